@@ -4,6 +4,7 @@
 #include "type.h"
 #include "sym.h"
 #include "ast.h"
+#include "table.h"
 
 typedef struct analyzerCtx {
     typeSys* ts;
@@ -107,6 +108,75 @@ static type* analyzeListLit (analyzerCtx* ctx, ast* node) {
     }
 }
 
+/*Whether values of a type can be hashed and compared, as Dict keys are.
+  Not Floats, as NaN isn't equal to itself.*/
+static bool typeIsKey (const type* dt) {
+    vector(const type*) types;
+
+    if (typeIsTupleOf(dt, &types)) {
+        bool keys = true;
+
+        for_vector (const type* element, types, {
+            keys &= typeIsKey(element);
+        })
+
+        return keys;
+    }
+
+    return    typeIsKind(type_Int, dt) || typeIsKind(type_Bool, dt)
+           || typeIsKind(type_Str, dt) || typeIsKind(type_File, dt)
+           || typeIsKind(type_Var, dt);
+}
+
+/*A Dict made by a fn (e.g. dict) must have keys that can be, as much
+  as one written as a literal*/
+static type* analyzeDictResult (analyzerCtx* ctx, type* result) {
+    type *keys, *values;
+
+    if (   typeIsDictOf(result, &keys, &values)
+        && !typeIsInvalid(keys) && !typeIsKey(keys)) {
+        error(ctx)("dict keys can't be %s\n", typeGetStr(keys));
+        return typeInvalid(ctx->ts);
+    }
+
+    return result;
+}
+
+static type* analyzeDictLit (analyzerCtx* ctx, ast* node) {
+    /*No entries => type is ['k: 'v] */
+    if (node->children.length == 0) {
+        type *K = typeVar(ctx->ts),
+             *V = typeVar(ctx->ts);
+        return typeForall(ctx->ts, K, typeForall(ctx->ts, V, typeDict(ctx->ts, K, V)));
+    }
+
+    /*Keys and values are each made consistent, like list elements*/
+    type *kinds[2] = {};
+
+    for_vector_indexed (i, ast* element, node->children, {
+        type* dt = analyzer(ctx, element);
+        type** expected = &kinds[i % 2];
+        type* unified;
+
+        if (!*expected)
+            *expected = dt;
+
+        else if (typeCanUnify(ctx->ts, *expected, dt, &unified))
+            *expected = unified;
+
+        else if (!typeIsInvalid(*expected) && !typeIsInvalid(dt))
+            error(ctx)("dict %s mismatch: given %s while others are %s\n",
+                       i % 2 ? "value" : "key", typeGetStr(dt), typeGetStr(*expected));
+    })
+
+    if (!typeIsInvalid(kinds[0]) && !typeIsKey(kinds[0])) {
+        error(ctx)("dict keys can't be %s\n", typeGetStr(kinds[0]));
+        return typeInvalid(ctx->ts);
+    }
+
+    return typeDict(ctx->ts, kinds[0], kinds[1]);
+}
+
 static type* analyzeLit (analyzerCtx* ctx, ast* node) {
     switch (node->kind) {
     case astUnitLit: return typeUnitary(ctx->ts, type_Unit);
@@ -114,6 +184,7 @@ static type* analyzeLit (analyzerCtx* ctx, ast* node) {
     case astFloatLit: return typeUnitary(ctx->ts, type_Float);
     case astBoolLit: return typeUnitary(ctx->ts, type_Bool);
     case astStrLit: return typeUnitary(ctx->ts, type_Str);
+    case astRegexLit: return typeUnitary(ctx->ts, type_Regex);
     case astFileLit: return typeUnitary(ctx->ts, type_File);
     /*This one thrown in too because it's similarly simple*/
     case astInvalid: return typeInvalid(ctx->ts);
@@ -204,7 +275,7 @@ static type* analyzeFnApp (analyzerCtx* ctx, ast* node) {
             type* callResult;
 
             if (typeAppliesToFn(ctx->ts, arg, result, &callResult))
-                result = callResult;
+                result = analyzeDictResult(ctx, callResult);
 
             else {
                 errorFnApp(ctx, arg, result);
@@ -218,7 +289,29 @@ static type* analyzeFnApp (analyzerCtx* ctx, ast* node) {
 
 /*---- Binary operators ----*/
 
+static bool isUnixInvocation (const ast* node) {
+    return    (node->kind == astFnApp && (node->flags & flagUnixInvocation))
+           || (node->kind == astBOP && (node->flags & flagUnixPipeline));
+}
+
+/*Values that can be written to the stdin of a program*/
+static bool isUnixInput (type* dt) {
+    type* elements;
+
+    return    typeIsKind(type_Str, dt)
+           || (typeIsListOf(dt, &elements) && typeIsKind(type_Str, elements));
+}
+
 static type* analyzePipe (analyzerCtx* ctx, ast* node, type* arg, type* fn) {
+    /*Programs piped into programs (given args or not) are connected
+      directly, stdout to stdin. Strings are written to their stdin.*/
+    if (   node->op == opPipe
+        && (isUnixInvocation(node->l) || isUnixInput(arg))
+        && (isUnixInvocation(node->r) || typeIsKind(type_File, fn))) {
+        node->flags |= flagUnixPipeline;
+        return typeUnitary(ctx->ts, type_Str);
+    }
+
     /*Work out what the result of the call is*/
     type* callResult; {
         type *elements;
@@ -239,6 +332,8 @@ static type* analyzePipe (analyzerCtx* ctx, ast* node, type* arg, type* fn) {
         }
     }
 
+    callResult = analyzeDictResult(ctx, callResult);
+
     if (node->op == opPipeZip)
         /*Zip up the arg with the result of (each/the) call*/
         callResult = typeTuple(ctx->ts, vectorInitChain(2, malloc, callResult, arg));
@@ -250,6 +345,105 @@ static type* analyzePipe (analyzerCtx* ctx, ast* node, type* arg, type* fn) {
         return callResult;
 }
 
+static type* analyzeFilter (analyzerCtx* ctx, ast* node, type* list, type* predicate) {
+    type *elements, *result;
+
+    if (typeIsInvalid(list) || typeIsInvalid(predicate))
+        return typeInvalid(ctx->ts);
+
+    else if (!typeIsListOf(list, &elements)) {
+        error(ctx)("operator (%s): %s is not a list\n", opKindGetStr(node->op), typeGetStr(list));
+        return typeInvalid(ctx->ts);
+
+    } else if (!typeAppliesToFn(ctx->ts, elements, predicate, &result)) {
+        errorFnApp(ctx, elements, predicate);
+        return typeInvalid(ctx->ts);
+
+    } else if (!typeIsKind(type_Bool, result)) {
+        error(ctx)("operator (%s): predicate returns %s, not a Bool\n",
+                   opKindGetStr(node->op), typeGetStr(result));
+        return typeInvalid(ctx->ts);
+    }
+
+    return list;
+}
+
+static type* analyzeReduce (analyzerCtx* ctx, ast* node, type* list, type* fn) {
+    type *elements, *partial, *result, *unified;
+
+    if (typeIsInvalid(list) || typeIsInvalid(fn))
+        return typeInvalid(ctx->ts);
+
+    else if (!typeIsListOf(list, &elements)) {
+        error(ctx)("operator (%s): %s is not a list\n", opKindGetStr(node->op), typeGetStr(list));
+        return typeInvalid(ctx->ts);
+    }
+
+    /*The fn must combine two elements into another element*/
+    bool combines =    typeAppliesToFn(ctx->ts, elements, fn, &partial)
+                    && typeAppliesToFn(ctx->ts, elements, partial, &result)
+                    && typeCanUnify(ctx->ts, elements, result, &unified);
+
+    if (!combines) {
+        error(ctx)("operator (%s): %s can't combine elements of %s\n",
+                   opKindGetStr(node->op), typeGetStr(fn), typeGetStr(list));
+        return typeInvalid(ctx->ts);
+    }
+
+    return unified;
+}
+
+static type* analyzeWrite (analyzerCtx* ctx, ast* node, type* from, type* to) {
+    type* elements;
+
+    if (typeIsInvalid(from) || typeIsInvalid(to))
+        return typeInvalid(ctx->ts);
+
+    else if (!typeIsKind(type_File, to)) {
+        error(ctx)("operator (%s): %s is not a File to write to\n", opKindGetStr(node->op), typeGetStr(to));
+        return typeInvalid(ctx->ts);
+    }
+
+    bool files =    typeIsKind(type_File, from)
+                 || (typeIsListOf(from, &elements) && typeIsKind(type_File, elements));
+
+    /*Files are copied, a list of them into a directory*/
+    if (files && node->op == opWrite)
+        return from;
+
+    else if (files) {
+        error(ctx)("operator (%s): %s can only be copied, with (|>)\n", opKindGetStr(node->op), typeGetStr(from));
+        return typeInvalid(ctx->ts);
+
+    /*Anything else is serialized into the file*/
+    } else if (   typeIsKind(type_Unit, from) || typeIsKind(type_Fn, from)
+               || typeIsKind(type_Forall, from)) {
+        error(ctx)("operator (%s): %s can't be written to a file\n", opKindGetStr(node->op), typeGetStr(from));
+        return typeInvalid(ctx->ts);
+    }
+
+    return to;
+}
+
+static type* analyzeLookup (analyzerCtx* ctx, ast* node, type* dict, type* key) {
+    type *keys, *values, *unified;
+
+    if (typeIsInvalid(dict) || typeIsInvalid(key))
+        return typeInvalid(ctx->ts);
+
+    else if (!typeIsDictOf(dict, &keys, &values)) {
+        error(ctx)("operator (%s): %s is not a Dict\n", opKindGetStr(node->op), typeGetStr(dict));
+        return typeInvalid(ctx->ts);
+
+    } else if (!typeCanUnify(ctx->ts, keys, key, &unified)) {
+        error(ctx)("operator (%s): %s is not a key of %s\n",
+                   opKindGetStr(node->op), typeGetStr(key), typeGetStr(dict));
+        return typeInvalid(ctx->ts);
+    }
+
+    return values;
+}
+
 static const char* nameTypeKind (typeKind kind, bool plural) {
     switch (kind) {
     case type_Int: return plural ? "Ints" : "an Int";
@@ -311,6 +505,14 @@ static type* analyzeBOP (analyzerCtx* ctx, ast* node) {
     case opPipeZip:
         return analyzePipe(ctx, node, left, right);
 
+    case opFilter: return analyzeFilter(ctx, node, left, right);
+    case opReduce: return analyzeReduce(ctx, node, left, right);
+    case opWrite:
+    case opAppend:
+        return analyzeWrite(ctx, node, left, right);
+
+    case opLookup: return analyzeLookup(ctx, node, left, right);
+
     case opAdd:
     case opSubtract:
     case opMultiply:
@@ -329,6 +531,25 @@ static type* analyzeBOP (analyzerCtx* ctx, ast* node) {
 
 /*---- ----*/
 
+static type* analyzeTypeHint (analyzerCtx* ctx, ast* node) {
+    type *given = analyzer(ctx, node->l),
+         *hint = node->dt,
+         *unified;
+
+    if (typeCanUnify(ctx->ts, given, hint, &unified))
+        return unified;
+
+    /*Rows of strings, e.g. from readTable, are parsed into the fields*/
+    else if (tableCanConvert(given, hint)) {
+        node->flags |= flagTableConversion;
+        return hint;
+
+    } else if (!typeIsInvalid(given))
+        error(ctx)("%s can't be given the type %s\n", typeGetStr(given), typeGetStr(hint));
+
+    return typeInvalid(ctx->ts);
+}
+
 static type* analyzeLet (analyzerCtx* ctx, ast* node) {
     type* init = analyzer(ctx, node->r);
 
@@ -347,6 +568,7 @@ static type* analyzer (analyzerCtx* ctx, ast* node) {
         [astFnLit] = analyzeFnLit,
         [astTupleLit] = analyzeTupleLit,
         [astListLit] = analyzeListLit,
+        [astDictLit] = analyzeDictLit,
         /*Common handler*/
         [astInvalid] = analyzeLit,
         [astUnitLit] = analyzeLit,
@@ -354,13 +576,15 @@ static type* analyzer (analyzerCtx* ctx, ast* node) {
         [astFloatLit] = analyzeLit,
         [astBoolLit] = analyzeLit,
         [astStrLit] = analyzeLit,
+        [astRegexLit] = analyzeLit,
         [astFileLit] = analyzeLit,
         /*---*/
         [astGlobLit] = analyzeGlobLit,
         [astSymbol] = analyzeSymbol,
         [astFnApp] = analyzeFnApp,
         [astBOP] = analyzeBOP,
-        [astLet] = analyzeLet
+        [astLet] = analyzeLet,
+        [astTypeHint] = analyzeTypeHint
     };
 
     if (!node) {
@@ -397,9 +621,10 @@ analyzerResult analyze (typeSys* ts, ast* node) {
     analyzerCtx ctx = analyzerInit(ts);
     analyzer(&ctx, node);
 
-    /*A top level fn app gets to execute synchronously.
-      That is, take control of the terminal and return only an error code.*/
-    if (node->kind == astFnApp && (node->flags & flagUnixInvocation)) {
+    /*A top level fn app (or pipeline) gets to execute synchronously.
+      That is, take control of the terminal and return only an error code.
+      Not if it's in the background, where its output is kept.*/
+    if (isUnixInvocation(node) && !(node->flags & flagBackground)) {
         node->flags |= flagUnixSynchronous;
         node->dt = typeUnitary(ts, type_Int);
     }
@@ -6,6 +6,7 @@
 #include "type.h"
 #include "ast.h"
 #include "sym.h"
+#include "regex.h"
 
 typedef struct printerCtx {
     int depth;
@@ -62,6 +63,10 @@ static void printer (printerCtx* ctx, const ast* node) {
         printer_outf(ctx)("\"%s\"\n", node->literal.str);
         break;
 
+    case astRegexLit:
+        printer_outf(ctx)("regex: %s\n", regexGetPattern(node->literal.regex));
+        break;
+
     case astFileLit:
         printer_outf(ctx)("file: %s\n", node->literal.str);
         break;
@@ -75,6 +80,13 @@ static void printer (printerCtx* ctx, const ast* node) {
             printer_outf(ctx)("capture: %s\n", symGetName(capture));
         })
 
+        if (node->hoisted) {
+            for_vector (ast* let, *node->hoisted, {
+                printer_outf(ctx)("hoisted:\n");
+                printer(ctx, let);
+            })
+        }
+
         break;
 
     case astSymbol:
@@ -85,6 +97,7 @@ static void printer (printerCtx* ctx, const ast* node) {
     case astTypeHint:
     case astListLit:
     case astTupleLit:
+    case astDictLit:
     case astFnApp:
     case astBOP:
     case astInvalid:
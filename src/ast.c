@@ -32,9 +32,22 @@ void astDestroy (ast* node) {
         free(node->captured);
     }
 
+    if (node->kind == astFnLit && node->hoisted) {
+        vectorFreeObjs(node->hoisted, (vectorDtor) astDestroy);
+        free(node->hoisted);
+    }
+
     free(node);
 }
 
+void astReplace (ast* node, ast* replacement) {
+    /*Move the contents out to be destroyed*/
+    astDestroy(malloci(sizeof(ast), node));
+
+    *node = *replacement;
+    free(replacement);
+}
+
 ast* astCreateListLit (vector(ast*) elements) {
     return astCreate(astListLit, (ast) {
         .children = elements,
@@ -47,6 +60,12 @@ ast* astCreateTupleLit (vector(ast*) elements) {
     });
 }
 
+ast* astCreateDictLit (vector(ast*) entries) {
+    return astCreate(astDictLit, (ast) {
+        .children = entries,
+    });
+}
+
 ast* astCreateFnLit (vector(ast*) args, ast* expr, vector(sym*) captured) {
     return astCreate(astFnLit, (ast) {
         .children = args, .r = expr,
@@ -82,6 +101,12 @@ ast* astCreateStrLit (const char* str) {
     });
 }
 
+ast* astCreateRegexLit (regex* re) {
+    return astCreate(astRegexLit, (ast) {
+        .literal.regex = re,
+    });
+}
+
 ast* astCreateFileLit (const char* str, astFlags flags) {
     return astCreate(astFileLit, (ast) {
         .flags = flags, .literal.str = strdup(str),
@@ -115,12 +140,10 @@ ast* astCreateBOP (ast* l, ast* r, opKind op) {
     });
 }
 
-ast* astCreateTypeHint (ast* symbol, type* dt) {
-    precond(symbol->kind == astSymbol);
-    precond(symbol->symbol);
-
+ast* astCreateTypeHint (ast* expr, type* dt) {
     return astCreate(astTypeHint, (ast) {
-        .l = symbol, .dt = dt, .symbol = symbol->symbol
+        .l = expr, .dt = dt,
+        .symbol = expr->kind == astSymbol ? expr->symbol : 0
     });
 }
 
@@ -170,6 +193,15 @@ ast* astDup (const ast* original, malloc_t malloc) {
             *node->captured = vectorDup(*original->captured, malloc);
         }
 
+        if (original->hoisted) {
+            node->hoisted = malloc(sizeof(vector));
+            *node->hoisted = vectorInit(original->hoisted->length, malloc);
+
+            for_vector (ast* let, *original->hoisted, {
+                vectorPush(node->hoisted, astDup(let, malloc));
+            })
+        }
+
         break;
 
     default:
@@ -185,7 +217,11 @@ const char* opKindGetStr (opKind kind) {
     switch (kind) {
     case opPipe: return "|";
     case opPipeZip: return "|:";
+    case opFilter: return "|?";
+    case opReduce: return "|/";
     case opWrite: return "|>";
+    case opAppend: return "|+>";
+    case opLookup: return ":";
     case opLogicalAnd: return "&&";
     case opLogicalOr: return "||";
     case opEqual: return "==";
@@ -213,10 +249,12 @@ const char* astKindGetStr (astKind kind) {
     case astFloatLit: return "FloatLit";
     case astBoolLit: return "BoolLit";
     case astStrLit: return "StrLit";
+    case astRegexLit: return "RegexLit";
     case astFileLit: return "FileLit";
     case astGlobLit: return "GlobLit";
     case astListLit: return "ListLit";
     case astTupleLit: return "TupleLit";
+    case astDictLit: return "DictLit";
     case astFnLit: return "FnLit";
     case astBOP: return "BOP";
     case astFnApp: return "FnApp";
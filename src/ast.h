@@ -6,7 +6,7 @@
 
 typedef enum astKind {
     astUnitLit, astIntLit, astFloatLit, astBoolLit, astStrLit,
-    astFileLit, astGlobLit, astListLit, astTupleLit, astFnLit,
+    astRegexLit, astFileLit, astGlobLit, astListLit, astTupleLit, astDictLit, astFnLit,
     astBOP, astFnApp, astSymbol,
     astLet, astTypeHint,
     astInvalid,
@@ -17,17 +17,24 @@ typedef enum astFlags {
     flagNone = 0,
     /*FnApp*/
     flagUnixInvocation = 1 << 0,
+    /*FnApp, BOP[o=Pipe]*/
     flagUnixSynchronous = 1 << 1,
-    /*BOP[o=Pipe]*/
+    /*BOP[o=Pipe PipeZip]*/
     flagListApplication = 1 << 2,
     /*FileLit*/
     flagAbsolutePath = 1 << 3,
-    flagAllowPathSearch = 1 << 4
+    flagAllowPathSearch = 1 << 4,
+    /*BOP[o=Pipe]*/
+    flagUnixPipeline = 1 << 5,
+    /*Any statement: Let, or the root of an expression*/
+    flagBackground = 1 << 6,
+    /*TypeHint*/
+    flagTableConversion = 1 << 7
 } astFlags;
 
 typedef enum opKind {
     opNull = 0,
-    opPipe, opPipeZip, opWrite,
+    opPipe, opPipeZip, opFilter, opReduce, opWrite, opAppend, opLookup,
     opLogicalAnd, opLogicalOr,
     opEqual, opNotEqual, opLess, opLessEqual, opGreater, opGreaterEqual,
     opAdd, opSubtract, opConcat,
@@ -54,11 +61,19 @@ typedef struct ast {
             bool truth;
             /*StrLit FileLit GlobLit*/
             char* str;
+            /*RegexLit, compiled by the parser and never freed*/
+            regex* regex;
         } literal;
 
         /*FnLit*/
-        vector(sym*)* captured;
-        /*Symbol Let*/
+        struct {
+            vector(sym*)* captured;
+            /*Lets of subexpressions hoisted out of the body by the
+              optimizer. Run once, when the closure is created.
+              May be null.*/
+            vector(ast*)* hoisted;
+        };
+        /*Symbol Let, TypeHint of a symbol*/
         sym* symbol;
     };
 } ast;
@@ -66,12 +81,15 @@ typedef struct ast {
 ast* astCreateFnLit (vector(ast*) args, ast* expr, vector(sym*) captured);
 ast* astCreateTupleLit (vector(ast*) elements);
 ast* astCreateListLit (vector(ast*) elements);
+/*The children alternate between keys and their values*/
+ast* astCreateDictLit (vector(ast*) entries);
 
 ast* astCreateUnitLit (void);
 ast* astCreateIntLit (int64_t integer);
 ast* astCreateFloatLit (double number);
 ast* astCreateBoolLit (bool truth);
 ast* astCreateStrLit (const char* str);
+ast* astCreateRegexLit (regex* re);
 ast* astCreateFileLit (const char* str, astFlags flags);
 ast* astCreateGlobLit (const char* str, astFlags flags);
 
@@ -79,13 +97,19 @@ ast* astCreateSymbol (sym* symbol);
 ast* astCreateFnApp (vector(ast*) args, ast* fn);
 ast* astCreateBOP (ast* l, ast* r, opKind op);
 
-ast* astCreateTypeHint (ast* symbol, type* dt);
+/*Of a pattern (a symbol) or of any expression*/
+ast* astCreateTypeHint (ast* expr, type* dt);
 ast* astCreateLet (sym* symbol, ast* init);
 
 ast* astCreateInvalid (void);
 
 void astDestroy (ast* node);
 
+/*Destroy the contents of a node and move another into its place
+  (freeing the replacement's own allocation). The replacement must not
+  be owned by the node.*/
+void astReplace (ast* node, ast* replacement);
+
 /*Duplicate an entire AST tree, including all owned objects*/
 ast* astDup (const ast* tree, malloc_t malloc);
 
@@ -1,4 +1,14 @@
-#include <glob.h>
+/*For d_type and memmem*/
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <gc.h>
 #include <vector.h>
@@ -7,11 +17,169 @@
 #include "type.h"
 #include "value.h"
 #include "sym.h"
+#include "paths.h"
+#include "terminal.h"
+#include "scan.h"
+#include "table.h"
+#include "regex.h"
+#include "parallel.h"
+#include "hash.h"
+#include "du.h"
+#include "copy.h"
+#include "dict.h"
+#include "builtins.h"
+
+/*==== Globs ====*/
+
+/*A glob is expanded lazily, reading a directory only once the matches
+  before it have all been asked for. This lets a consumer that only
+  needs some of the matches stop the traversal early.
+
+  The pending work is a stack of (path, segment) pairs: the path has
+  matched the segments of the pattern before the given one. Once all
+  the segments have been matched, the path is a result.*/
+
+typedef struct globFrame {
+    /*Relative to the working dir, or absolute if there is none*/
+    const char* path;
+    int segment;
+} globFrame;
+
+typedef struct globCtx {
+    const char* workingDir;
+    vector(const char*) segments;
+    vector(globFrame*) stack;
+} globCtx;
+
+static bool isGlobSegment (const char* segment) {
+    return strpbrk(segment, "*?[") != 0;
+}
+
+static const char* globJoin (const char* dir, const char* name) {
+    if (dir[0] == 0)
+        return GC_STRDUP(name);
+
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char* path = GC_MALLOC_ATOMIC(length);
+    bool slash = dir[strlen(dir)-1] != '/';
+    snprintf(path, length, slash ? "%s/%s" : "%s%s", dir, name);
+    return path;
+}
+
+/*The path that can actually be given to the OS*/
+static const char* globRealPath (globCtx* ctx, const char* path) {
+    if (!ctx->workingDir)
+        return path;
+
+    else if (path[0] == 0)
+        return ctx->workingDir;
+
+    else
+        return globJoin(ctx->workingDir, path);
+}
+
+static void globPush (globCtx* ctx, const char* path, int segment) {
+    globFrame* frame = GC_MALLOC(sizeof(globFrame));
+    *frame = (globFrame) {path, segment};
+    vectorPush(&ctx->stack, frame);
+}
+
+static bool globIsDir (globCtx* ctx, const char* path, const struct dirent* entry, bool followLinks) {
+    if (entry->d_type != DT_UNKNOWN && (entry->d_type != DT_LNK || !followLinks))
+        return entry->d_type == DT_DIR;
+
+    /*Only stat if the directory entry didn't say*/
+    if (followLinks)
+        return pathIsDir(globRealPath(ctx, path));
+
+    struct stat st;
+    return !lstat(globRealPath(ctx, path), &st) && S_ISDIR(st.st_mode);
+}
+
+/*Read the entries of a directory matching a segment, in alphabetical
+  order, and push them so that they'll be popped in that order.*/
+static void globExpandDir (globCtx* ctx, globFrame* frame, const char* segment, bool onlyDirs) {
+    DIR* dir = opendir(globRealPath(ctx, frame->path));
+
+    if (!dir)
+        return;
+
+    bool recursive = !strcmp(segment, "**");
+    vector(const char*) matches = vectorInit(32, GC_malloc);
+
+    for (struct dirent* entry; (entry = readdir(dir));) {
+        const char* name = entry->d_name;
+
+        bool matched =   recursive
+                       ? name[0] != '.'
+                       : !fnmatch(segment, name, FNM_PERIOD);
+
+        if (!matched)
+            continue;
+
+        const char* path = globJoin(frame->path, name);
+
+        /*A ** doesn't follow links, which could form cycles*/
+        if (onlyDirs && !globIsDir(ctx, path, entry, !recursive))
+            continue;
+
+        vectorPush(&matches, path);
+    }
+
+    closedir(dir);
+
+    qsort(matches.buffer, matches.length, sizeof(void*), qsort_cstr);
+
+    /*A ** stays on the same segment, as it matches any depth*/
+    int next = recursive ? frame->segment : frame->segment+1;
+
+    for_vector_reverse (const char* path, matches, {
+        globPush(ctx, path, next);
+    })
+}
+
+static value* globNext (globCtx* ctx) {
+    /*Checked before popping, so a cancelled glob can carry on later*/
+    while (ctx->stack.length != 0 && !cancelled()) {
+        globFrame* frame = vectorPop(&ctx->stack);
+
+        /*Fully matched (a trailing ** also matches the starting dir, skip it)*/
+        if (frame->segment == ctx->segments.length) {
+            if (frame->path[0] == 0)
+                continue;
+
+            return valueCreateFile(frame->path, ctx->workingDir);
+        }
+
+        const char* segment = vectorGet(ctx->segments, frame->segment);
+        bool last = frame->segment+1 == ctx->segments.length;
+
+        if (!strcmp(segment, "**")) {
+            /*Subdirectories go under the matches of the rest of the pattern here,
+              so the rest are popped first*/
+            globExpandDir(ctx, frame, segment, true);
+            globPush(ctx, frame->path, frame->segment+1);
+
+        } else if (isGlobSegment(segment)) {
+            globExpandDir(ctx, frame, segment, !last);
+
+        /*A plain name, only needs to exist*/
+        } else {
+            const char* path = globJoin(frame->path, segment);
+            struct stat st;
+
+            if (!lstat(globRealPath(ctx, path), &st))
+                globPush(ctx, path, frame->segment+1);
+        }
+    }
+
+    return 0;
+}
 
 value* builtinExpandGlob (const char* pattern, const char* workingDir) {
     /*No working dir => the path is absolute*/
     if (!workingDir) {
-        /*Must be provided to glob() as such*/
+        /*Must start at the root*/
         if (!precond(pattern[0] == '/')) {
             size_t length = strlen(pattern) + 2;
             char* absolutepattern = GC_MALLOC(length);
@@ -23,29 +191,30 @@ value* builtinExpandGlob (const char* pattern, const char* workingDir) {
         }
     }
 
-    value* result;
-
-    glob_t matches = {};
-    int error = glob(pattern, 0, 0, &matches);
-
-    if (error)
-        result = valueStoreTuple(0);
+    globCtx* ctx = GC_MALLOC(sizeof(globCtx));
+    *ctx = (globCtx) {
+        .workingDir = workingDir,
+        .segments = vectorInit(8, GC_malloc),
+        .stack = vectorInit(32, GC_malloc)
+    };
 
-    else {
-        vector(value*) results = vectorInit(matches.gl_pathc, GC_malloc);
+    char* segments = pathGetSegments(pattern, GC_malloc);
 
-        /*Box the strings in value objects*/
-        for (unsigned int n = 0; n < matches.gl_pathc; n++)
-            vectorPush(&results, valueCreateFile(matches.gl_pathv[n], workingDir));
+    for (char* segment = segments; *segment; segment += strlen(segment)+1) {
+        /*The root segment is where the traversal starts, not a match*/
+        if (!strcmp(segment, "/"))
+            continue;
 
-        result = valueStoreVector(results);
+        vectorPush(&ctx->segments, segment);
     }
 
-    globfree(&matches);
+    globPush(ctx, workingDir ? "" : "/", 0);
 
-    return result;
+    return valueCreateStream(ctx, (streamNextFn) globNext);
 }
 
+/*==== ====*/
+
 static value* builtinSize (const value* file) {
     const char* filename = valueGetFilename(file);
 
@@ -73,18 +242,21 @@ static value* builtinLinecount (const value* file) {
         return valueCreateInvalid();
 
     int lines = 1;
-    int lastch = 0;
+    char lastch = 0;
 
-    while (true) {
-        int ch = fgetc(f);
+    /*A block at a time, checking for a cancellation between them*/
+    char buffer[64*1024];
 
-        if (ch == '\n')
-            lines++;
+    for (size_t length; (length = fread(buffer, 1, sizeof(buffer), f));) {
+        if (cancelled()) {
+            fclose(f);
+            return valueCreateInvalid();
+        }
 
-        else if (ch == EOF)
-            break;
+        for (char* ch = buffer; (ch = memchr(ch, '\n', buffer+length - ch)); ch++)
+            lines++;
 
-        lastch = ch;
+        lastch = buffer[length-1];
     }
 
     if (lastch == '\n')
@@ -95,6 +267,752 @@ static value* builtinLinecount (const value* file) {
     return valueCreateInt(lines);
 }
 
+/*---- Reading files ----*/
+
+enum {
+    /*Smaller files are cheaper to read than to map*/
+    readMapMinSize = 64*1024,
+    readBlockSize = 64*1024
+};
+
+/*At least a byte past the file, for the terminator*/
+static size_t readMapLength (size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size/page + 1) * page;
+}
+
+static void readUnmap (const char* str, size_t size) {
+    munmap((void*) str, readMapLength(size));
+}
+
+/*Map a file, followed by zeroes so that it is null terminated even when
+  it ends on a page boundary. The whole range is reserved as zero pages
+  and the file mapped over the start of it.
+  A file truncated while mapped faults when read past its new end, like
+  any mapping.*/
+static char* readMap (int fd, size_t size) {
+    size_t length = readMapLength(size);
+
+    char* reserved = mmap(0, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (reserved == MAP_FAILED)
+        return 0;
+
+    char* str = mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+
+    if (str == MAP_FAILED) {
+        munmap(reserved, length);
+        return 0;
+    }
+
+    return str;
+}
+
+static value* readMapped (int fd, size_t size) {
+    char* str = readMap(fd, size);
+    return str ? valueStoreStr(str, size, readUnmap) : 0;
+}
+
+/*For pipes, procfs and others that can't be mapped or don't know their size*/
+static value* readAll (int fd, size_t sizeHint) {
+    size_t capacity = sizeHint ? sizeHint+1 : readBlockSize,
+           length = 0;
+
+    char* str = GC_MALLOC_ATOMIC(capacity);
+
+    for (;;) {
+        if (cancelled())
+            return valueCreateInvalid();
+
+        /*Full, maybe just with the whole file as hinted. Only grow if
+          there is more.*/
+        if (length+1 == capacity) {
+            char more;
+            ssize_t got = read(fd, &more, 1);
+
+            if (got < 0 && errno == EINTR)
+                continue;
+
+            else if (got <= 0)
+                break;
+
+            capacity = 2*capacity + readBlockSize;
+            str = GC_REALLOC(str, capacity);
+            str[length++] = more;
+        }
+
+        ssize_t got = read(fd, str+length, capacity-length-1);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        else if (got < 0)
+            return valueCreateInvalid();
+
+        else if (got == 0)
+            break;
+
+        length += got;
+    }
+
+    str[length] = 0;
+
+    return valueStoreStr(str, length, 0);
+}
+
+static value* builtinRead (const value* file) {
+    const char* filename = valueGetFilename(file);
+
+    if (!filename)
+        return valueCreateInvalid();
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return valueCreateInvalid();
+
+    struct stat st;
+    bool regular = !fstat(fd, &st) && S_ISREG(st.st_mode);
+
+    value* contents = 0;
+
+    if (regular && st.st_size >= readMapMinSize)
+        contents = readMapped(fd, st.st_size);
+
+    if (!contents)
+        contents = readAll(fd, regular ? st.st_size : 0);
+
+    close(fd);
+
+    return contents;
+}
+
+/*The contents of a file being searched or hashed, which aren't kept:
+  mapped if large, otherwise read into a buffer that is freed straight
+  after*/
+typedef struct fileContents {
+    char* str;
+    size_t length;
+    bool mapped;
+} fileContents;
+
+static char* contentsReadAll (int fd, size_t sizeHint, size_t* length_out) {
+    size_t capacity = sizeHint ? sizeHint+1 : readBlockSize,
+           length = 0;
+
+    char* str = malloc(capacity);
+
+    for (;;) {
+        if (length == capacity) {
+            capacity *= 2;
+            str = realloc(str, capacity);
+        }
+
+        ssize_t got = read(fd, str+length, capacity-length);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        /*Directories fail here*/
+        else if (got < 0) {
+            free(str);
+            return 0;
+
+        } else if (got == 0)
+            break;
+
+        length += got;
+    }
+
+    *length_out = length;
+    return str;
+}
+
+static bool contentsOpen (const char* filename, fileContents* file) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool regular = !fstat(fd, &st) && S_ISREG(st.st_mode);
+
+    *file = (fileContents) {};
+
+    if (regular && st.st_size >= readMapMinSize && (file->str = readMap(fd, st.st_size))) {
+        file->length = st.st_size;
+        file->mapped = true;
+        madvise(file->str, st.st_size, MADV_SEQUENTIAL);
+
+    } else
+        file->str = contentsReadAll(fd, regular ? st.st_size : 0, &file->length);
+
+    close(fd);
+
+    return file->str;
+}
+
+static void contentsClose (fileContents* file) {
+    if (file->mapped)
+        readUnmap(file->str, file->length);
+
+    else
+        free(file->str);
+}
+
+/*---- Searching files ----*/
+
+/*Stops at the first line that matches*/
+static value* builtinContains (const value* re, const value* file) {
+    const regex* compiled = valueGetRegex(re);
+    const char* filename = valueGetFilename(file);
+    fileContents contents;
+
+    if (!compiled || !filename || !contentsOpen(filename, &contents))
+        return valueCreateInvalid();
+
+    const char* lineEnd;
+    bool found = regexFindLine(compiled, contents.str, contents.str + contents.length, &lineEnd);
+
+    contentsClose(&contents);
+
+    return valueCreateInt(found);
+}
+
+static value* builtinContainsCurried (const value* re) {
+    return valueCreateSimpleClosure(re, (simpleClosureFn) builtinContains);
+}
+
+/*The files are searched a batch at a time, in parallel, as the rows are
+  asked for. The lines matched are copied so the files can be let go of.*/
+typedef struct searchCtx {
+    const regex* re;
+    valueIter files;
+
+    vector(const value*) batch;
+    /*The rows from each file of the batch*/
+    vector(value*)* found;
+
+    /*Rows not yet read*/
+    vector(value*) ready;
+    int readyPos;
+} searchCtx;
+
+static void searchFiles (searchCtx* ctx, int start, int end) {
+    for (int i = start; i < end && !cancelled(); i++) {
+        value* file = (value*) vectorGet(ctx->batch, i);
+        vector(value*)* rows = &ctx->found[i];
+        *rows = vectorInit(4, GC_malloc);
+
+        const char* filename = valueGetFilename(file);
+        fileContents contents;
+
+        if (!filename || !contentsOpen(filename, &contents))
+            continue;
+
+        const char *str = contents.str,
+                   *end = str + contents.length,
+                   *line, *lineEnd;
+
+        while (!cancelled() && (line = regexFindLine(ctx->re, str, end, &lineEnd))) {
+            size_t length = lineEnd - line;
+            char* copy = GC_MALLOC_ATOMIC(length+1);
+            memcpy(copy, line, length);
+            copy[length] = 0;
+
+            vectorPush(rows, valueStoreTuple(2, file, valueStoreStr(copy, length, 0)));
+
+            const char* eol = memchr(lineEnd, '\n', end - lineEnd);
+            str = eol ? eol+1 : end;
+        }
+
+        contentsClose(&contents);
+    }
+}
+
+static value* searchNext (searchCtx* ctx) {
+    int batchSize = parallelThreads() * 4;
+
+    while (ctx->readyPos == ctx->ready.length && !cancelled()) {
+        ctx->batch.length = 0;
+
+        for (const value* file;
+             ctx->batch.length < batchSize && (file = valueIterRead(&ctx->files));)
+            vectorPush(&ctx->batch, file);
+
+        if (ctx->batch.length == 0)
+            return 0;
+
+        ctx->found = GC_MALLOC(sizeof(vector) * ctx->batch.length);
+        parallelFor(ctx->batch.length, 1, (parallelBody) searchFiles, ctx);
+
+        ctx->ready.length = ctx->readyPos = 0;
+
+        for (int i = 0; i < ctx->batch.length; i++)
+            for_vector (value* row, ctx->found[i], {
+                vectorPush(&ctx->ready, row);
+            })
+    }
+
+    /*Cancelled*/
+    if (ctx->readyPos == ctx->ready.length)
+        return 0;
+
+    return vectorGet(ctx->ready, ctx->readyPos++);
+}
+
+static value* builtinSearch (const value* re, const value* files) {
+    const regex* compiled = valueGetRegex(re);
+
+    if (!compiled)
+        return valueCreateInvalid();
+
+    searchCtx* ctx = GC_MALLOC(sizeof(searchCtx));
+    *ctx = (searchCtx) {
+        .re = compiled,
+        .batch = vectorInit(parallelThreads() * 4, GC_malloc),
+        .ready = vectorInit(64, GC_malloc)
+    };
+
+    if (valueGetIterator(files, &ctx->files))
+        return valueCreateInvalid();
+
+    return valueCreateStream(ctx, (streamNextFn) searchNext);
+}
+
+static value* builtinSearchCurried (const value* re) {
+    return valueCreateSimpleClosure(re, (simpleClosureFn) builtinSearch);
+}
+
+/*---- Hashing files ----*/
+
+static value* hashFile (const value* file, bool cryptographic) {
+    const char* filename = valueGetFilename(file);
+    fileContents contents;
+
+    if (!filename || !contentsOpen(filename, &contents))
+        return valueCreateInvalid();
+
+    char* hex;
+
+    if (cryptographic) {
+        uint8_t digest[hashSHA256Size];
+        hashSHA256(contents.str, contents.length, digest);
+
+        hex = GC_MALLOC_ATOMIC(2*hashSHA256Size + 1);
+        hashToHex(digest, hashSHA256Size, hex);
+
+    } else {
+        /*As xxhsum writes it*/
+        hex = GC_MALLOC_ATOMIC(17);
+        snprintf(hex, 17, "%016" PRIx64, hashFast(contents.str, contents.length, 0));
+    }
+
+    contentsClose(&contents);
+
+    return valueStoreStr(hex, strlen(hex), 0);
+}
+
+static value* builtinHash (const value* file) {
+    return hashFile(file, false);
+}
+
+static value* builtinSHA256 (const value* file) {
+    return hashFile(file, true);
+}
+
+/*Files are grouped by size, and only those that share a size with
+  another are hashed*/
+typedef struct dupsFile {
+    const value* file;
+    /*Its position in the list given*/
+    int index;
+    off_t size;
+    dev_t dev;
+    ino_t ino;
+    /*Null if it couldn't be read*/
+    const value* hash;
+} dupsFile;
+
+enum {
+    /*Files stat'd per chunk of parallel work*/
+    dupsStatChunkSize = 64
+};
+
+typedef struct dupsCtx {
+    dupsFile* files;
+    /*Those to be hashed*/
+    dupsFile** candidates;
+} dupsCtx;
+
+static void dupsStat (dupsCtx* ctx, int start, int end) {
+    for (int i = start; i < end && !cancelled(); i++) {
+        dupsFile* file = &ctx->files[i];
+        const char* filename = valueGetFilename(file->file);
+        struct stat st;
+
+        /*Empty files, and anything else, are left out with a size of 0*/
+        if (filename && !stat(filename, &st) && S_ISREG(st.st_mode))
+            *file = (dupsFile) {
+                .file = file->file, .index = i,
+                .size = st.st_size, .dev = st.st_dev, .ino = st.st_ino
+            };
+    }
+}
+
+static void dupsHash (dupsCtx* ctx, int start, int end) {
+    for (int i = start; i < end && !cancelled(); i++) {
+        value* hash = builtinHash(ctx->candidates[i]->file);
+        ctx->candidates[i]->hash = valueIsInvalid(hash) ? 0 : hash;
+    }
+}
+
+/*Largest first, so that the biggest waste of space comes first*/
+static int compareSize (const dupsFile* l, const dupsFile* r) {
+    return (l->size < r->size) - (l->size > r->size);
+}
+
+static int compareSizeThenInode (const void* left, const void* right) {
+    const dupsFile *l = left, *r = right;
+
+    return   compareSize(l, r) ? compareSize(l, r)
+           : l->dev != r->dev ? (l->dev > r->dev) - (l->dev < r->dev)
+           : l->ino != r->ino ? (l->ino > r->ino) - (l->ino < r->ino)
+           : l->index - r->index;
+}
+
+static int compareSizeThenHash (const void* left, const void* right) {
+    dupsFile *const *l = left, *const *r = right;
+    int byHash = strcmp(valueGetStr((*l)->hash), valueGetStr((*r)->hash));
+
+    return   compareSize(*l, *r) ? compareSize(*l, *r)
+           : byHash ? byHash
+           : (*l)->index - (*r)->index;
+}
+
+static value* builtinDups (const value* list) {
+    vector(const value*) files = valueGetVector(list);
+
+    dupsCtx ctx = {
+        .files = GC_MALLOC(sizeof(dupsFile) * (files.length + 1)),
+        .candidates = GC_MALLOC(sizeof(dupsFile*) * (files.length + 1))
+    };
+
+    for (int i = 0; i < files.length; i++)
+        ctx.files[i] = (dupsFile) {.file = vectorGet(files, i), .index = i};
+
+    parallelFor(files.length, dupsStatChunkSize, (parallelBody) dupsStat, &ctx);
+
+    qsort(ctx.files, files.length, sizeof(dupsFile), compareSizeThenInode);
+
+    /*Candidates share their size with a different file. Hard links to
+      a file seen already are the same file, not a copy.*/
+    int candidateNo = 0;
+
+    for (int i = 0; i < files.length && ctx.files[i].size; ) {
+        int sameSize = i;
+        int first = candidateNo;
+
+        for (; sameSize < files.length && !compareSize(&ctx.files[i], &ctx.files[sameSize]); sameSize++) {
+            dupsFile *file = &ctx.files[sameSize],
+                     *last = candidateNo > first ? ctx.candidates[candidateNo-1] : 0;
+
+            if (!last || last->dev != file->dev || last->ino != file->ino)
+                ctx.candidates[candidateNo++] = file;
+        }
+
+        /*Only one of this size*/
+        if (candidateNo - first == 1)
+            candidateNo = first;
+
+        i = sameSize;
+    }
+
+    parallelFor(candidateNo, 1, (parallelBody) dupsHash, &ctx);
+
+    if (cancelled())
+        return valueCreateInvalid();
+
+    /*Group those of the same size and hash*/
+
+    int hashedNo = 0;
+
+    for (int i = 0; i < candidateNo; i++)
+        if (ctx.candidates[i]->hash)
+            ctx.candidates[hashedNo++] = ctx.candidates[i];
+
+    qsort(ctx.candidates, hashedNo, sizeof(dupsFile*), compareSizeThenHash);
+
+    vector(value*) groups = vectorInit(8, GC_malloc);
+
+    for (int i = 0, end; i < hashedNo; i = end) {
+        const dupsFile* first = ctx.candidates[i];
+        vector(value*) group = vectorInit(2, GC_malloc);
+
+        for (end = i;    end < hashedNo
+                      && !compareSize(first, ctx.candidates[end])
+                      && !strcmp(valueGetStr(first->hash), valueGetStr(ctx.candidates[end]->hash));
+             end++)
+            vectorPush(&group, (value*) ctx.candidates[end]->file);
+
+        if (group.length > 1)
+            vectorPush(&groups, valueStoreTuple(2, first->hash, valueStoreVector(group)));
+    }
+
+    return valueStoreVector(groups);
+}
+
+static value* builtinDu (const value* file) {
+    const char* filename = valueGetFilename(file);
+    int64_t size;
+
+    if (!filename || !duMeasure(1, &filename, &size) || size < 0)
+        return valueCreateInvalid();
+
+    return valueCreateInt(size);
+}
+
+/*The usage of each thing in a directory, all measured in one walk so
+  that a hard link shared between two is only counted once*/
+static value* builtinDuTree (const value* dir) {
+    const char* dirname = valueGetFilename(dir);
+    DIR* dirp = dirname ? opendir(dirname) : 0;
+
+    if (!dirp)
+        return valueCreateInvalid();
+
+    vector(const char*) names = vectorInit(32, GC_malloc);
+
+    for (struct dirent* entry; (entry = readdir(dirp));)
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+            vectorPush(&names, GC_STRDUP(entry->d_name));
+
+    closedir(dirp);
+
+    qsort(names.buffer, names.length, sizeof(void*), qsort_cstr);
+
+    const char** filenames = GC_MALLOC(sizeof(char*) * (names.length + 1));
+    int64_t* sizes = GC_MALLOC_ATOMIC(sizeof(int64_t) * (names.length + 1));
+
+    for (int i = 0; i < names.length; i++)
+        filenames[i] = globJoin(dirname, vectorGet(names, i));
+
+    if (!duMeasure(names.length, filenames, sizes))
+        return valueCreateInvalid();
+
+    vector(value*) rows = vectorInit(names.length + 1, GC_malloc);
+
+    for (int i = 0; i < names.length; i++)
+        /*Gone since it was listed*/
+        if (sizes[i] >= 0)
+            vectorPush(&rows, valueStoreTuple(2, valueCreateInt(sizes[i]),
+                                                 valueCreateFileIn(dir, vectorGet(names, i))));
+
+    return valueStoreVector(rows);
+}
+
+/*---- Copying files ----*/
+
+static bool isDir (const char* filename) {
+    struct stat st;
+    return !stat(filename, &st) && S_ISDIR(st.st_mode);
+}
+
+/*A file copied into a directory keeps its name*/
+static value* copyDestination (const value* from, const value* to, bool intoDir) {
+    if (!intoDir)
+        return (value*) to;
+
+    const char *filename = valueGetDisplayFilename(from),
+               *name = strrchr(filename, '/');
+
+    return valueCreateFileIn(to, name ? name+1 : filename);
+}
+
+static value* copyTo (const value* from, const value* to, bool intoDir) {
+    value* dest = copyDestination(from, to, intoDir);
+    const char* error;
+
+    if (!copyFile(valueGetFilename(from), valueGetFilename(dest), &error)) {
+        fprintf(stderr, "error: couldn't copy %s to %s: %s\n",
+                valueGetDisplayFilename(from), valueGetDisplayFilename(dest), error);
+        return valueCreateInvalid();
+    }
+
+    return dest;
+}
+
+static value* builtinCopy (const value* to, const value* from) {
+    return copyTo(from, to, isDir(valueGetFilename(to)));
+}
+
+static value* builtinCopyCurried (const value* to) {
+    return valueCreateSimpleClosure(to, (simpleClosureFn) builtinCopy);
+}
+
+value* builtinCopyFile (const value* from, const value* to) {
+    return builtinCopy(to, from);
+}
+
+typedef struct copyCtx {
+    vector(const value*) files;
+    const value* to;
+    value** copies;
+} copyCtx;
+
+static void copyChunk (copyCtx* ctx, int start, int end) {
+    for (int i = start; i < end && !cancelled(); i++)
+        ctx->copies[i] = copyTo(vectorGet(ctx->files, i), ctx->to, true);
+}
+
+value* builtinCopyFiles (const value* list, const value* to) {
+    if (!isDir(valueGetFilename(to))) {
+        fprintf(stderr, "error: couldn't copy files to %s: it is not a directory\n",
+                valueGetDisplayFilename(to));
+        return valueCreateInvalid();
+    }
+
+    copyCtx ctx = {
+        .files = valueGetVector(list),
+        .to = to
+    };
+
+    ctx.copies = GC_MALLOC(sizeof(value*) * (ctx.files.length + 1));
+
+    /*Each file is a chunk: one large file shouldn't hold up the rest*/
+    parallelFor(ctx.files.length, 1, (parallelBody) copyChunk, &ctx);
+
+    if (cancelled())
+        return valueCreateInvalid();
+
+    /*Those that failed have said so already*/
+    vector(value*) copies = vectorInit(ctx.files.length + 1, GC_malloc);
+
+    for (int i = 0; i < ctx.files.length; i++)
+        if (!valueIsInvalid(ctx.copies[i]))
+            vectorPush(&copies, ctx.copies[i]);
+
+    return valueStoreVector(copies);
+}
+
+/*---- Splitting strings ----*/
+
+/*These give views of the string, sharing its memory, so splitting a
+  large string copies none of it*/
+
+static value* builtinLines (const value* str) {
+    size_t length;
+    const char* start = valueGetStrWithLength(str, &length);
+    const char* end = start+length;
+
+    vector(value*) lines = vectorInit(64, GC_malloc);
+
+    for (const char* line = start; line < end; ) {
+        if (cancelled())
+            return valueCreateInvalid();
+
+        const char* eol = memchr(line, '\n', end-line);
+
+        if (!eol)
+            eol = end;
+
+        /*Without a carriage return either*/
+        const char* lineEnd = eol != line && eol[-1] == '\r' ? eol-1 : eol;
+
+        vectorPush(&lines, valueCreateStrView(str, line, lineEnd-line));
+        line = eol+1;
+    }
+
+    return valueStoreVector(lines);
+}
+
+static value* builtinWords (const value* str) {
+    size_t length;
+    const char* start = valueGetStrWithLength(str, &length);
+    const char* end = start+length;
+
+    vector(value*) words = vectorInit(64, GC_malloc);
+
+    for (const char* word = start;; ) {
+        while (word != end && scanIsSpace(*word))
+            word++;
+
+        if (word == end)
+            break;
+
+        else if (cancelled())
+            return valueCreateInvalid();
+
+        const char* wordEnd = scanForSpace(word, end);
+
+        vectorPush(&words, valueCreateStrView(str, word, wordEnd-word));
+        word = wordEnd;
+    }
+
+    return valueStoreVector(words);
+}
+
+static value* builtinSplit (const value* separator, const value* str) {
+    size_t length, separatorLength;
+    const char* start = valueGetStrWithLength(str, &length);
+    const char* end = start+length;
+    const char* sep = valueGetStrWithLength(separator, &separatorLength);
+
+    if (separatorLength == 0)
+        return valueStoreArray(1, (value**) &str);
+
+    vector(value*) fields = vectorInit(64, GC_malloc);
+
+    for (const char* field = start;; ) {
+        if (cancelled())
+            return valueCreateInvalid();
+
+        const char* fieldEnd =   separatorLength == 1
+                               ? memchr(field, *sep, end-field)
+                               : memmem(field, end-field, sep, separatorLength);
+
+        vectorPush(&fields, valueCreateStrView(str, field, (fieldEnd ? fieldEnd : end) - field));
+
+        if (!fieldEnd)
+            break;
+
+        field = fieldEnd + separatorLength;
+    }
+
+    return valueStoreVector(fields);
+}
+
+static value* builtinSplitCurried (const value* separator) {
+    return valueCreateSimpleClosure(separator, (simpleClosureFn) builtinSplit);
+}
+
+/*---- Regexes ----*/
+
+static value* builtinMatch (const value* re, const value* str) {
+    const regex* compiled = valueGetRegex(re);
+
+    if (!compiled)
+        return valueCreateInvalid();
+
+    size_t length;
+    const char* start = valueGetStrWithLength(str, &length);
+
+    return valueCreateInt(regexMatch(compiled, start, length));
+}
+
+static value* builtinMatchCurried (const value* re) {
+    return valueCreateSimpleClosure(re, (simpleClosureFn) builtinMatch);
+}
+
+static value* builtinReadTable (const value* file) {
+    const char* filename = valueGetFilename(file);
+
+    if (!filename)
+        return valueCreateInvalid();
+
+    return tableRead(filename);
+}
+
 static value* builtinSum (const value* numbers) {
     int64_t total = 0;
 
@@ -109,6 +1027,169 @@ static value* builtinSum (const value* numbers) {
     return valueCreateInt(total);
 }
 
+/*---- Early termination ----
+  These read only as far into a list as they need to, which for a lazy
+  list (e.g. a glob) means the rest is never computed.*/
+
+static value* builtinTake (const value* n, const value* list) {
+    int64_t count = valueGetInt(n);
+
+    vector(value*) taken = vectorInit(count > 0 ? count : 1, GC_malloc);
+
+    valueIter iter;
+
+    if (valueGetIterator(list, &iter))
+        return valueCreateInvalid();
+
+    for (const value* element;
+         taken.length < count && (element = valueIterRead(&iter));)
+        vectorPush(&taken, element);
+
+    return valueStoreVector(taken);
+}
+
+static value* builtinTakeCurried (const value* n) {
+    return valueCreateSimpleClosure(n, (simpleClosureFn) builtinTake);
+}
+
+static value* builtinFirst (const value* list) {
+    valueIter iter;
+
+    if (valueGetIterator(list, &iter))
+        return valueCreateInvalid();
+
+    const value* first = valueIterRead(&iter);
+
+    /*Empty list*/
+    if (!first)
+        return valueCreateInvalid();
+
+    return (value*) first;
+}
+
+static value* builtinAny (const value* predicate, const value* list) {
+    valueIter iter;
+
+    if (valueGetIterator(list, &iter))
+        return valueCreateInvalid();
+
+    for (const value* element; (element = valueIterRead(&iter));) {
+        if (valueGetInt(valueCall(predicate, element)))
+            return valueCreateInt(true);
+    }
+
+    return valueCreateInt(false);
+}
+
+static value* builtinAnyCurried (const value* predicate) {
+    return valueCreateSimpleClosure(predicate, (simpleClosureFn) builtinAny);
+}
+
+/*---- Operators as functions ----*/
+
+static value* builtinAdd (const value* left, const value* right) {
+    return valueCreateInt(valueGetInt(left) + valueGetInt(right));
+}
+
+static value* builtinMultiply (const value* left, const value* right) {
+    return valueCreateInt(valueGetInt(left) * valueGetInt(right));
+}
+
+static value* builtinMax (const value* left, const value* right) {
+    return (value*) (valueGetInt(left) >= valueGetInt(right) ? left : right);
+}
+
+static value* builtinMin (const value* left, const value* right) {
+    return (value*) (valueGetInt(left) <= valueGetInt(right) ? left : right);
+}
+
+static value* builtinConcat (const value* left, const value* right) {
+    vector(const value*) lvec = valueGetVector(left),
+                         rvec = valueGetVector(right);
+
+    vector(value*) result = vectorInit(lvec.length + rvec.length, GC_malloc);
+    vectorPushFromVector(&result, lvec);
+    vectorPushFromVector(&result, rvec);
+
+    return valueStoreVector(result);
+}
+
+static value* builtinAddCurried (const value* left) {
+    return valueCreateSimpleClosure(left, (simpleClosureFn) builtinAdd);
+}
+
+static value* builtinMultiplyCurried (const value* left) {
+    return valueCreateSimpleClosure(left, (simpleClosureFn) builtinMultiply);
+}
+
+static value* builtinMaxCurried (const value* left) {
+    return valueCreateSimpleClosure(left, (simpleClosureFn) builtinMax);
+}
+
+static value* builtinMinCurried (const value* left) {
+    return valueCreateSimpleClosure(left, (simpleClosureFn) builtinMin);
+}
+
+static value* builtinConcatCurried (const value* left) {
+    return valueCreateSimpleClosure(left, (simpleClosureFn) builtinConcat);
+}
+
+/*The builtin values of the associative fns, with direct implementations*/
+typedef struct associative {
+    value* fn;
+    builtinBinaryFn impl;
+} associative;
+
+static associative associatives[8];
+
+static int associativeNo = 0;
+
+static value* addAssociative (value* fn, builtinBinaryFn impl) {
+    if (precond(associativeNo < (int)(sizeof(associatives) / sizeof(*associatives))))
+        associatives[associativeNo++] = (associative) {fn, impl};
+
+    return fn;
+}
+
+builtinBinaryFn builtinGetAssociative (const value* fn) {
+    for (int i = 0; i < associativeNo; i++) {
+        if (associatives[i].fn == fn)
+            return associatives[i].impl;
+    }
+
+    return 0;
+}
+
+/*The builtin values of fns worth mapping in parallel*/
+static value* parallels[8];
+
+static int parallelNo = 0;
+
+static value* addParallel (value* fn) {
+    if (precond(parallelNo < (int)(sizeof(parallels) / sizeof(*parallels))))
+        parallels[parallelNo++] = fn;
+
+    return fn;
+}
+
+bool builtinIsParallel (const value* fn) {
+    for (int i = 0; i < parallelNo; i++) {
+        if (parallels[i] == fn)
+            return true;
+    }
+
+    return false;
+}
+
+/*The builtin value of lines*/
+static value* linesFn;
+
+bool builtinIsLines (const value* fn) {
+    return fn == linesFn;
+}
+
+/*---- ----*/
+
 static value* builtinZipf (const value* fn, const value* arg) {
     return valueStoreTuple(2, valueCall(fn, arg), arg);
 }
@@ -148,21 +1229,46 @@ int compareTuple (const value** left, const value** right) {
 static value* builtinSort (const value* table) {
     vector(const value*) rows = vectorDup(valueGetVector(table), GC_malloc);
 
+    /*Only some of the rows were read*/
+    if (cancelled())
+        return valueCreateInvalid();
+
     qsort(rows.buffer, rows.length, sizeof(void*),
           (int (*)(const void *, const void *)) compareTuple);
 
     return valueStoreVector(rows);
 }
 
-static void addBuiltin (sym* global, const char* name, type* dt, value* val) {
+static value* builtinDict (const value* rows) {
+    dict* table = dictCreate(valueIsLazy(rows) ? 0 : valueGuessIterableLength(rows));
+
+    /*Later entries replace earlier ones of the same key*/
+    for_iterable_value (const value* row, rows, {
+        const value* key = valueGetTupleNth(row, 0);
+
+        if (valueIsInvalid(key))
+            return valueCreateInvalid();
+
+        dictSet(table, key, valueGetTupleNth(row, 1));
+    })
+
+    if (cancelled())
+        return valueCreateInvalid();
+
+    return valueStoreDict(table);
+}
+
+static sym* addBuiltin (sym* global, const char* name, type* dt, value* val) {
     sym* symbol = symAdd(global, name);
     symbol->dt = dt;
     symbol->val = val;
+    return symbol;
 }
 
 void addBuiltins (typeSys* ts, sym* global) {
     type *File = typeUnitary(ts, type_File),
-         *Int = typeUnitary(ts, type_Int);
+         *Int = typeUnitary(ts, type_Int),
+         *Bool = typeUnitary(ts, type_Bool);
 
     addBuiltin(global, "size",
                typeFn(ts, File, Int),
@@ -170,12 +1276,141 @@ void addBuiltins (typeSys* ts, sym* global) {
 
     addBuiltin(global, "lc",
                typeFn(ts, File, Int),
-               valueCreateFn(builtinLinecount));
+               addParallel(valueCreateFn(builtinLinecount)));
+
+    addBuiltin(global, "read",
+               typeFn(ts, File, typeUnitary(ts, type_Str)),
+               addParallel(valueCreateFn(builtinRead)));
+
+    addBuiltin(global, "hash",
+               typeFn(ts, File, typeUnitary(ts, type_Str)),
+               addParallel(valueCreateFn(builtinHash)));
+
+    addBuiltin(global, "sha256",
+               typeFn(ts, File, typeUnitary(ts, type_Str)),
+               addParallel(valueCreateFn(builtinSHA256)));
+
+    addBuiltin(global, "dups",
+               /*[File] -> [(Str, [File])]*/
+               typeFn(ts, typeList(ts, File),
+                   typeList(ts, typeTuple(ts, vectorInitChain(2, malloc,
+                       typeUnitary(ts, type_Str), typeList(ts, File))))),
+               valueCreateFn(builtinDups));
+
+    addBuiltin(global, "du",
+               typeFn(ts, File, Int),
+               addParallel(valueCreateFn(builtinDu)));
+
+    addBuiltin(global, "duTree",
+               /*File -> [(Int, File)]*/
+               typeFn(ts, File,
+                   typeList(ts, typeTuple(ts, vectorInitChain(2, malloc, Int, File)))),
+               valueCreateFn(builtinDuTree));
+
+    addBuiltin(global, "copy",
+               /*File -> File -> File*/
+               typeFn(ts, File, typeFn(ts, File, File)),
+               valueCreateFn(builtinCopyCurried))->effects = true;
+
+    {
+        type* Str = typeUnitary(ts, type_Str);
+
+        addBuiltin(global, "lines",
+                   typeFn(ts, Str, typeList(ts, Str)),
+                   linesFn = valueCreateFn(builtinLines));
+
+        addBuiltin(global, "words",
+                   typeFn(ts, Str, typeList(ts, Str)),
+                   valueCreateFn(builtinWords));
+
+        addBuiltin(global, "split",
+                   /*Str -> Str -> [Str]*/
+                   typeFn(ts, Str, typeFn(ts, Str, typeList(ts, Str))),
+                   valueCreateFn(builtinSplitCurried));
+
+        addBuiltin(global, "match",
+                   /*Regex -> Str -> Bool*/
+                   typeFn(ts, typeUnitary(ts, type_Regex), typeFn(ts, Str, Bool)),
+                   valueCreateFn(builtinMatchCurried));
+
+        addBuiltin(global, "contains",
+                   /*Regex -> File -> Bool*/
+                   typeFn(ts, typeUnitary(ts, type_Regex), typeFn(ts, File, Bool)),
+                   valueCreateFn(builtinContainsCurried));
+
+        addBuiltin(global, "search",
+                   /*Regex -> [File] -> [(File, Str)]*/
+                   typeFn(ts, typeUnitary(ts, type_Regex),
+                       typeFn(ts, typeList(ts, File),
+                       typeList(ts, typeTuple(ts, vectorInitChain(2, malloc, File, Str))))),
+                   valueCreateFn(builtinSearchCurried));
+    }
+
+    addBuiltin(global, "readTable",
+               typeFn(ts, File, typeList(ts, typeList(ts, typeUnitary(ts, type_Str)))),
+               valueCreateFn(builtinReadTable));
 
     addBuiltin(global, "sum",
                typeFn(ts, typeList(ts, Int), Int),
                valueCreateFn(builtinSum));
 
+    /*Int -> Int -> Int*/
+    type* binaryInt = typeFn(ts, Int, typeFn(ts, Int, Int));
+
+    addBuiltin(global, "+", binaryInt,
+               addAssociative(valueCreateFn(builtinAddCurried), builtinAdd));
+
+    addBuiltin(global, "*", binaryInt,
+               addAssociative(valueCreateFn(builtinMultiplyCurried), builtinMultiply));
+
+    addBuiltin(global, "max", binaryInt,
+               addAssociative(valueCreateFn(builtinMaxCurried), builtinMax));
+
+    addBuiltin(global, "min", binaryInt,
+               addAssociative(valueCreateFn(builtinMinCurried), builtinMin));
+
+    {
+        type* A = typeVar(ts);
+
+        addBuiltin(global, "++",
+                   /*'a => ['a] -> ['a] -> ['a]*/
+                   typeForall(ts, A,
+                       typeFn(ts, typeList(ts, A),
+                       typeFn(ts, typeList(ts, A), typeList(ts, A)))),
+                   addAssociative(valueCreateFn(builtinConcatCurried), builtinConcat));
+    }
+
+    {
+        type* A = typeVar(ts);
+
+        addBuiltin(global, "take",
+                   /*'a => Int -> ['a] -> ['a]*/
+                   typeForall(ts, A,
+                       typeFn(ts, Int,
+                       typeFn(ts, typeList(ts, A), typeList(ts, A)))),
+                   valueCreateFn(builtinTakeCurried));
+    }
+
+    {
+        type* A = typeVar(ts);
+
+        addBuiltin(global, "first",
+                   typeForall(ts, A,
+                       typeFn(ts, typeList(ts, A), A)),
+                   valueCreateFn(builtinFirst));
+    }
+
+    {
+        type* A = typeVar(ts);
+
+        addBuiltin(global, "any",
+                   /*'a => ('a -> Bool) -> ['a] -> Bool*/
+                   typeForall(ts, A,
+                       typeFn(ts, typeFn(ts, A, Bool),
+                       typeFn(ts, typeList(ts, A), Bool))),
+                   valueCreateFn(builtinAnyCurried));
+    }
+
     {
         type *A = typeVar(ts),
              *B = typeVar(ts);
@@ -225,4 +1460,17 @@ void addBuiltins (typeSys* ts, sym* global) {
                                   typeList(ts, Int_A))),
                    valueCreateFn(builtinSort));
     }
+
+    {
+        type *A = typeVar(ts),
+             *B = typeVar(ts);
+        type* A_B = typeTuple(ts, vectorInitChain(2, malloc, A, B));
+
+        addBuiltin(global, "dict",
+                   /*'a => 'b => [('a, 'b)] -> ['a: 'b]*/
+                   typeForall(ts, A,
+                   typeForall(ts, B,
+                       typeFn(ts, typeList(ts, A_B), typeDict(ts, A, B)))),
+                   valueCreateFn(builtinDict));
+    }
 }
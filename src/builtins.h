@@ -4,4 +4,24 @@
   paths and [pattern] must start with a slash.*/
 value* builtinExpandGlob (const char* pattern, const char* workingDir);
 
+/*Copy a file, or a list of them in parallel, as |> does. A copy into a
+  directory keeps its name, and a list can only be copied into one.
+  Gives the copies, having reported any that failed.*/
+value* builtinCopyFile (const value* from, const value* to);
+value* builtinCopyFiles (const value* list, const value* to);
+
+typedef value* (*builtinBinaryFn)(const value* left, const value* right);
+
+/*If the value is a builtin fn known to be associative, get a direct
+  (uncurried) implementation of it. Otherwise, null.*/
+builtinBinaryFn builtinGetAssociative (const value* fn);
+
+/*Whether the value is a builtin fn slow enough, usually from reading
+  files, to be worth mapping over a list in parallel*/
+bool builtinIsParallel (const value* fn);
+
+/*Whether the value is the builtin lines, which the output of programs
+  can be split by lazily*/
+bool builtinIsLines (const value* fn);
+
 void addBuiltins (typeSys* ts, sym* global);
@@ -0,0 +1,146 @@
+/*For copy_file_range*/
+#define _GNU_SOURCE
+
+#include "copy.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "terminal.h"
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+enum {
+    /*Copied at a time, between checks for Ctrl-C*/
+    copyRangeSize = 64*1024*1024,
+    copyBufferSize = 1024*1024
+};
+
+/*Besides an errno, or 0 for success, a copy can end in*/
+enum {
+    copyUnsupported = -1,
+    copyCancelled = -2
+};
+
+/*Whether the kernel can't copy between these files, rather than it
+  having failed to*/
+static bool copyRangeUnsupported (int error) {
+    return    error == EXDEV || error == ENOSYS || error == EINVAL
+           || error == EOPNOTSUPP || error == EBADF;
+}
+
+static int copyRange (int in, int out) {
+    for (bool first = true;; first = false) {
+        if (cancelled())
+            return copyCancelled;
+
+        ssize_t copied = copy_file_range(in, 0, out, 0, copyRangeSize, 0);
+
+        if (copied == 0)
+            return 0;
+
+        else if (copied < 0 && errno == EINTR)
+            continue;
+
+        else if (copied < 0)
+            return first && copyRangeUnsupported(errno) ? copyUnsupported : errno;
+    }
+}
+
+static int copyBuffered (int in, int out) {
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    char* buffer = malloc(copyBufferSize);
+    int error = 0;
+
+    while (!error) {
+        if (cancelled()) {
+            error = copyCancelled;
+            break;
+        }
+
+        ssize_t got = read(in, buffer, copyBufferSize);
+
+        if (got == 0)
+            break;
+
+        else if (got < 0) {
+            if (errno != EINTR)
+                error = errno;
+
+            continue;
+        }
+
+        for (ssize_t written = 0, n; written < got && !error; written += n > 0 ? n : 0) {
+            n = write(out, buffer + written, got - written);
+
+            if (n < 0 && errno != EINTR)
+                error = errno;
+        }
+    }
+
+    free(buffer);
+    return error;
+}
+
+bool copyFile (const char* from, const char* to, const char** error_out) {
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    struct stat st, toSt;
+
+    if (in < 0 || fstat(in, &st)) {
+        *error_out = strerror(errno);
+
+        if (in >= 0)
+            close(in);
+
+        return false;
+
+    } else if (!S_ISREG(st.st_mode)) {
+        *error_out = S_ISDIR(st.st_mode) ? "it is a directory" : "it is not a regular file";
+        close(in);
+        return false;
+
+    /*Opening it would empty the original*/
+    } else if (!stat(to, &toSt) && toSt.st_dev == st.st_dev && toSt.st_ino == st.st_ino) {
+        *error_out = "they are the same file";
+        close(in);
+        return false;
+    }
+
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+
+    if (out < 0) {
+        *error_out = strerror(errno);
+        close(in);
+        return false;
+    }
+
+    int error = ioctl(out, FICLONE, in) ? copyUnsupported : 0;
+
+    if (error == copyUnsupported)
+        error = copyRange(in, out);
+
+    if (error == copyUnsupported)
+        error = copyBuffered(in, out);
+
+    if (close(out) && !error)
+        error = errno;
+
+    close(in);
+
+    if (error) {
+        *error_out = error == copyCancelled ? "cancelled" : strerror(error);
+        unlink(to);
+        return false;
+    }
+
+    return true;
+}
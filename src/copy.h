@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*Copy a regular file, creating the destination or replacing what it
+  held, with the same permissions (less the umask).
+
+  Where the filesystem can, the copy shares the blocks of the original
+  until either is changed (a reflink), so it costs nothing. Otherwise
+  the kernel copies it with copy_file_range, which it may offload to
+  the device, and failing that it is read and written a buffer at a
+  time. Safe to call from many threads at once.
+
+  Returns false and the reason, a static string, if it couldn't be
+  copied. Nothing is left of a copy that failed part way.*/
+bool copyFile (const char* from, const char* to, const char** error_out);
@@ -0,0 +1,182 @@
+#include "dict.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <gc.h>
+#include <common.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "value.h"
+
+enum {
+    dictGroupSize = 16,
+    /*A control byte is either this, or the low seven bits of the hash
+      of the entry in that slot. Entries are never removed, so there is
+      no need to mark a slot that used to be full.*/
+    dictEmpty = -128
+};
+
+typedef struct dictEntry {
+    uint64_t hash;
+    const value *key, *value;
+} dictEntry;
+
+struct dict {
+    /*In the order they were added*/
+    dictEntry* entries;
+    int length, entryCapacity;
+
+    /*A control byte for each slot, and the entry it holds. There are a
+      power of two groups of slots, never more than 7/8 full.*/
+    int8_t* ctrl;
+    int32_t* slots;
+    size_t groupMask;
+};
+
+/*Bitmasks of the slots in a group with this control byte, and of those
+  that are empty*/
+static inline uint32_t dictGroupMatch (const int8_t* group, int8_t h2, uint32_t* empty_out) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    *empty_out = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(dictEmpty)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+    uint32_t matches = 0, empty = 0;
+
+    for (int i = 0; i < dictGroupSize; i++) {
+        matches |= (uint32_t) (group[i] == h2) << i;
+        empty |= (uint32_t) (group[i] == dictEmpty) << i;
+    }
+
+    *empty_out = empty;
+    return matches;
+#endif
+}
+
+static inline int8_t dictH2 (uint64_t hash) {
+    return hash & 0x7f;
+}
+
+/*Where the probe sequence of a hash starts. The groups after it are
+  visited in triangular steps, which covers them all as there are a
+  power of two.*/
+static inline size_t dictH1 (const dict* d, uint64_t hash) {
+    return (hash >> 7) & d->groupMask;
+}
+
+static void dictAllocSlots (dict* d, size_t groups) {
+    size_t slots = groups * dictGroupSize;
+
+    d->ctrl = GC_MALLOC_ATOMIC(slots);
+    d->slots = GC_MALLOC_ATOMIC(slots * sizeof(int32_t));
+    d->groupMask = groups-1;
+
+    memset(d->ctrl, dictEmpty, slots);
+}
+
+/*Give an entry the first empty slot in its probe sequence*/
+static void dictPlace (dict* d, int index) {
+    uint64_t hash = d->entries[index].hash;
+
+    for (size_t group = dictH1(d, hash), step = 1;; group = (group + step++) & d->groupMask) {
+        int8_t* ctrl = d->ctrl + group*dictGroupSize;
+        uint32_t empty;
+        dictGroupMatch(ctrl, 0, &empty);
+
+        if (empty) {
+            int slot = __builtin_ctz(empty);
+            ctrl[slot] = dictH2(hash);
+            d->slots[group*dictGroupSize + slot] = index;
+            return;
+        }
+    }
+}
+
+static void dictGrow (dict* d) {
+    dictAllocSlots(d, 2*(d->groupMask+1));
+
+    for (int i = 0; i < d->length; i++)
+        dictPlace(d, i);
+}
+
+dict* dictCreate (int sizeHint) {
+    dict* d = GC_MALLOC(sizeof(dict));
+
+    size_t groups = 1;
+
+    while (groups*dictGroupSize*7/8 < (size_t) sizeHint)
+        groups *= 2;
+
+    dictAllocSlots(d, groups);
+
+    d->entryCapacity = sizeHint > 4 ? sizeHint : 4;
+    d->entries = GC_MALLOC(sizeof(dictEntry) * d->entryCapacity);
+
+    return d;
+}
+
+/*The index of the entry of a key, or -1*/
+static int dictFind (const dict* d, const value* key, uint64_t hash) {
+    int8_t h2 = dictH2(hash);
+
+    for (size_t group = dictH1(d, hash), step = 1;; group = (group + step++) & d->groupMask) {
+        const int8_t* ctrl = d->ctrl + group*dictGroupSize;
+        uint32_t empty;
+
+        for (uint32_t matches = dictGroupMatch(ctrl, h2, &empty); matches; matches &= matches-1) {
+            int index = d->slots[group*dictGroupSize + __builtin_ctz(matches)];
+            const dictEntry* entry = &d->entries[index];
+
+            if (entry->hash == hash && valueIsEqual(entry->key, key))
+                return index;
+        }
+
+        /*The key would have gone in the first empty slot*/
+        if (empty)
+            return -1;
+    }
+}
+
+void dictSet (dict* d, const value* key, const value* val) {
+    uint64_t hash = valueHash(key);
+    int index = dictFind(d, key, hash);
+
+    if (index >= 0) {
+        d->entries[index].value = val;
+        return;
+    }
+
+    if (d->length == d->entryCapacity) {
+        d->entryCapacity *= 2;
+        d->entries = GC_REALLOC(d->entries, sizeof(dictEntry) * d->entryCapacity);
+    }
+
+    index = d->length++;
+    d->entries[index] = (dictEntry) {hash, key, val};
+
+    if (d->length > (int) ((d->groupMask+1) * dictGroupSize * 7/8))
+        dictGrow(d);
+
+    else
+        dictPlace(d, index);
+}
+
+const value* dictGet (const dict* d, const value* key) {
+    int index = dictFind(d, key, valueHash(key));
+    return index >= 0 ? d->entries[index].value : 0;
+}
+
+int dictGetLength (const dict* d) {
+    return d->length;
+}
+
+void dictGetNth (const dict* d, int n, const value** key_out, const value** value_out) {
+    if (!precond(n >= 0 && n < d->length))
+        return;
+
+    *key_out = d->entries[n].key;
+    *value_out = d->entries[n].value;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "forward.h"
+
+/*A hash table from values to values, as used by Dicts. Keys are
+  compared with valueIsEqual.
+
+  It is a Swiss table: a byte of each key's hash is kept apart from the
+  entries, and sixteen of those are compared at once (with SSE2, where
+  it's available), so a lookup usually touches one entry, the one it
+  wants. The entries themselves are kept in the order they were added.
+
+  Built once and only read from then on, it is safe to read from many
+  threads at once. All allocations are GC'd.*/
+dict* dictCreate (int sizeHint);
+
+/*Add an entry, or replace the value of a key already there*/
+void dictSet (dict* d, const value* key, const value* val);
+
+/*Null if the key isn't there*/
+const value* dictGet (const dict* d, const value* key);
+
+int dictGetLength (const dict* d);
+
+/*The nth entry added, for going through them in that order*/
+void dictGetNth (const dict* d, int n, const value** key_out, const value** value_out);
@@ -1,14 +1,28 @@
 #pragma once
 
 #include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <gc.h>
 #include <vector.h>
+#include <hashmap.h>
 
 #include "common.h"
 #include "paths.h"
 
 typedef struct dirCtx {
     vector(char*) searchPaths;
+    /*The commands found in the search paths, mapped to the first
+      search path holding them (like the hash of sh). Built lazily, and
+      rebuilt when a command is missing and a search path has changed
+      since, according to the modification times.*/
+    hashmap(const char*) commands;
+    vector(char*) commandNames;
+    int64_t* searchPathMTimes;
+    bool commandsBuilt;
+    /*Held while building, searching or forgetting them, as closures
+      share the dirs and may run on many threads at once*/
+    pthread_mutex_t* commandsLock;
     /*This is for UI purposes and shouldn't be used to construct
       actual paths.*/
     char* workingDirDisplay;
@@ -21,22 +35,32 @@ static dirCtx* dirsFree (dirCtx* dirs);
 
 static bool dirsChangeWD (dirCtx* dirs, const char* newWD);
 
+/*Find the search path holding a command, or return null*/
 static const char* dirsSearch (dirCtx* dirs, const char* str);
 
+/*Forget the commands found, they will be searched for again*/
+static void dirsRehash (dirCtx* dirs);
+
 /*==== Inline implementations ====*/
 
 inline static dirCtx dirsInit () {
     char* workingDir = getWorkingDir(gcalloc);
 
+    pthread_mutex_t* commandsLock = GC_MALLOC_ATOMIC(sizeof(pthread_mutex_t));
+    pthread_mutex_init(commandsLock, 0);
+
     return (dirCtx) {
         .searchPaths = initVectorFromPATH(gcalloc),
+        .commandsBuilt = false,
+        .commandsLock = commandsLock,
         .workingDirDisplay = workingDir,
         .workingDirReal = GC_STRDUP(workingDir)
     };
 }
 
 inline static dirCtx* dirsFree (dirCtx* dirs) {
-    /*Nothing to do because everything was GC allocated*/
+    /*Everything else was GC allocated*/
+    dirsRehash(dirs);
     return dirs;
 };
 
@@ -67,28 +91,84 @@ inline static bool dirsChangeWD (dirCtx* dirs, const char* newWD) {
     return error;
 }
 
-inline static const char* dirsSearch (dirCtx* dirs, const char* str) {
-    const char* path = 0;
+/*The commands must be locked*/
+inline static void dirsForgetCommands (dirCtx* dirs) {
+    if (dirs->commandsBuilt) {
+        hashmapFree(&dirs->commands);
+        vectorFreeObjs(&dirs->commandNames, free);
+        dirs->commandsBuilt = false;
+    }
+}
 
-    enum {bufsize = 512};
-    char* fullpath = malloc(bufsize);
+inline static void dirsRehash (dirCtx* dirs) {
+    pthread_mutex_lock(dirs->commandsLock);
+    dirsForgetCommands(dirs);
+    pthread_mutex_unlock(dirs->commandsLock);
+}
 
-    for_vector (const char* dir, dirs->searchPaths, {
-        int printed = snprintf(fullpath, bufsize, "%s/%s", dir, str);
+/*The commands must be locked, or only used by one thread*/
+inline static void dirsHashCommands (dirCtx* dirs) {
+    dirs->commands = hashmapInit(1024, calloc);
+    dirs->commandNames = vectorInit(1024, malloc);
+    dirs->searchPathMTimes = GC_MALLOC_ATOMIC(sizeof(int64_t) * (dirs->searchPaths.length+1));
+    dirs->commandsBuilt = true;
 
-        if (printed == bufsize) {
-            //todo realloc
-            errprintf("Search path '%s' too long\n", dir);
+    for_vector_indexed (i, char* dir, dirs->searchPaths, {
+        /*Taken before reading, so any later change is noticed*/
+        dirs->searchPathMTimes[i] = pathGetMTime(dir);
+
+        DIR* dirstream = opendir(dir);
+
+        if (!dirstream)
             continue;
+
+        for (struct dirent* entry; (entry = readdir(dirstream));) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            /*Earlier search paths take precedence*/
+            if (hashmapMap(&dirs->commands, entry->d_name))
+                continue;
+
+            /*Not GC allocated, as nothing the GC sees refers to them*/
+            char* name = strdup(entry->d_name);
+            hashmapAdd(&dirs->commands, name, dir);
+            vectorPush(&dirs->commandNames, name);
         }
 
-        bool notfound = access(fullpath, F_OK);
+        closedir(dirstream);
+    })
+}
 
-        if (!notfound)
-            path = dir;
+/*Whether any of the search paths have changed since the commands
+  were hashed*/
+inline static bool dirsCommandsStale (dirCtx* dirs) {
+    for_vector_indexed (i, char* dir, dirs->searchPaths, {
+        if (pathGetMTime(dir) != dirs->searchPathMTimes[i])
+            return true;
     })
 
-    free(fullpath);
+    return false;
+}
+
+inline static const char* dirsSearch (dirCtx* dirs, const char* str) {
+    pthread_mutex_lock(dirs->commandsLock);
+
+    if (!dirs->commandsBuilt)
+        dirsHashCommands(dirs);
+
+    /*No syscalls for the commands already known*/
+    const char* path = hashmapMap(&dirs->commands, str);
+
+    /*Not found, but it may have been added since*/
+    if (!path && dirsCommandsStale(dirs)) {
+        dirsForgetCommands(dirs);
+        dirsHashCommands(dirs);
+        path = hashmapMap(&dirs->commands, str);
+    }
+
+    pthread_mutex_unlock(dirs->commandsLock);
 
+    /*A search path, which outlives the commands hashed*/
     return path;
 }
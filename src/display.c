@@ -1,6 +1,11 @@
 #include "display.h"
 
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
 #include <dirent.h>
+#include <hashmap.h>
+#include <sys/uio.h>
 #include <nicestat.h>
 
 #include "terminal.h"
@@ -8,12 +13,212 @@
 
 #include "type.h"
 #include "value.h"
+#include "dict.h"
 
 enum {
     useSIUnitNames = false,
     sizeMagnitudes = 1024
 };
 
+/*==== Output ====*/
+
+/*Everything displayed is rendered once into an arena, then written out
+  with large writevs instead of through stdio a char at a time.
+  The output is a sequence of pieces, each either a range of the arena
+  (by offset, as it may move) or a string kept alive elsewhere. This
+  lets a table render its cells before deciding where they go.*/
+
+typedef struct outputPiece {
+    /*Null if in the arena*/
+    const char* str;
+    size_t offset, length;
+} outputPiece;
+
+static struct {
+    char* arena;
+    size_t length, capacity;
+
+    outputPiece* pieces;
+    int pieceNo, pieceCapacity;
+
+    /*The start of the arena not yet made into a piece*/
+    size_t unpieced;
+} output;
+
+static char outputSpaces[256];
+
+enum {
+    /*Pieces per writev, IOV_MAX on Linux*/
+    outputBatchSize = 1024
+};
+
+static void outputReserve (size_t length) {
+    if (output.length + length <= output.capacity)
+        return;
+
+    output.capacity = 2*output.capacity + length + 4096;
+    output.arena = realloc(output.arena, output.capacity);
+}
+
+static void outputPushPiece (const char* str, size_t offset, size_t length) {
+    if (length == 0)
+        return;
+
+    if (output.pieceNo == output.pieceCapacity) {
+        output.pieceCapacity = 2*output.pieceCapacity + 64;
+        output.pieces = realloc(output.pieces, sizeof(outputPiece) * output.pieceCapacity);
+    }
+
+    output.pieces[output.pieceNo++] = (outputPiece) {str, offset, length};
+}
+
+/*Make what was rendered since the last piece into one*/
+static void outputPieceArena (void) {
+    outputPushPiece(0, output.unpieced, output.length - output.unpieced);
+    output.unpieced = output.length;
+}
+
+/*Render into the arena, like printf*/
+static int arenaprintf (const char* format, ...) {
+    va_list args;
+
+    /*Usually there's room, otherwise it's formatted again with enough*/
+    outputReserve(256);
+
+    va_start(args, format);
+    int length = vsnprintf(output.arena + output.length, output.capacity - output.length, format, args);
+    va_end(args);
+
+    if (length < 0)
+        return 0;
+
+    if ((size_t) length >= output.capacity - output.length) {
+        outputReserve(length+1);
+
+        va_start(args, format);
+        vsnprintf(output.arena + output.length, length+1, format, args);
+        va_end(args);
+    }
+
+    output.length += length;
+    return length;
+}
+
+static void arenaputc (char c) {
+    outputReserve(1);
+    output.arena[output.length++] = c;
+}
+
+static void arenaputn (char c, size_t n) {
+    outputReserve(n);
+    memset(output.arena + output.length, c, n);
+    output.length += n;
+}
+
+/*Spaces, as pieces, without copying them into the arena*/
+static void outputSpacesPiece (size_t n) {
+    if (outputSpaces[0] != ' ')
+        memset(outputSpaces, ' ', sizeof(outputSpaces));
+
+    for (; n > sizeof(outputSpaces); n -= sizeof(outputSpaces))
+        outputPushPiece(outputSpaces, 0, sizeof(outputSpaces));
+
+    outputPushPiece(outputSpaces, 0, n);
+}
+
+/*A string that will outlive the output, as a piece of its own*/
+static void outputStr (const char* str, size_t length) {
+    outputPieceArena();
+    outputPushPiece(str, 0, length);
+}
+
+/*Write out all the pieces, and empty the arena*/
+static void outputFlush (void) {
+    outputPieceArena();
+
+    /*Anything printed through stdio goes first*/
+    fflush(stdout);
+
+    struct iovec iov[outputBatchSize];
+
+    for (int start = 0; start < output.pieceNo;) {
+        int n = 0;
+
+        for (; n < outputBatchSize && start+n < output.pieceNo; n++) {
+            outputPiece piece = output.pieces[start+n];
+            const char* base = piece.str ? piece.str : output.arena;
+
+            iov[n] = (struct iovec) {
+                .iov_base = (char*) base + piece.offset,
+                .iov_len = piece.length
+            };
+        }
+
+        start += n;
+
+        for (struct iovec* next = iov; n;) {
+            ssize_t written = writev(STDOUT_FILENO, next, n);
+
+            if (written < 0) {
+                /*Ctrl-C, or the terminal went away: the rest isn't wanted*/
+                if (errno != EINTR || cancelled())
+                    start = output.pieceNo;
+
+                if (errno != EINTR || cancelled())
+                    break;
+
+                continue;
+            }
+
+            /*Skip what was written, maybe part of a piece*/
+            for (; n && (size_t) written >= next->iov_len; next++, n--)
+                written -= next->iov_len;
+
+            if (n) {
+                next->iov_base = (char*) next->iov_base + written;
+                next->iov_len -= written;
+            }
+        }
+    }
+
+    output.length = output.unpieced = 0;
+    output.pieceNo = 0;
+}
+
+/*The width on the terminal of some rendered output: style escapes take
+  none, and each UTF-8 sequence one. Mostly it's ASCII, with no escapes,
+  and that's checked a word at a time.*/
+static size_t displayGetWidth (const char* str, size_t length) {
+    size_t i = 0;
+
+    for (uint64_t word; i+8 <= length; i += 8) {
+        memcpy(&word, str+i, 8);
+
+        /*Any high bit, or any byte of 0x1b (by the usual zero byte test)*/
+        uint64_t escapes = word ^ 0x1b1b1b1b1b1b1b1bull;
+
+        if (   (word & 0x8080808080808080ull)
+            || ((escapes - 0x0101010101010101ull) & ~escapes & 0x8080808080808080ull))
+            break;
+    }
+
+    size_t width = i;
+
+    for (; i < length; i++) {
+        /*Skip a CSI sequence, up to its final letter*/
+        if (str[i] == '\e' && i+1 < length && str[i+1] == '[') {
+            for (i += 2; i < length && !(str[i] >= '@' && str[i] <= '~'); i++)
+                ;
+
+        } else if ((str[i] & 0xc0) != 0x80)
+            width++;
+    }
+
+    return width;
+}
+
+/*==== ====*/
+
 const char* units[] = {"bytes", "kB", "MB", "GB", "TB"};
 const char* unitsSI[] = {"bytes", "kiB", "MiB", "GiB", "TiB"};
 
@@ -38,66 +243,306 @@ static void printSizeNicely (size_t size) {
     int digitsAfterPoint =   relativeSize > 100 ? 0
                            : relativeSize > 10 ? 1 : 2;
 
-    printf("%.*f %s", digitsAfterPoint, relativeSize, unit);
+    arenaprintf("%.*f %s", digitsAfterPoint, relativeSize, unit);
 }
 
-static int printFilename (const char* name) {
-    return   pathIsDir(name)
-           ? printf_style("{%s}/", styleBlue, name)
-           : printf("%s", name);
+/*Returns the width*/
+static size_t printFilename (const char* name) {
+    size_t length = strlen(name);
+
+    if (pathIsDir(name)) {
+        arenaprintf("%s%s%s/", styleBlue, name, styleReset);
+        return displayGetWidth(name, length) + 1;
+
+    } else {
+        outputReserve(length);
+        memcpy(output.arena + output.length, name, length);
+        output.length += length;
+        return displayGetWidth(name, length);
+    }
 }
 
-static int displayValueImpl (const value* result, type* dt, printf_t printf) {
-    bool dry = printf == dryprintf;
+/*---- Bounds ----*/
 
-    type* elementType = 0;
-    vector(type*) tuple;
+/*A huge result is shown in part: its first rows, a summary of those
+  left out, then its last rows. Only the rows shown are rendered, or
+  even produced (for a stream). :more pages through the rest.
+  There's no limit when the output isn't a terminal.*/
 
-    /*Iterable types*/
-    if (   typeIsListOf(dt, &elementType)
-        || typeIsTupleOf(dt, &tuple)) {
-        bool list = elementType != 0;
-        char* brackets = list ? "[]" : "()";
-        int length = 2;
+enum {
+    /*When the height of the terminal isn't known*/
+    displayDefaultRows = 20,
+    /*Elements of a list shown inline, [1, 2, 3, ...]*/
+    displayInlineLimit = 200,
+    /*Lines shown from each end of a long string*/
+    displayStrEndLines = 10
+};
 
-        if (!dry)
-            putchar(brackets[0]);
+/*Rows shown from each end of a result, zero for no limit. Set for each
+  result displayed.*/
+static int displayLimit = 0;
 
-        for_iterable_value_indexed (i, const value* element, result, {
-            if (i != 0)
-                length += printf(", ");
+typedef struct displayPlan displayPlan;
 
-            if (!list)
-                elementType = vectorGet(tuple, i);
+/*The last result displayed, for :more to carry on from*/
+static struct {
+    value* result;
+    const displayPlan* plan;
+    /*The first row not yet shown, -1 if all have been*/
+    int next;
+} displayLast;
 
-            if (!precond(elementType))
-                length += valuePrint(element);
+static int displayGetLimit (void) {
+    if (!isatty(STDOUT_FILENO))
+        return 0;
 
-            else
-                length += displayValueImpl(element, elementType, printf);
-        })
+    /*Both ends, the summary and the type, in one screen*/
+    int height = getWindowHeight();
+    return height > 12 ? (height-4) / 2 : displayDefaultRows;
+}
+
+/*The rows of a list to show, from some index*/
+typedef struct displaySpan {
+    vector(const value*) rows;
+    /*The number of rows in the head, the rest are the tail*/
+    int head;
+    /*Rows left out between the head and the tail, -1 if not known (a
+      stream not yet read to the end)*/
+    int elided;
+    /*The first row left out, -1 if none were*/
+    int next;
+} displaySpan;
+
+/*Takes the head from the start, and the tail if asked for and the
+  length is known without reading the whole list. Rows are only read as
+  far as the head, and one more to see whether there are any others.*/
+static displaySpan displayGetSpan (const value* result, int start, int limit, bool tail) {
+    displaySpan span = {.rows = vectorInit(limit && limit < 1024 ? 2*limit : 64, malloc)};
+
+    int i = start;
+
+    for (const value* row; (!limit || i < start+limit) && (row = valueGetTupleNth(result, i)); i++)
+        vectorPush(&span.rows, row);
+
+    span.head = span.rows.length;
+
+    /*All shown*/
+    if (!limit || !valueGetTupleNth(result, i)) {
+        span.elided = 0;
+        span.next = -1;
+        return span;
+    }
+
+    span.next = i;
+
+    if (valueIsLazy(result)) {
+        span.elided = -1;
+        return span;
+    }
+
+    int length = valueGuessIterableLength(result);
+    int tailStart = tail && length - limit > i ? length - limit : tail ? i : length;
 
-        if (!dry)
-            putchar(brackets[1]);
+    for (int j = tailStart; j < length; j++)
+        vectorPush(&span.rows, valueGetTupleNth(result, j));
 
-        return length;
+    span.elided = tailStart - i;
 
-    } else if (typeIsKind(type_Bool, dt)) {
-        return printf(valueGetInt(result) ? "true" : "false");
+    if (span.elided == 0)
+        span.next = -1;
+
+    return span;
+}
+
+/*1234567 as 1,234,567*/
+static void displayCount (int n) {
+    if (n >= 1000) {
+        displayCount(n / 1000);
+        arenaprintf(",%03d", n % 1000);
+
+    } else
+        arenaprintf("%d", n);
+}
+
+static void displaySummary (int elided, const char* noun) {
+    if (elided == 0)
+        return;
+
+    arenaprintf("  \u2026 ");
+
+    if (elided > 0) {
+        displayCount(elided);
+        arenaprintf(" more %s\n", noun);
 
     } else
-        return (dry ? valueGetWidthOfStr : valuePrint)(result);
+        arenaprintf("more %s\n", noun);
+}
+
+/*Note the result, so :more can show what was left out*/
+static void displayRemember (value* result, const displayPlan* plan, int next) {
+    displayLast.result = next < 0 ? 0 : result;
+    displayLast.plan = plan;
+    displayLast.next = next;
+}
+
+/*---- Formats ----*/
+
+/*How to render a value of some type inline, worked out from the type
+  once instead of testing it for every element.*/
+
+typedef struct displayFormat displayFormat;
+
+struct displayFormat {
+    void (*render)(const displayFormat* format, const value* v);
+    /*List: the format of the elements. Tuple: that of each field.
+      Dict: that of the keys, then of the values.*/
+    displayFormat** fields;
+    int fieldNo;
+};
+
+static void renderGeneric (const displayFormat* format, const value* v) {
+    (void) format;
+    valuePrintWith(v, arenaprintf);
+}
+
+static void renderInt (const displayFormat* format, const value* v) {
+    if (valueIsInvalid(v))
+        renderGeneric(format, v);
+
+    else
+        arenaprintf("%lld", (long long) valueGetInt(v));
+}
+
+static void renderBool (const displayFormat* format, const value* v) {
+    if (valueIsInvalid(v))
+        renderGeneric(format, v);
+
+    else
+        arenaprintf(valueGetInt(v) ? "true" : "false");
+}
+
+/*Styled by whether it's a directory*/
+static void renderFilename (const displayFormat* format, const value* v) {
+    (void) format;
+    printFilename(valueGetDisplayFilename(v));
+}
+
+static void renderList (const displayFormat* format, const value* v) {
+    const displayFormat* elements = format->fields[0];
+
+    arenaputc('[');
+
+    for_iterable_value_indexed (i, const value* element, v, {
+        if (i != 0)
+            arenaprintf(", ");
+
+        /*Enough of it, but only reading one more to tell*/
+        if (displayLimit && i == displayInlineLimit) {
+            arenaprintf("\u2026");
+
+            if (!valueIsLazy(v))
+                arenaprintf(" %d more", valueGuessIterableLength(v) - i);
+
+            break;
+        }
+
+        elements->render(elements, element);
+    })
+
+    arenaputc(']');
+}
+
+static void renderTuple (const displayFormat* format, const value* v) {
+    arenaputc('(');
+
+    for (int i = 0; i < format->fieldNo; i++) {
+        if (i != 0)
+            arenaprintf(", ");
+
+        const displayFormat* field = format->fields[i];
+        field->render(field, valueGetTupleNth(v, i));
+    }
+
+    arenaputc(')');
+}
+
+static void renderDict (const displayFormat* format, const value* v) {
+    const displayFormat *keys = format->fields[0],
+                        *values = format->fields[1];
+
+    const dict* table = valueGetDict(v);
+    int length = dictGetLength(table);
+
+    if (!length) {
+        arenaprintf("[:]");
+        return;
+    }
+
+    arenaputc('[');
+
+    for (int i = 0; i < length; i++) {
+        if (i != 0)
+            arenaprintf(", ");
+
+        if (displayLimit && i == displayInlineLimit) {
+            arenaprintf("\u2026 %d more", length - i);
+            break;
+        }
+
+        const value *key, *val;
+        dictGetNth(table, i, &key, &val);
+
+        keys->render(keys, key);
+        arenaprintf(": ");
+        values->render(values, val);
+    }
+
+    arenaputc(']');
 }
 
-static int displayGetWidthOfStr (const value* result, type* dt) {
-    return displayValueImpl(result, dt, dryprintf);
+/*Table cells are given files styled, otherwise they're as inline*/
+static displayFormat* displayCompileFormat (type* dt, bool cell) {
+    displayFormat* format = calloc(1, sizeof(displayFormat));
+
+    type *elements, *keys, *values;
+    vector(type*) tuple;
+
+    if (typeIsListOf(dt, &elements)) {
+        format->render = renderList;
+        format->fieldNo = 1;
+        format->fields = malloc(sizeof(displayFormat*));
+        format->fields[0] = displayCompileFormat(elements, false);
+
+    } else if (typeIsDictOf(dt, &keys, &values)) {
+        format->render = renderDict;
+        format->fieldNo = 2;
+        format->fields = malloc(sizeof(displayFormat*) * 2);
+        format->fields[0] = displayCompileFormat(keys, false);
+        format->fields[1] = displayCompileFormat(values, false);
+
+    } else if (typeIsTupleOf(dt, &tuple)) {
+        format->render = renderTuple;
+        format->fieldNo = tuple.length;
+        format->fields = malloc(sizeof(displayFormat*) * tuple.length);
+
+        for_vector_indexed (i, type* field, tuple, {
+            format->fields[i] = displayCompileFormat(field, false);
+        })
+
+    } else
+        format->render =   typeIsKind(type_Int, dt) ? renderInt
+                         : typeIsKind(type_Bool, dt) ? renderBool
+                         : typeIsKind(type_File, dt) && cell ? renderFilename
+                         : renderGeneric;
+
+    return format;
 }
 
-static int displayValue (const value* result, type* dt) {
-    return displayValueImpl(result, dt, printf);
+static void displayValue (const displayFormat* format, const value* v) {
+    format->render(format, v);
 }
 
-static void displayGrid (vector(const char*) entries, int (*printEntry)(const char*), size_t columnWidth) {
+static void displayGrid (vector(const char*) entries, size_t (*printEntry)(const char*), size_t columnWidth) {
     enum {gap = 2};
     columnWidth += gap;
 
@@ -106,6 +551,10 @@ static void displayGrid (vector(const char*) entries, int (*printEntry)(const ch
     int windowWidth = getWindowWidth();
 
     int columns = windowWidth / columnWidth;
+
+    if (columns < 1)
+        columns = 1;
+
     int rows = intdiv_roundup(entries.length, columns);
 
     /*Print row-by-row*/
@@ -119,35 +568,73 @@ static void displayGrid (vector(const char*) entries, int (*printEntry)(const ch
 
             size_t entrywidth = printEntry(entry);
             size_t padding = columnWidth-entrywidth;
-            putnchar(' ', padding);
+            arenaputn(' ', padding);
         }
 
-        printf("\n");
+        arenaputc('\n');
+    }
+}
+
+/*Show as many of the names as fit in the row limit. Only those that
+  could fit are measured. Returns how many were shown.*/
+static int displayGridOf (vector(const char*) names) {
+    enum {gap = 2};
+
+    int fit = names.length;
+
+    if (displayLimit) {
+        /*At most this many columns, of names a char wide*/
+        int maxColumns = getWindowWidth() / (1+gap);
+        maxColumns = maxColumns < 1 ? 1 : maxColumns;
+
+        if (fit > displayLimit * maxColumns)
+            fit = displayLimit * maxColumns;
+    }
+
+    size_t columnWidth = 0;
+
+    for (int i = 0; i < fit; i++) {
+        const char* name = vectorGet(names, i);
+        size_t namelen = displayGetWidth(name, strlen(name));
+
+        if (columnWidth < namelen)
+            columnWidth = namelen;
+    }
+
+    if (displayLimit) {
+        int columns = getWindowWidth() / (columnWidth+gap);
+        columns = columns < 1 ? 1 : columns;
+
+        if (fit > displayLimit * columns)
+            fit = displayLimit * columns;
     }
+
+    /*A view of the names that fit*/
+    vector(const char*) shown = names;
+    shown.length = fit;
+
+    displayGrid(shown, printFilename, columnWidth);
+
+    return fit;
 }
 
 static void displayDirectory (const char* dirname) {
     DIR* dir = opendir(dirname);
 
-    /*Get a listing of all the files and find the largest name*/
+    /*Get a listing of all the files*/
 
     vector(const char*) filenames = vectorInit(20, malloc);
 
-    size_t largest = 0;
-
-    for (struct dirent* entry; (entry = readdir(dir));) {
+    for (struct dirent* entry; (entry = readdir(dir));)
 		vectorPush(&filenames, entry->d_name);
-        size_t namelen = strwidth(entry->d_name);
-
-        if (largest < namelen)
-            largest = namelen;
-    }
 
     /*Display in a grid, in alphabetical order*/
     qsort(filenames.buffer, filenames.length, sizeof(void*), qsort_cstr);
-    displayGrid(filenames, printFilename, largest);
 
-    /*Kept the dir open til now as the filenames belonged to it*/
+    int shown = displayGridOf(filenames);
+    displaySummary(filenames.length - shown, "files");
+
+    /*The names have been copied into the output*/
     closedir(dir);
     vectorFree(&filenames);
 }
@@ -156,30 +643,30 @@ static void displayFile (const char* filename) {
     stat_t file;
     staterr error = nicestat(filename, &file);
 
-    printf("(");
+    arenaprintf("(");
 
     if (!error) {
         if (file.mode == file_regular)
             printSizeNicely(file.size);
 
         else
-            printf("A %s", fmode_getstr(file.mode));
+            arenaprintf("A %s", fmode_getstr(file.mode));
 
         /*Print the absolute path*/
-        printf(", located at %s", filename);
+        arenaprintf(", located at %s", filename);
 
     } else {
         switch (error) {
         case staterr_notexist:
-            printf("This file does not exist");
+            arenaprintf("This file does not exist");
             break;
 
         case staterr_notdir:
-            printf("This file has an invalid path");
+            arenaprintf("This file has an invalid path");
             break;
 
         case staterr_access:
-            printf("You do not have permission to access this path");
+            arenaprintf("You do not have permission to access this path");
             break;
 
         default:
@@ -187,102 +674,240 @@ static void displayFile (const char* filename) {
         }
     }
 
-    printf(")\n");
+    arenaprintf(")\n");
 
     if (!error && file.mode == file_dir)
         displayDirectory(filename);
 }
 
-static void displayRegular (value* result, type* dt) {
-    displayValue(result, dt);
+/*---- Plans ----*/
+
+typedef enum displayLayout {
+    layoutRegular,
+    /*Also describes the file*/
+    layoutFile,
+    layoutStr,
+    /*Nothing*/
+    layoutUnit,
+    /*Lists*/
+    layoutFileList,
+    layoutTable,
+    layoutListList
+} displayLayout;
+
+/*How to display a result of some type, compiled once per type*/
+struct displayPlan {
+    displayLayout layout;
+    /*Shown after the value*/
+    char* typeStr;
+    /*The whole value inline, also for short lists*/
+    displayFormat* format;
+
+    /*Table*/
+    int columns;
+    displayFormat** cells;
+    bool* rightAlign;
+
+    /*List of lists: how many levels deep there are lists of rows, and
+      the format of the rows*/
+    int levels;
+    displayFormat* rows;
+};
+
+/*By the string of the type, as types aren't interned*/
+static hashmap(displayPlan*) displayPlans;
+
+static displayPlan* displayCompilePlan (type* dt) {
+    displayPlan* plan = calloc(1, sizeof(displayPlan));
+    plan->typeStr = strdup(typeGetStr(dt));
+    plan->format = displayCompileFormat(dt, false);
+    plan->layout = layoutRegular;
+
+    type *elements, *innerElements;
+    vector(type*) tuple;
+
+    if (typeIsListOf(dt, &elements)) {
+        /* [['a]] -- List of lists (and possibly recursive) */
+        if (typeIsListOf(elements, &innerElements)) {
+            plan->layout = layoutListList;
+
+            /*Each level of nesting but the last is a row per line*/
+            for (type* rows = elements; typeIsListOf(rows, &innerElements); rows = innerElements) {
+                plan->levels++;
+                plan->rows = displayCompileFormat(rows, false);
+            }
+
+        /* [File] -- File lists are displayed in an autocomplete-like grid*/
+        } else if (typeIsKind(type_File, elements))
+            plan->layout = layoutFileList;
+
+        //todo check 'a 'b ... are simple (value and type)
+        /* [('a, 'b, ...)] -- A table */
+        else if (typeIsTupleOf(elements, &tuple)) {
+            plan->layout = layoutTable;
+            plan->columns = tuple.length;
+            plan->cells = malloc(sizeof(displayFormat*) * tuple.length);
+            plan->rightAlign = malloc(sizeof(bool) * tuple.length);
+
+            for_vector_indexed (i, type* column, tuple, {
+                plan->cells[i] = displayCompileFormat(column, true);
+                /*Right align (i.e. pad before the item) if the column is an int*/
+                plan->rightAlign[i] = typeIsKind(type_Int, column);
+            })
+        }
+
+    } else if (typeIsKind(type_Str, dt))
+        plan->layout = layoutStr;
+
+    /*Don't display unit results
+      These occur from statements like `let`*/
+    else if (typeIsKind(type_Unit, dt))
+        plan->layout = layoutUnit;
+
+    else if (typeIsKind(type_File, dt))
+        plan->layout = layoutFile;
+
+    return plan;
+}
+
+static const displayPlan* displayGetPlan (type* dt) {
+    if (mapNull(displayPlans))
+        displayPlans = hashmapInit(64, calloc);
+
+    const char* key = typeGetStr(dt);
+    displayPlan* plan = hashmapMap(&displayPlans, key);
+
+    if (!plan) {
+        plan = displayCompilePlan(dt);
+        /*The plan owns the key, so it lasts as long*/
+        hashmapAdd(&displayPlans, plan->typeStr, plan);
+    }
+
+    return plan;
+}
+
+static void displayType (const displayPlan* plan) {
+    arenaprintf(" :: %s\n", plan->typeStr);
+}
+
+static void displayRegular (value* result, const displayPlan* plan) {
+    displayValue(plan->format, result);
     //todo if multiline result, type on new line
-    printf(" :: %s\n", typeGetStr(dt));
+    displayType(plan);
 }
 
 /*Display a list of files as a grid of names, going down the rows
   first and then wrapping up to the next column.*/
-static void displayFileList (value* result, type* resultType) {
-    /*Turn the file list into a vector of names*/
-    vector(const char*) names = vectorMapInit((vectorMapper) valueGetDisplayFilename,
-                                              valueGetVector(result), malloc);
+static void displayFileList (value* result, const displayPlan* plan, int start) {
+    /*Enough names to fill the grid, if they're all a char wide*/
+    int maxColumns = getWindowWidth() / 3;
+    int limit = displayLimit * (maxColumns < 1 ? 1 : maxColumns);
 
-    /*Find the longest filename*/
+    displaySpan span = displayGetSpan(result, start, limit, false);
 
-    size_t columnWidth = 0;
+    /*Turn the files into a vector of names*/
+    vector(const char*) names = vectorMapInit((vectorMapper) valueGetDisplayFilename,
+                                              span.rows, malloc);
 
-    for_vector (const char* name, names, {
-        size_t namelen = strwidth(name);
+    int shown = displayGridOf(names);
 
-        if (columnWidth < namelen)
-            columnWidth = namelen;
-    })
+    /*Those that didn't fit after all are left out too*/
+    int unfit = names.length - shown;
 
-    /* */
+    if (unfit) {
+        span.next = start + shown;
+        span.elided = span.elided < 0 ? -1 : span.elided + unfit;
+    }
 
-    displayGrid(names, printFilename, columnWidth);
+    displaySummary(span.elided, "files");
+    displayRemember(result, plan, span.next);
 
     vectorFree(&names);
+    vectorFree(&span.rows);
 
-    printf(" :: %s\n", typeGetStr(resultType));
+    displayType(plan);
 }
 
+/*A rendered table cell*/
+typedef struct displayCell {
+    size_t offset, length, width;
+} displayCell;
+
 /*Display a tuple list as a table
   (because they are tuples, the result is square)*/
-static void displayTable (value* result, type* resultType, vector(type*) tuple) {
-    int columns = tuple.length;
+static void displayTable (value* result, const displayPlan* plan, int start) {
+    int columns = plan->columns;
+
+    displaySpan span = displayGetSpan(result, start, displayLimit, start == 0);
+    int rows = span.rows.length;
 
     /*Note: VLA*/
     size_t columnWidths[columns];
     memset(columnWidths, 0, sizeof(columnWidths));
 
-    /*For each column, find the max width of any value*/
+    /*Render each cell shown once, off to the side of the output, and
+      find the max width of each column from them*/
+
+    displayCell* cells = malloc(sizeof(displayCell) * rows * columns);
 
-    for_iterable_value (const value* inner, result, {
+    outputPieceArena();
+
+    for_vector_indexed (row, const value* inner, span.rows, {
         for (int col = 0; col < columns; col++) {
-            const value* item = valueGetTupleNth(inner, col);
-            type* itemType = vectorGet(tuple, col);
+            const displayFormat* format = plan->cells[col];
+
+            displayCell* cell = &cells[row*columns + col];
+            cell->offset = output.length;
 
-            size_t width = displayGetWidthOfStr(item, itemType);
+            format->render(format, valueGetTupleNth(inner, col));
 
-            if (columnWidths[col] < width)
-                columnWidths[col] = width;
+            cell->length = output.length - cell->offset;
+            cell->width = displayGetWidth(output.arena + cell->offset, cell->length);
+
+            if (columnWidths[col] < cell->width)
+                columnWidths[col] = cell->width;
         }
     })
 
+    /*Not to be output in the order rendered*/
+    output.unpieced = output.length;
+
     enum {gap = 2};
 
-    /*Print it*/
+    /*Lay it out*/
+
+    for (int row = 0; row < rows; row++) {
+        if (row == span.head) {
+            displaySummary(span.elided, "rows");
+            outputPieceArena();
+        }
 
-    for_iterable_value (const value* inner, result, {
         for (int col = 0; col < columns; col++) {
-            const value* item = valueGetTupleNth(inner, col);
-            putnchar(' ', gap);
+            displayCell cell = cells[row*columns + col];
+            size_t padding = columnWidths[col] - cell.width;
 
-            /*Right align (i.e. print padding before the item)
-              if the column is an int*/
+            bool rightAlign = plan->rightAlign[col];
 
-            type* itemType = vectorGet(tuple, col);
+            outputSpacesPiece(rightAlign ? gap + padding : gap);
+            outputPushPiece(0, cell.offset, cell.length);
 
-            bool rightAlign = typeIsKind(type_Int, itemType);
-            bool filename = typeIsKind(type_File, itemType);
+            if (!rightAlign)
+                outputSpacesPiece(padding);
+        }
 
-            size_t width =   filename ? printFilename(valueGetDisplayFilename(item))
-                           : (rightAlign ? displayGetWidthOfStr : displayValue)(item, itemType);
-            size_t padding = columnWidths[col] - width;
+        outputStr("\n", 1);
+    }
 
-            if (rightAlign) {
-                putnchar(' ', padding);
-                displayValue(item, itemType);
+    /*No tail*/
+    if (span.head == rows)
+        displaySummary(span.elided, "rows");
 
-            } else
-                /*Value already printed*/
-                putnchar(' ', padding);
-        }
+    displayRemember(result, plan, span.next);
 
-        putchar('\n');
-    })
+    free(cells);
+    vectorFree(&span.rows);
 
-    printf(" :: %s\n", typeGetStr(resultType));
+    displayType(plan);
 }
 
 /*Options for lists of lists*/
@@ -291,118 +916,191 @@ enum {
     displayListList_bracesOnOwnLineIfRecursing = true
 };
 
-void displayListList (value* result, type* resultType, type* elementType, type* innerElementType, int depth) {
-    vector(value*) elements = valueGetVector(result);
+static void displayListList (value* result, const displayPlan* plan, int depth, int start) {
+    /*Only the outermost list is cut short*/
+    displaySpan span = displayGetSpan(result, start, depth == 0 ? displayLimit : 0, start == 0);
+    vector(const value*) elements = span.rows;
 
-    /*Is the element type *also* a list of lists?*/
-    type* innerInnerElementType;
-    bool recursing = typeIsListOf(innerElementType, &innerInnerElementType);
+    /*Are the elements *also* lists of lists?*/
+    bool recursing = depth+1 < plan->levels;
 
     /*Put the braces on their own line, if the options say so*/
     bool bracesOnOwnLine =    displayListList_bracesOnOwnLine
                            || (   recursing
                                && displayListList_bracesOnOwnLineIfRecursing);
 
-    putchar('[');
+    arenaputc('[');
 
     if (bracesOnOwnLine) {
-        putchar('\n');
-        putnchar(' ', depth+1);
+        arenaputc('\n');
+        arenaputn(' ', depth+1);
     }
 
-    for_vector_indexed (i, value* element, elements, {
+    for_vector_indexed (i, const value* element, elements, {
         if (i != 0)
-            putnchar(' ', depth+1);
+            arenaputn(' ', depth+1);
 
         if (recursing)
-            displayListList(element, elementType, innerElementType, innerInnerElementType, depth+1);
+            displayListList((value*) element, plan, depth+1, 0);
 
         else
-            displayValue(element, elementType);
+            displayValue(plan->rows, element);
 
         if (i < elements.length-1) {
-            putchar(',');
-            putchar('\n');
+            arenaputc(',');
+            arenaputc('\n');
+        }
+
+        if (i+1 == span.head && span.elided) {
+            if (i == elements.length-1)
+                arenaputc('\n');
+
+            displaySummary(span.elided, "rows");
         }
     })
 
     if (bracesOnOwnLine) {
-        putchar('\n');
-        putnchar(' ', depth);
+        arenaputc('\n');
+        arenaputn(' ', depth);
     }
 
-    putchar(']');
+    arenaputc(']');
 
     if (depth == 0) {
         /*If the braces are on a same line as the rest of the list
           then there is room for the type*/
         if (!bracesOnOwnLine)
-            putchar('\n');
+            arenaputc('\n');
 
-        printf(" :: %s\n", typeGetStr(resultType));
+        displayRemember(result, plan, span.next);
+        displayType(plan);
     }
+
+    vectorFree(&span.rows);
 }
 
-void displayStr (value* result, type* resultType) {
+/*Show the lines at each end of a long string, referring to it rather
+  than copying. Only the lines shown are looked at.*/
+static void displayStrLines (const char* str, size_t length) {
+    if (!displayLimit) {
+        outputStr(str, length);
+        return;
+    }
+
+    /*The end of the head*/
+    const char* headEnd = str;
+
+    for (int i = 0; i < displayStrEndLines && headEnd; i++) {
+        headEnd = memchr(headEnd, '\n', str+length - headEnd);
+        headEnd = headEnd ? headEnd+1 : 0;
+    }
+
+    /*The start of the tail, not counting a final EOL*/
+    const char* tailStart = str+length;
+
+    if (headEnd) {
+        for (int lines = 0; tailStart > headEnd; tailStart--) {
+            if (tailStart[-1] == '\n' && tailStart != str+length && ++lines == displayStrEndLines)
+                break;
+        }
+    }
+
+    if (!headEnd || tailStart <= headEnd) {
+        outputStr(str, length);
+        return;
+    }
+
+    outputStr(str, headEnd - str);
+
+    arenaprintf("  \u2026 ");
+    printSizeNicely(tailStart - headEnd);
+    arenaprintf(" more\n");
+
+    outputStr(tailStart, str+length - tailStart);
+}
+
+static void displayStr (value* result, const displayPlan* plan) {
     size_t length;
     const char* str = valueGetStrWithLength(result, &length);
 
     /*Special handling for multiline strings
        - Check for final EOL and warn if missing
        - Display without quotes, with the type on a new line*/
-    if (strchr(str, '\n')) {
+    if (memchr(str, '\n', length)) {
         bool missingEOL = str[length-1] != '\n';
 
-        printf(missingEOL ? "%s\n :: %s\n" : "%s :: %s\n", str, typeGetStr(resultType));
+        /*Could be large, it isn't copied*/
+        displayStrLines(str, length);
+
+        if (missingEOL)
+            arenaputc('\n');
+
+        displayType(plan);
 
         if (missingEOL)
-            printf("(This string was missing a final end of line character.)\n");
+            arenaprintf("(This string was missing a final end of line character.)\n");
 
     } else
-        displayRegular(result, resultType);
+        displayRegular(result, plan);
+}
+
+/*Display the rows of a list from some index, the way its plan says.
+  Returns false if it isn't shown as rows.*/
+static bool displayRows (value* result, const displayPlan* plan, int start) {
+    bool list =    plan->layout == layoutListList || plan->layout == layoutFileList
+                || plan->layout == layoutTable;
+
+    /*Display empty or singular iterables the normal way instead*/
+    if (!list || (start == 0 && plan->layout != layoutListList && !valueGetTupleNth(result, 1)))
+        return false;
+
+    switch (plan->layout) {
+    case layoutListList: displayListList(result, plan, 0, start); break;
+    case layoutFileList: displayFileList(result, plan, start); break;
+    case layoutTable: displayTable(result, plan, start); break;
+    default: return false;
+    }
+
+    return true;
 }
 
 void displayResult (value* result, type* resultType) {
     /*Print the value and type*/
 
-    type *elements, *innerElements;
-    vector(type*) tuple;
+    const displayPlan* plan = displayGetPlan(resultType);
 
-    if (valueIsInvalid(result))
-        displayRegular(result, resultType);
+    displayLimit = displayGetLimit();
+    displayRemember(0, 0, -1);
 
-    else if (typeIsListOf(resultType, &elements)) {
-        /* [['a]] -- List of lists (and possibly recursive) */
-        if (typeIsListOf(elements, &innerElements))
-            displayListList(result, resultType, elements, innerElements, 0);
+    if (valueIsInvalid(result)) {
+        valuePrintWith(result, arenaprintf);
+        displayType(plan);
 
-        /*Display empty or singular iterables the normal way instead one of the following*/
-        else if (valueGuessIterableLength(result) <= 1)
-            displayRegular(result, resultType);
+    } else if (displayRows(result, plan, 0))
+        ;
 
-        /* [File] -- File lists are displayed in an autocomplete-like grid*/
-        else if (typeIsKind(type_File, elements))
-            displayFileList(result, resultType);
+    else if (plan->layout == layoutStr)
+        displayStr(result, plan);
 
-        //todo check 'a 'b ... are simple (value and type)
-        /* [('a, 'b, ...)] -- A table */
-        else if (typeIsTupleOf(elements, &tuple))
-            displayTable(result, resultType, tuple);
+    else if (plan->layout != layoutUnit) {
+        displayRegular(result, plan);
 
-        else
-            displayRegular(result, resultType);
+        if (plan->layout == layoutFile)
+            displayFile(valueGetFilename(result));
+    }
+
+    outputFlush();
+}
 
-    } else if (typeIsKind(type_Str, resultType)) {
-        displayStr(result, resultType);
+bool displayMore (int rows) {
+    if (!displayLast.result)
+        return false;
 
-    } else if (typeIsKind(type_Unit, resultType)) {
-        /*Don't display unit results
-          These occur from statements like `let`*/
+    /*Zero, the whole rest of it, if not to a terminal*/
+    displayLimit = rows > 0 ? rows : displayGetLimit();
 
-    } else {
-        displayRegular(result, resultType);
+    displayRows(displayLast.result, displayLast.plan, displayLast.next);
+    outputFlush();
 
-        if (typeIsKind(type_File, resultType))
-            displayFile(valueGetFilename(result));
-    }
+    return true;
 }
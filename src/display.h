@@ -1,5 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "forward.h"
 
 void displayResult (value* result, type* resultType);
+
+/*Carry on displaying the rows of the last result that were left out,
+  up to some number of them (or a screenful, if zero). Returns false if
+  there were none.*/
+bool displayMore (int rows);
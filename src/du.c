@@ -0,0 +1,344 @@
+/*For syscall and getdents64*/
+#define _GNU_SOURCE
+
+#include "du.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <common.h>
+
+#include "terminal.h"
+#include "parallel.h"
+
+enum {
+    /*Directories waiting to be read keep their fd open, so that they
+      needn't be looked up again by path, but only this many at once,
+      and no more than a quarter of the limit*/
+    duMaxHeldFds = 256,
+    duBufferSize = 64*1024,
+    duInitialLinks = 1024
+};
+
+/*As the kernel writes them, which glibc doesn't always declare*/
+typedef struct duDirent {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} duDirent;
+
+typedef struct duDir {
+    struct duDir* next;
+    /*-1 if it has to be opened from the path*/
+    int fd;
+    char* path;
+    /*Which of the sizes it counts towards*/
+    int slot;
+} duDir;
+
+typedef struct duLink {
+    dev_t dev;
+    ino_t ino;
+    /*Whose size it is counted in*/
+    int slot;
+    int64_t size;
+} duLink;
+
+typedef struct duWalk {
+    _Atomic int64_t* sizes;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    /*Read depth first, which keeps the number waiting down*/
+    duDir* waiting;
+    /*Directories being read right now. When there are none, and none
+      waiting, the walk is done.*/
+    int busy;
+    int heldFds, maxHeldFds;
+
+    /*Files with more than one link, seen already. An open addressed
+      set, of a power of two capacity.*/
+    pthread_mutex_t linksLock;
+    duLink* links;
+    size_t linkNo, linkCapacity;
+} duWalk;
+
+/*==== Hard links ====*/
+
+static size_t duLinkHash (dev_t dev, ino_t ino) {
+    uint64_t h = ((uint64_t) dev * 0x9E3779B97F4A7C15ULL) ^ (uint64_t) ino;
+    return (h ^ (h >> 29)) * 0xBF58476D1CE4E5B9ULL;
+}
+
+static void duLinksInsert (duLink* links, size_t capacity, duLink link) {
+    size_t mask = capacity-1;
+
+    for (size_t i = duLinkHash(link.dev, link.ino) & mask;; i = (i+1) & mask) {
+        if (!links[i].ino) {
+            links[i] = link;
+            return;
+        }
+    }
+}
+
+/*Whether the file should be counted in this slot: it hasn't been seen
+  before, or only by a later slot, which then gives it up. That way a
+  file is always counted in the first of the sizes that has it, however
+  the walk happens to go. Inode 0 isn't a real file, so it marks an
+  empty entry.*/
+static bool duClaimLink (duWalk* walk, const struct stat* st, int slot, int64_t size) {
+    if (!st->st_ino)
+        return true;
+
+    pthread_mutex_lock(&walk->linksLock);
+
+    size_t mask = walk->linkCapacity-1;
+    duLink* seen = 0;
+
+    for (size_t i = duLinkHash(st->st_dev, st->st_ino) & mask; walk->links[i].ino; i = (i+1) & mask) {
+        if (walk->links[i].ino == st->st_ino && walk->links[i].dev == st->st_dev) {
+            seen = &walk->links[i];
+            break;
+        }
+    }
+
+    bool claimed = !seen || slot < seen->slot;
+
+    if (seen && claimed) {
+        walk->sizes[seen->slot] -= size;
+        seen->slot = slot;
+
+    } else if (!seen) {
+        /*Keep it at most half full*/
+        if (2*(walk->linkNo+1) > walk->linkCapacity) {
+            size_t capacity = 2*walk->linkCapacity;
+            duLink* links = calloc(capacity, sizeof(duLink));
+
+            for (size_t i = 0; i < walk->linkCapacity; i++)
+                if (walk->links[i].ino)
+                    duLinksInsert(links, capacity, walk->links[i]);
+
+            free(walk->links);
+            walk->links = links;
+            walk->linkCapacity = capacity;
+        }
+
+        duLinksInsert(walk->links, walk->linkCapacity, (duLink) {st->st_dev, st->st_ino, slot, size});
+        walk->linkNo++;
+    }
+
+    pthread_mutex_unlock(&walk->linksLock);
+
+    return claimed;
+}
+
+/*The space a file takes, or nothing if it is counted elsewhere*/
+static int64_t duSize (duWalk* walk, const struct stat* st, int slot) {
+    /*Always in units of 512, whatever the block size*/
+    int64_t size = (int64_t) st->st_blocks * 512;
+
+    if (S_ISDIR(st->st_mode) || st->st_nlink <= 1)
+        return size;
+
+    return duClaimLink(walk, st, slot, size) ? size : 0;
+}
+
+/*==== Directories ====*/
+
+static void duPush (duWalk* walk, int parentFd, const char* parentPath, const char* name, int slot) {
+    duDir* dir = malloc(sizeof(duDir));
+
+    size_t length = strlen(parentPath) + strlen(name) + 2;
+    dir->path = malloc(length);
+    snprintf(dir->path, length, "%s/%s", parentPath, name);
+
+    dir->slot = slot;
+    dir->fd = -1;
+
+    pthread_mutex_lock(&walk->lock);
+
+    bool hold = walk->heldFds < walk->maxHeldFds;
+
+    if (hold)
+        walk->heldFds++;
+
+    pthread_mutex_unlock(&walk->lock);
+
+    if (hold)
+        dir->fd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    pthread_mutex_lock(&walk->lock);
+
+    if (hold && dir->fd < 0)
+        walk->heldFds--;
+
+    dir->next = walk->waiting;
+    walk->waiting = dir;
+
+    pthread_cond_signal(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static void duFree (duDir* dir) {
+    free(dir->path);
+    free(dir);
+}
+
+/*Take a directory to read, waiting for one if others are still being
+  read. Null once there are no more.*/
+static duDir* duPop (duWalk* walk) {
+    pthread_mutex_lock(&walk->lock);
+
+    while (!walk->waiting && walk->busy && !cancelled())
+        pthread_cond_wait(&walk->changed, &walk->lock);
+
+    duDir* dir = 0;
+
+    if (cancelled()) {
+        /*Drop the rest*/
+        for (duDir* next; walk->waiting; walk->waiting = next) {
+            next = walk->waiting->next;
+
+            if (walk->waiting->fd >= 0) {
+                close(walk->waiting->fd);
+                walk->heldFds--;
+            }
+
+            duFree(walk->waiting);
+        }
+
+    } else if (walk->waiting) {
+        dir = walk->waiting;
+        walk->waiting = dir->next;
+        walk->busy++;
+
+        if (dir->fd >= 0)
+            walk->heldFds--;
+    }
+
+    /*Let the others see that it's over*/
+    if (!dir)
+        pthread_cond_broadcast(&walk->changed);
+
+    pthread_mutex_unlock(&walk->lock);
+
+    return dir;
+}
+
+static void duDone (duWalk* walk) {
+    pthread_mutex_lock(&walk->lock);
+    walk->busy--;
+
+    if (!walk->busy)
+        pthread_cond_broadcast(&walk->changed);
+
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/*Count everything in the directory, queueing those inside it. The
+  directory itself was counted by whoever found it.*/
+static void duRead (duWalk* walk, duDir* dir, char* buffer) {
+    int fd = dir->fd >= 0 ? dir->fd : open(dir->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (fd < 0)
+        return;
+
+    int64_t total = 0;
+    long got;
+
+    while (!cancelled() && (got = syscall(SYS_getdents64, fd, buffer, duBufferSize)) > 0) {
+        for (long pos = 0; pos < got;) {
+            const duDirent* entry = (const duDirent*) (buffer + pos);
+            pos += entry->d_reclen;
+
+            const char* name = entry->d_name;
+
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+                continue;
+
+            struct stat st;
+
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW))
+                continue;
+
+            total += duSize(walk, &st, dir->slot);
+
+            if (S_ISDIR(st.st_mode))
+                duPush(walk, fd, dir->path, name, dir->slot);
+        }
+    }
+
+    close(fd);
+
+    walk->sizes[dir->slot] += total;
+}
+
+static void duWorker (duWalk* walk, int start, int end) {
+    (void) start, (void) end;
+
+    char* buffer = malloc(duBufferSize);
+
+    for (duDir* dir; (dir = duPop(walk));) {
+        duRead(walk, dir, buffer);
+        duFree(dir);
+        duDone(walk);
+    }
+
+    free(buffer);
+}
+
+bool duMeasure (int n, const char* const* filenames, int64_t* sizes_out) {
+    duWalk walk = {
+        .sizes = calloc(n, sizeof(*walk.sizes)),
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .changed = PTHREAD_COND_INITIALIZER,
+        .linksLock = PTHREAD_MUTEX_INITIALIZER,
+        .links = calloc(duInitialLinks, sizeof(duLink)),
+        .linkCapacity = duInitialLinks
+    };
+
+    struct rlimit limit;
+    walk.maxHeldFds = duMaxHeldFds;
+
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur/4 < duMaxHeldFds)
+        walk.maxHeldFds = limit.rlim_cur/4;
+
+    for (int i = 0; i < n; i++) {
+        struct stat st;
+
+        if (stat(filenames[i], &st)) {
+            walk.sizes[i] = -1;
+            continue;
+        }
+
+        walk.sizes[i] = duSize(&walk, &st, i);
+
+        if (S_ISDIR(st.st_mode)) {
+            /*Opened by path when it is read*/
+            duDir* dir = malloc(sizeof(duDir));
+            *dir = (duDir) {walk.waiting, -1, strdup(filenames[i]), i};
+            walk.waiting = dir;
+        }
+    }
+
+    parallelFor(parallelThreads(), 1, (parallelBody) duWorker, &walk);
+
+    for (int i = 0; i < n; i++)
+        sizes_out[i] = walk.sizes[i];
+
+    free((void*) walk.sizes);
+    free(walk.links);
+    pthread_mutex_destroy(&walk.lock);
+    pthread_cond_destroy(&walk.changed);
+    pthread_mutex_destroy(&walk.linksLock);
+
+    return !cancelled();
+}
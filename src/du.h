@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*The disk usage, in bytes, of each of n files: the space allocated for
+  it and, for a directory, for everything inside it, as du counts it.
+  Symbolic links inside are not followed, but the files given are.
+
+  Directories are read by as many threads as there are cores. A file
+  with many hard links is counted once, in the first of the sizes to
+  include it, as du does. Anything inside that can't be read counts as
+  nothing, and a file given that doesn't exist gets a size of -1.
+
+  Returns false if cancelled, leaving the sizes partial.*/
+bool duMeasure (int n, const char* const* filenames, int64_t* sizes_out);
@@ -5,5 +5,7 @@ typedef struct typeSys typeSys;
 typedef struct sym sym;
 typedef struct ast ast;
 typedef struct value value;
+typedef struct regex regex;
+typedef struct dict dict;
 
 typedef struct lexerCtx lexerCtx;
@@ -0,0 +1,190 @@
+#include "hash.h"
+
+#include <string.h>
+
+/*==== XXH64 ====*/
+
+static const uint64_t prime1 = 0x9E3779B185EBCA87ULL,
+                      prime2 = 0xC2B2AE3D27D4EB4FULL,
+                      prime3 = 0x165667B19E3779F9ULL,
+                      prime4 = 0x85EBCA77C2B2AE63ULL,
+                      prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64 (uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/*Unaligned, little endian reads*/
+static inline uint64_t read64 (const uint8_t* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint32_t read32 (const uint8_t* p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint64_t xxhRound (uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc = rotl64(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t xxhMerge (uint64_t acc, uint64_t lane) {
+    acc ^= xxhRound(0, lane);
+    return acc * prime1 + prime4;
+}
+
+uint64_t hashFast (const void* data, size_t length, uint64_t seed) {
+    const uint8_t *p = data,
+                  *end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + prime1 + prime2,
+                 v2 = seed + prime2,
+                 v3 = seed,
+                 v4 = seed - prime1;
+
+        for (; end - p >= 32; p += 32) {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p+8));
+            v3 = xxhRound(v3, read64(p+16));
+            v4 = xxhRound(v4, read64(p+24));
+        }
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+
+    } else
+        h = seed + prime5;
+
+    h += length;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= xxhRound(0, read64(p));
+        h = rotl64(h, 27) * prime1 + prime4;
+    }
+
+    if (end - p >= 4) {
+        h ^= read32(p) * prime1;
+        h = rotl64(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+
+    for (; p < end; p++) {
+        h ^= *p * prime5;
+        h = rotl64(h, 11) * prime1;
+    }
+
+    /*Avalanche*/
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/*==== SHA-256 ====*/
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32 (uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static void sha256Block (uint32_t state[8], const uint8_t* block) {
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; i++)
+        w[i] =   (uint32_t) block[4*i] << 24 | (uint32_t) block[4*i+1] << 16
+               | (uint32_t) block[4*i+2] << 8 | block[4*i+3];
+
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ (w[i-15] >> 3),
+                 s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25),
+                 ch = (e & f) ^ (~e & g),
+                 t1 = h + s1 + ch + sha256K[i] + w[i],
+                 s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22),
+                 maj = (a & b) ^ (a & c) ^ (b & c),
+                 t2 = s0 + maj;
+
+        h = g; g = f; f = e;
+        e = d + t1;
+        d = c; c = b; b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void hashSHA256 (const void* data, size_t length, uint8_t digest[hashSHA256Size]) {
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    const uint8_t* p = data;
+    size_t left = length;
+
+    for (; left >= 64; p += 64, left -= 64)
+        sha256Block(state, p);
+
+    /*The rest, a one bit, zeroes and the length in bits fill one or two
+      more blocks*/
+    uint8_t tail[128] = {};
+    memcpy(tail, p, left);
+    tail[left] = 0x80;
+
+    size_t tailLength = left + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t) length * 8;
+
+    for (int i = 0; i < 8; i++)
+        tail[tailLength-1-i] = bits >> 8*i;
+
+    for (size_t i = 0; i < tailLength; i += 64)
+        sha256Block(state, tail+i);
+
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 4; j++)
+            digest[4*i+j] = state[i] >> (24 - 8*j);
+}
+
+/*==== ====*/
+
+void hashToHex (const uint8_t* bytes, size_t length, char* str) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < length; i++) {
+        str[2*i] = digits[bytes[i] >> 4];
+        str[2*i+1] = digits[bytes[i] & 15];
+    }
+
+    str[2*length] = 0;
+}
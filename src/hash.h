@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*XXH64, a fast non-cryptographic hash. Four independent lanes take 32
+  bytes at a time, so it runs at about the speed memory can be read.*/
+uint64_t hashFast (const void* data, size_t length, uint64_t seed);
+
+enum {
+    hashSHA256Size = 32
+};
+
+/*SHA-256, for when the hash has to be trusted*/
+void hashSHA256 (const void* data, size_t length, uint8_t digest[hashSHA256Size]);
+
+/*Write bytes as lowercase hex into str, which must have room for
+  2*length+1 chars*/
+void hashToHex (const uint8_t* bytes, size_t length, char* str);
@@ -1,32 +1,58 @@
-#define _XOPEN_SOURCE 700
+/*For pipe2*/
+#define _GNU_SOURCE
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <spawn.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <termios.h>
 #include <sys/types.h>
+#include <gc.h>
 
 #include <common.h>
 
 #include "common.h"
+#include "terminal.h"
+#include "invoke.h"
 
 void handleCtrlZ (int signo) {
     precond(signo == SIGTSTP);
     exit(0);
 }
 
+/*Ctrl-C cancels the command running, not the shell. The programs it
+  started share our process group, so the terminal interrupts them too.*/
+static void handleCtrlC (int signo) {
+    (void) signo;
+    terminalInterrupts++;
+}
+
 void terminalInit (void) {
     int terminal = STDIN_FILENO;
     bool interactive = isatty(terminal);
 
+    /*Writing to a program that has stopped reading is an error (EPIPE),
+      not a reason to exit*/
+    signal(SIGPIPE, SIG_IGN);
+
     if (interactive) {
         sigaction(SIGTSTP, &(struct sigaction) {.sa_handler = handleCtrlZ}, 0); //Ctrl-Z
 
         /*Ignore various signals*/
 
+        /*No SA_RESTART: a blocking call returns to check the token*/
+        sigaction(SIGINT, &(struct sigaction) {.sa_handler = handleCtrlC}, 0); //Ctrl-C
+
         /*Job control*/
-        signal(SIGINT, SIG_IGN); //Ctrl-C
         signal(SIGQUIT, SIG_IGN); //Ctrl-\-
 
         /*Attempting IO while in the background*/
@@ -47,84 +73,737 @@ void terminalInit (void) {
     }
 }
 
-void childInit (void) {
-    /*Restore the default handlers*/
-    signal(SIGINT, SIG_DFL);
-    signal(SIGQUIT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGTTIN, SIG_DFL);
-    signal(SIGTTOU, SIG_DFL);
-    signal(SIGCHLD, SIG_DFL);
+/*The signals ignored by the shell, which programs get the default
+  handlers for*/
+static void invokeSigDefaults (sigset_t* set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
+    sigaddset(set, SIGCHLD);
+    sigaddset(set, SIGPIPE);
 }
 
-static _Noreturn void invoke (const char* program, char** argv) {
-    childInit();
+enum {
+    /*The least room given to each read of a program's output*/
+    invokeReadSize = 64*1024,
+    invokeMaxEvents = 16,
+    /*How often the cancellation token is checked, in case the signal
+      interrupted another thread (ms)*/
+    invokeCancelPoll = 50
+};
+
+/*Start a program without waiting for it, reading from and writing to
+  the given fds (-1 for stderr shares the shell's). posix_spawn avoids
+  copying the page tables of the shell (and its GC heap) like fork would.
+  Returns the pid, or -1 if it couldn't be started.*/
+static pid_t invoke (char** argv, int in, int out, int err) {
+    const char* program = argv[0];
 
-    execv(program, argv);
-    /*exec* only returns if there was an error*/
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
 
-    perror("error: failed to execute program");
-    printf("       program '%s'\n", program);
-    exit(1);
-}
+    /*Programs in the background get their own process group, see
+      below, so reading the terminal would stop them with SIGTTIN.
+      They get nothing to read instead.*/
+    bool background = threadCancelToken != &terminalInterrupts;
 
-int invokeSyncronously (char** argv) {
-    const char* program = argv[0];
+    if (in != STDIN_FILENO)
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+
+    else if (background)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    if (out != STDOUT_FILENO)
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+
+    if (err >= 0)
+        posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    sigset_t defaults, unblocked;
+    invokeSigDefaults(&defaults);
+    sigemptyset(&unblocked);
+
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &unblocked);
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+    /*Programs started in the background get a process group of their
+      own, out of the reach of Ctrl-C*/
+    if (background) {
+        posix_spawnattr_setpgroup(&attr, 0);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+
+    posix_spawnattr_setflags(&attr, flags);
 
     pid_t child;
+    int error = posix_spawn(&child, program, &actions, &attr, argv, environ);
 
-    switch ((child = fork())) {
-    case -1:
-        errprintf("Failed to start a new process\n");
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error) {
+        fprintf(stderr, "error: failed to execute program: %s\n", strerror(error));
+        printf("       program '%s'\n", program);
         return -1;
+    }
+
+    return child;
+}
+
+/*Start the programs of a pipeline, the first reading from in and the
+  last writing to out, all writing errors to err. The pids are written
+  to children, -1 for any that couldn't be started.*/
+static void invokeStart (int n, char** argvs[], int in, int out, int err, pid_t* children) {
+    for (int i = 0; i < n; i++) {
+        bool last = i == n-1;
+        int stagePipe[2] = {-1, out};
+
+        /*Close-on-exec, so that no other program (started by another
+          thread) holds on to the pipe. dup2 clears it for the child.*/
+        if (!last && pipe2(stagePipe, O_CLOEXEC) < 0) {
+            errprintf("Failed to create a pipe\n");
+
+            for (; i < n; i++)
+                children[i] = -1;
+
+            break;
+        }
+
+        children[i] = invoke(argvs[i], in, stagePipe[1], err);
+
+        /*The ends of the pipes are only for the children. If one
+          wasn't started, its neighbours see the pipes close.*/
+
+        if (in != STDIN_FILENO)
+            close(in);
+
+        if (!last)
+            close(stagePipe[1]);
+
+        in = stagePipe[0];
+    }
+
+    if (in >= 0 && in != STDIN_FILENO)
+        close(in);
+}
+
+static int invokeDecodeStatus (int status) {
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+
+    else
+        return -3;
+}
+
+static int invokeWait (pid_t child) {
+    int status;
+
+    if (waitpid(child, &status, 0) != child)
+        return -2;
+
+    return invokeDecodeStatus(status);
+}
+
+/*A pidfd becomes readable when the process exits, so children can be
+  waited on by the same loop as their pipes. -1 if unsupported.*/
+static int invokePidfd (pid_t child) {
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, child, 0);
+#else
+    (void) child;
+    return -1;
+#endif
+}
+
+/*Write as much of the input as the fd takes, advancing through it.
+  Returns whether there's any left to write.*/
+static bool invokeWriteSome (int fd, struct iovec** input, int* inputs) {
+    while (*inputs) {
+        ssize_t written = writev(fd, *input, *inputs < IOV_MAX ? *inputs : IOV_MAX);
+
+        if (written < 0) {
+            /*Stopped reading, or full: either way, not now*/
+            if (errno == EINTR)
+                continue;
+
+            else if (errno == EAGAIN)
+                return true;
+
+            else {
+                *inputs = 0;
+                return false;
+            }
+        }
+
+        /*Skip past whatever was written*/
+        for (; *inputs && (size_t) written >= (*input)->iov_len; (*input)++, (*inputs)--)
+            written -= (*input)->iov_len;
+
+        if (*inputs) {
+            (*input)->iov_base = (char*) (*input)->iov_base + written;
+            (*input)->iov_len -= written;
+        }
+    }
 
-    /*Child (the program)*/
-    case 0:
-        invoke(program, argv);
+    return false;
+}
+
+/*==== Event loop ====*/
+
+/*What an fd watched by the loop is for*/
+typedef enum invokeSourceKind {
+    sourceOutput, sourceErrors, sourceInput, sourceChild
+} invokeSourceKind;
+
+typedef struct invokeSource {
+    struct invokeJob* job;
+    invokeSourceKind kind;
+    int fd;
+    /*sourceChild: which of the programs*/
+    int index;
+} invokeSource;
+
+/*A growing buffer for the output of programs*/
+typedef struct invokeBuffer {
+    char* str;
+    size_t length, capacity;
+    realloc_t realloc;
+} invokeBuffer;
+
+/*A pipeline started together, and the ends of the pipes the shell
+  holds to it*/
+typedef struct invokeJob {
+    int n;
+    char*** argvs;
+    pid_t* children;
+    int* statuses;
+    bool captured;
+
+    struct iovec* input;
+    int inputs;
+
+    invokeBuffer output, errors;
+
+    /*The input, output, errors, then a pidfd for each child*/
+    invokeSource* sources;
+    /*Sources still open*/
+    int pending;
+    bool finished;
+} invokeJob;
+
+/*Services the pipes and exits of the programs of any number of jobs*/
+typedef struct invokeLoop {
+    int epoll;
+    int active;
+    /*The cancellation requests already acted on*/
+    int cancels;
+} invokeLoop;
+
+static invokeLoop invokeLoopInit (void) {
+    return (invokeLoop) {
+        .epoll = epoll_create1(EPOLL_CLOEXEC),
+        .active = 0,
+        .cancels = 0
+    };
+}
+
+static invokeLoop* invokeLoopFree (invokeLoop* loop) {
+    close(loop->epoll);
+    return loop;
+}
+
+static invokeJob invokeJobInit (int n, char** argvs[], bool captured, alloc_t alloc) {
+    invokeJob job = {
+        .n = n,
+        .argvs = argvs,
+        .children = malloc(sizeof(pid_t) * n),
+        .statuses = malloc(sizeof(int) * n),
+        .captured = captured,
+        .sources = calloc(n+3, sizeof(invokeSource)),
+        .pending = 0,
+        .finished = false
+    };
+
+    if (captured) {
+        job.output = (invokeBuffer) {
+            .str = alloc.malloc(invokeReadSize+1),
+            .capacity = invokeReadSize+1,
+            .realloc = alloc.realloc
+        };
+        job.errors = (invokeBuffer) {
+            .str = malloc(invokeReadSize+1),
+            .capacity = invokeReadSize+1,
+            .realloc = realloc
+        };
+    }
+
+    for (int i = 0; i < n; i++)
+        job.statuses[i] = -1;
+
+    return job;
+}
+
+static invokeJob* invokeJobFree (invokeJob* job) {
+    free(job->children);
+    free(job->statuses);
+    free(job->sources);
+
+    if (job->captured)
+        free(job->errors.str);
+
+    return job;
+}
+
+static void invokeWatch (invokeLoop* loop, invokeJob* job, invokeSource* source,
+                         invokeSourceKind kind, int fd, int index) {
+    *source = (invokeSource) {.job = job, .kind = kind, .fd = fd, .index = index};
+
+    struct epoll_event event = {
+        .events = kind == sourceInput ? EPOLLOUT : EPOLLIN,
+        .data.ptr = source
+    };
+
+    if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        errprintf("Failed to watch a pipe\n");
+        close(fd);
+        return;
+    }
+
+    job->pending++;
+}
+
+static void invokeUnwatch (invokeLoop* loop, invokeSource* source) {
+    epoll_ctl(loop->epoll, EPOLL_CTL_DEL, source->fd, 0);
+    close(source->fd);
+    source->fd = -1;
+    source->job->pending--;
+}
+
+/*Start the programs of a job, and watch them*/
+static void invokeJobStart (invokeLoop* loop, invokeJob* job) {
+    int inputPipe[2] = {STDIN_FILENO, -1},
+        outputPipe[2] = {-1, STDOUT_FILENO},
+        errorPipe[2] = {-1, -1};
+
+    bool fail =    (job->input && pipe2(inputPipe, O_CLOEXEC) < 0)
+                || (job->captured && pipe2(outputPipe, O_CLOEXEC) < 0)
+                || (job->captured && pipe2(errorPipe, O_CLOEXEC) < 0);
+
+    if (fail) {
+        errprintf("Failed to create a pipe\n");
+
+        for (int i = 0; i < job->n; i++)
+            job->children[i] = -1;
 
-    /*Parent (the shell)*/
-    default: {
+        loop->active++;
+        job->finished = true;
+        return;
+    }
+
+    invokeStart(job->n, job->argvs, inputPipe[0], outputPipe[1], errorPipe[1], job->children);
+
+    /*invokeStart closed the read end of the input, for the first program*/
+
+    if (job->input) {
+        fcntl(inputPipe[1], F_SETFL, fcntl(inputPipe[1], F_GETFL) | O_NONBLOCK);
+        invokeWatch(loop, job, &job->sources[0], sourceInput, inputPipe[1], 0);
+    }
+
+    if (job->captured) {
+        close(outputPipe[1]);
+        close(errorPipe[1]);
+        invokeWatch(loop, job, &job->sources[1], sourceOutput, outputPipe[0], 0);
+        invokeWatch(loop, job, &job->sources[2], sourceErrors, errorPipe[0], 0);
+    }
+
+    for (int i = 0; i < job->n; i++) {
+        int pidfd = job->children[i] < 0 ? -1 : invokePidfd(job->children[i]);
+
+        if (pidfd >= 0)
+            invokeWatch(loop, job, &job->sources[3+i], sourceChild, pidfd, i);
+
+        else
+            job->sources[3+i].fd = -1;
+    }
+
+    loop->active++;
+
+    if (job->pending == 0)
+        job->finished = true;
+}
+
+/*Read as much as is waiting, at least invokeReadSize at a time.
+  Returns whether the pipe is still open.*/
+static bool invokeReadSome (int fd, invokeBuffer* buffer) {
+    if (buffer->capacity - buffer->length < invokeReadSize+1) {
+        buffer->capacity = 2*buffer->capacity + invokeReadSize;
+        buffer->str = buffer->realloc(buffer->str, buffer->capacity);
+    }
+
+    ssize_t readsize = read(fd, buffer->str + buffer->length, buffer->capacity - buffer->length - 1);
+
+    if (readsize < 0)
+        return errno == EINTR || errno == EAGAIN;
+
+    buffer->length += readsize;
+    return readsize != 0;
+}
+
+static void invokeHandle (invokeLoop* loop, invokeSource* source) {
+    invokeJob* job = source->job;
+    bool open;
+
+    switch (source->kind) {
+    case sourceOutput: open = invokeReadSome(source->fd, &job->output); break;
+    case sourceErrors: open = invokeReadSome(source->fd, &job->errors); break;
+    /*Done with the input, or the program doesn't want the rest*/
+    case sourceInput: open = invokeWriteSome(source->fd, &job->input, &job->inputs); break;
+
+    case sourceChild: {
         int status;
 
-        if (waitpid(child, &status, 0) != child)
-            return -2;
+        if (waitpid(job->children[source->index], &status, 0) == job->children[source->index])
+            job->statuses[source->index] = invokeDecodeStatus(status);
 
-        if (WIFEXITED(status))
-            return WEXITSTATUS(status);
+        else
+            job->statuses[source->index] = -2;
+
+        open = false;
+        break;
+    }
+
+    default:
+        open = false;
+    }
+
+    if (!open)
+        invokeUnwatch(loop, source);
+
+    if (job->pending == 0)
+        job->finished = true;
+}
+
+/*Wait on the children that couldn't be given a pidfd, and finish off
+  the output*/
+static void invokeJobEnd (invokeJob* job) {
+    for (int i = 0; i < job->n; i++) {
+        if (job->children[i] >= 0 && job->statuses[i] == -1)
+            job->statuses[i] = invokeWait(job->children[i]);
+    }
+
+    if (job->captured) {
+        job->output.str[job->output.length] = 0;
+        job->errors.str[job->errors.length] = 0;
+    }
+}
+
+/*Stop the programs of the jobs after a cancellation. Those writing to
+  the terminal have been interrupted by it already, and may handle that
+  as they like (e.g. an editor), unless asked again. Output that is
+  captured is thrown away anyway, so those are killed straight off.*/
+static void invokeLoopCancel (invokeLoop* loop, invokeJob* jobs, int n) {
+    int cancels = *threadCancelToken;
+
+    if (loop->cancels == cancels)
+        return;
+
+    for (int i = 0; i < n; i++) {
+        invokeJob* job = &jobs[i];
+
+        /*Nothing more to be sent*/
+        if (job->input && job->sources[0].fd >= 0) {
+            invokeUnwatch(loop, &job->sources[0]);
+            job->finished = job->pending == 0;
+        }
+
+        if (!job->captured && cancels < 2)
+            continue;
+
+        for (int j = 0; j < job->n; j++)
+            /*Still unreaped, so the pid can't have been reused*/
+            if (job->children[j] >= 0 && job->statuses[j] == -1)
+                kill(job->children[j], SIGKILL);
+
+        /*Any programs they started may hold the pipes open, don't wait
+          on them*/
+        for (int j = 1; j <= 2; j++) {
+            if (job->captured && job->sources[j].fd >= 0) {
+                invokeUnwatch(loop, &job->sources[j]);
+                job->finished = job->pending == 0;
+            }
+        }
+    }
+
+    loop->cancels = cancels;
+}
+
+/*Run the loop until one of the jobs finishes, and return it. Returns
+  null if there are none left.*/
+static invokeJob* invokeLoopNext (invokeLoop* loop, invokeJob* jobs, int n) {
+    while (loop->active) {
+        /*Any finished already?*/
+        for (int i = 0; i < n; i++) {
+            if (jobs[i].finished) {
+                jobs[i].finished = false;
+                loop->active--;
+                invokeJobEnd(&jobs[i]);
+                return &jobs[i];
+            }
+        }
+
+        if (cancelled())
+            invokeLoopCancel(loop, jobs, n);
+
+        struct epoll_event events[invokeMaxEvents];
+        int ready = epoll_wait(loop->epoll, events, invokeMaxEvents, invokeCancelPoll);
+
+        if (ready < 0 && errno != EINTR) {
+            errprintf("Failed to wait for programs\n");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+            invokeHandle(loop, events[i].data.ptr);
+    }
+
+    return 0;
+}
+
+/*Let the errors of a program be seen, now that it won't interleave
+  with any others*/
+static void invokeJobReplayErrors (invokeJob* job) {
+    if (job->captured && job->errors.length) {
+        fwrite(job->errors.str, 1, job->errors.length, stderr);
+        fflush(stderr);
+    }
+}
+
+/*==== ====*/
+
+long invokeArgLimit (void) {
+    long limit = sysconf(_SC_ARG_MAX);
+
+    for (char** var = environ; *var; var++)
+        limit -= strlen(*var) + 1 + sizeof(char*);
+
+    /*Some slack, as xargs leaves*/
+    return limit - 2048;
+}
+
+int invokeSyncronously (char** argv) {
+    return invokePipelineSyncronously(1, &argv, 0, 0);
+}
+
+int invokePipelineSyncronously (int n, char** argvs[], struct iovec* input, int inputs) {
+    invokeLoop loop = invokeLoopInit();
+
+    /*The output goes to the terminal, the loop only writes the input
+      and waits*/
+    invokeJob job = invokeJobInit(n, argvs, false, (alloc_t) {.malloc = 0});
+    job.input = input;
+    job.inputs = inputs;
+
+    invokeJobStart(&loop, &job);
+    invokeLoopNext(&loop, &job, 1);
+
+    int status = job.children[n-1] < 0 ? -1 : job.statuses[n-1];
+
+    invokeJobFree(&job);
+    invokeLoopFree(&loop);
+
+    return status;
+}
+
+char* invokePipelinePiped (int n, char** argvs[], struct iovec* input, int inputs, alloc_t alloc) {
+    return invokePipelinePipedStatus(n, argvs, input, inputs, alloc, 0);
+}
+
+char* invokePipelinePipedStatus (int n, char** argvs[], struct iovec* input, int inputs,
+                                 alloc_t alloc, int* status) {
+    invokeLoop loop = invokeLoopInit();
+
+    invokeJob job = invokeJobInit(n, argvs, true, alloc);
+    job.input = input;
+    job.inputs = inputs;
+
+    invokeJobStart(&loop, &job);
+    invokeLoopNext(&loop, &job, 1);
+    invokeJobReplayErrors(&job);
+
+    bool started = job.children[n-1] >= 0;
+
+    if (status)
+        *status = job.statuses[n-1];
+
+    char* output = started ? job.output.str : 0;
+
+    invokeJobFree(&job);
+    invokeLoopFree(&loop);
+
+    return output;
+}
+
+void invokeFanOut (int n, char** argvs[], int fanout, char** outputs, int* statuses, alloc_t alloc) {
+    invokeLoop loop = invokeLoopInit();
+
+    /*Seen by the collector, as the outputs may be GC allocated and are
+      only held here until the jobs finish*/
+    invokeJob* jobs = GC_MALLOC_UNCOLLECTABLE(sizeof(invokeJob) * n);
+    bool* done = calloc(n, sizeof(bool));
+
+    for (int i = 0; i < n; i++)
+        jobs[i] = invokeJobInit(1, &argvs[i], true, alloc);
+
+    int started = 0, replayed = 0;
+
+    for (; started < n && started < fanout; started++)
+        invokeJobStart(&loop, &jobs[started]);
+
+    for (invokeJob* job; (job = invokeLoopNext(&loop, jobs, started));) {
+        int i = job - jobs;
+        done[i] = true;
+
+        outputs[i] = job->children[0] >= 0 ? job->output.str : 0;
+        statuses[i] = job->statuses[0];
+
+        /*Errors in the same order as the output*/
+        for (; replayed < n && done[replayed]; replayed++)
+            invokeJobReplayErrors(&jobs[replayed]);
+
+        if (started < n && !cancelled())
+            invokeJobStart(&loop, &jobs[started++]);
+    }
+
+    /*Cancelled before they were started*/
+    for (int i = started; i < n; i++) {
+        outputs[i] = 0;
+        statuses[i] = -1;
+    }
+
+    for (int i = 0; i < n; i++)
+        invokeJobFree(&jobs[i]);
+
+    GC_FREE(jobs);
+    free(done);
+    invokeLoopFree(&loop);
+}
+
+/*==== Readers ====*/
+
+struct invokeReader {
+    int n;
+    pid_t* children;
+    /*The read end of the output of the last program, -1 once closed*/
+    int fd;
+    bool ended;
+};
+
+/*Children of closed readers that hadn't exited yet. They are reaped
+  later, so as not to hold up whoever closed it (maybe the collector).*/
+static struct {
+    pthread_mutex_t lock;
+    pid_t* children;
+    int length, capacity;
+} invokeUnreaped = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void invokeReap (pid_t child) {
+    pthread_mutex_lock(&invokeUnreaped.lock);
+
+    /*Any left from before*/
+    for (int i = 0; i < invokeUnreaped.length;) {
+        if (waitpid(invokeUnreaped.children[i], 0, WNOHANG) == 0)
+            i++;
 
         else
-            return -3;
-    }}
+            invokeUnreaped.children[i] = invokeUnreaped.children[--invokeUnreaped.length];
+    }
+
+    if (child >= 0 && waitpid(child, 0, WNOHANG) == 0) {
+        if (invokeUnreaped.length == invokeUnreaped.capacity) {
+            invokeUnreaped.capacity = 2*invokeUnreaped.capacity + 8;
+            invokeUnreaped.children = realloc(invokeUnreaped.children,
+                                              sizeof(pid_t) * invokeUnreaped.capacity);
+        }
+
+        invokeUnreaped.children[invokeUnreaped.length++] = child;
+    }
+
+    pthread_mutex_unlock(&invokeUnreaped.lock);
 }
 
-FILE* invokePiped (char** argv) {
-    int programPipe[2];
+invokeReader* invokePipelineReader (int n, char** argvs[]) {
+    int outputPipe[2];
 
-    if (pipe(programPipe) < 0) {
+    if (pipe2(outputPipe, O_CLOEXEC) < 0) {
         errprintf("Failed to create a pipe\n");
         return 0;
     }
 
-    const char* program = argv[0];
+    invokeReader* reader = malloc(sizeof(invokeReader));
+    *reader = (invokeReader) {
+        .n = n, .children = malloc(sizeof(pid_t) * n),
+        .fd = outputPipe[0]
+    };
 
-    //todo: how does fork deal with resources owned by the parent?
+    invokeStart(n, argvs, STDIN_FILENO, outputPipe[1], -1, reader->children);
+    close(outputPipe[1]);
 
-    switch (fork()) {
-    case -1:
-        errprintf("Failed to start a new process\n");
+    if (reader->children[n-1] < 0) {
+        invokeReaderClose(reader);
         return 0;
+    }
 
-    /*Child*/
-    case 0:
-        /*Use the pipe as stdout*/
-        fclose(stdout);
-        dup2(programPipe[1], STDIN_FILENO);
+    return reader;
+}
 
-        invoke(program, argv);
+ssize_t invokeReaderRead (invokeReader* reader, char* buffer, size_t size) {
+    if (reader->ended)
+        return 0;
 
-    /*Parent*/
-    default:
-        close(programPipe[1]);
-        return fdopen(programPipe[0], "r");
+    while (true) {
+        if (cancelled())
+            return -1;
+
+        struct pollfd output = {.fd = reader->fd, .events = POLLIN};
+
+        if (poll(&output, 1, invokeCancelPoll) <= 0)
+            continue;
+
+        ssize_t readsize = read(reader->fd, buffer, size);
+
+        if (readsize < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+
+        reader->ended = readsize <= 0;
+        return readsize < 0 ? 0 : readsize;
     }
 }
+
+void invokeReaderClose (invokeReader* reader) {
+    close(reader->fd);
+
+    for (int i = 0; i < reader->n; i++) {
+        pid_t child = reader->children[i];
+
+        if (child < 0)
+            continue;
+
+        /*Left unread: end it the way a closed pipe would, even a program
+          earlier on that isn't writing*/
+        if (!reader->ended)
+            kill(child, SIGPIPE);
+
+        invokeReap(child);
+    }
+
+    free(reader->children);
+    free(reader);
+}
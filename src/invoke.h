@@ -1,10 +1,54 @@
 #pragma once
 
 #include <stdio.h>
+#include <sys/uio.h>
 
-/*Invoke a program.
-   - Synchronously passes control to the program and waits for it to finish.
-   - Piped creates a pipe from the stdout of the program and returns it as a FILE.
-  argv contains the program name, the arguments, and finally a null-terminator.*/
-bool invokeSyncronously (char** argv);
-FILE* invokePiped (char** argv);
+#include <common.h>
+
+/*Invoke a program, passing control to it and waiting for it to finish.
+  argv contains the program name, the arguments, and finally a null-terminator.
+  Returns the exit status of the program, or a negative number if it
+  couldn't be started or didn't exit normally.*/
+int invokeSyncronously (char** argv);
+
+/*The space there is for the args of a program, in bytes, after that
+  taken by the environment. Each arg takes its length, plus one, plus
+  the size of a pointer.*/
+long invokeArgLimit (void);
+
+/*Invoke a pipeline of n programs, the stdout of each connected to the
+  stdin of the next by a pipe. They run concurrently. Synchronously
+  waits for them, as above, and returns the exit status of the last.
+  Piped reads the stdout of the last through a pipe and returns it,
+  allocated by alloc. Null if it couldn't be started.
+  If input is given, the buffers are written to the stdin of the first
+  (consuming the iovecs as it goes), otherwise it shares the shell's.*/
+int invokePipelineSyncronously (int n, char** argvs[], struct iovec* input, int inputs);
+char* invokePipelinePiped (int n, char** argvs[], struct iovec* input, int inputs, alloc_t alloc);
+
+/*Piped, also giving the exit status of the last program*/
+char* invokePipelinePipedStatus (int n, char** argvs[], struct iovec* input, int inputs,
+                                 alloc_t alloc, int* status_out);
+
+/*Invoke a pipeline, as above, to be read from bit by bit. Its errors
+  go straight to the terminal. Null if it couldn't be started.
+
+  Read gives the size read, zero at the end of the output, or -1 if
+  cancelled (it may be read again after). Closing it before the end
+  sends SIGPIPE to the programs, as if they had written to a closed
+  pipe, and the reader is freed either way.*/
+typedef struct invokeReader invokeReader;
+
+invokeReader* invokePipelineReader (int n, char** argvs[]);
+ssize_t invokeReaderRead (invokeReader* reader, char* buffer, size_t size);
+void invokeReaderClose (invokeReader* reader);
+
+/*Invoke n programs, as if piped, with at most fanout running at once.
+  Their outputs and exit statuses are written to the arrays given, the
+  output null for any that couldn't be started.
+
+  All the programs are serviced by one thread, as are those of any
+  pipeline. The stderr of a piped program is gathered and passed on
+  when it is done (in order, here), so that it doesn't interleave with
+  any others.*/
+void invokeFanOut (int n, char** argvs[], int fanout, char** outputs, int* statuses, alloc_t alloc);
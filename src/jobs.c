@@ -0,0 +1,191 @@
+/*The collector must know of any threads that hold GC references*/
+#define GC_THREADS
+/*For clock_gettime*/
+#define _XOPEN_SOURCE 700
+
+#include "jobs.h"
+
+#include <time.h>
+#include <pthread.h>
+#include <gc.h>
+#include <vector.h>
+
+#include "common.h"
+#include "dirctx.h"
+#include "sym.h"
+#include "ast.h"
+#include "value.h"
+#include "serialize.h"
+#include "terminal.h"
+
+typedef struct job {
+    int id;
+    char* str;
+    ast* tree;
+    bool display;
+
+    envCtx env;
+    /*Its own, so that the command hash isn't shared between threads*/
+    dirCtx dirs;
+
+    /*The value of a let, given to its variable before it's done*/
+    value* future;
+    value* result;
+
+    /*Ctrl-C is for the foreground, not this*/
+    cancelToken cancel;
+
+    double started, elapsed;
+} job;
+
+static struct {
+    pthread_mutex_t lock;
+    /*Signalled whenever a job finishes*/
+    pthread_cond_t done;
+    int lastId;
+    /*Jobs are allocated uncollectable, so they keep their values alive*/
+    vector(job*) running;
+    vector(job*) finished;
+} jobs = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .lastId = 0
+};
+
+static double jobsNow (void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void* jobRun (job* j) {
+    threadCancelToken = &j->cancel;
+
+    const ast* expr = j->tree->kind == astLet ? j->tree->r : j->tree;
+    value* result = run(&j->env, expr);
+
+    if (j->future)
+        valueFutureResolve(j->future, result);
+
+    pthread_mutex_lock(&jobs.lock);
+
+    j->result = result;
+    j->elapsed = jobsNow() - j->started;
+
+    vectorRemoveReorder(&jobs.running, vectorFind(jobs.running, j));
+    vectorPush(&jobs.finished, j);
+
+    pthread_cond_broadcast(&jobs.done);
+    pthread_mutex_unlock(&jobs.lock);
+
+    return 0;
+}
+
+void jobsStart (envCtx env, ast* tree, const char* str, bool display) {
+    job* j = GC_MALLOC_UNCOLLECTABLE(sizeof(job));
+
+    *j = (job) {
+        .str = strdup(str),
+        .tree = tree,
+        .display = display,
+        .dirs = *env.dirs,
+        .started = jobsNow()
+    };
+
+    j->dirs.commandsBuilt = false;
+    j->env = env;
+    j->env.dirs = &j->dirs;
+
+    if (tree->kind == astLet) {
+        j->future = valueCreateFuture();
+        tree->symbol->val = j->future;
+    }
+
+    pthread_mutex_lock(&jobs.lock);
+
+    if (vectorNull(jobs.running)) {
+        jobs.running = vectorInit(4, malloc);
+        jobs.finished = vectorInit(4, malloc);
+    }
+
+    j->id = ++jobs.lastId;
+    vectorPush(&jobs.running, j);
+
+    pthread_mutex_unlock(&jobs.lock);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    if (pthread_create(&thread, &attr, (void* (*)(void*)) jobRun, j)) {
+        errprintf("Failed to start a thread for a job, running it now\n");
+        jobRun(j);
+        threadCancelToken = &terminalInterrupts;
+    }
+
+    pthread_attr_destroy(&attr);
+
+    if (display)
+        printf("[%d] %s\n", j->id, j->str);
+}
+
+bool jobsFinished (void) {
+    pthread_mutex_lock(&jobs.lock);
+    bool finished = !vectorNull(jobs.finished) && jobs.finished.length != 0;
+    pthread_mutex_unlock(&jobs.lock);
+
+    return finished;
+}
+
+void jobsReport (void) {
+    pthread_mutex_lock(&jobs.lock);
+
+    vector(job*) finished = jobs.finished;
+    jobs.finished = vectorInit(4, malloc);
+
+    pthread_mutex_unlock(&jobs.lock);
+
+    if (vectorNull(finished))
+        return;
+
+    for_vector (job* j, finished, {
+        if (j->display) {
+            printf("[%d] done (%.1fs) %s\n", j->id, j->elapsed, j->str);
+
+            /*A let has already bound its value, there's nothing to show*/
+            if (j->tree->kind != astLet)
+                outputResult(j->result, j->tree->dt);
+        }
+
+        dirsFree(&j->dirs);
+        astDestroy(j->tree);
+        free(j->str);
+        GC_FREE(j);
+    })
+
+    vectorFree(&finished);
+}
+
+void jobsWait (void) {
+    pthread_mutex_lock(&jobs.lock);
+
+    while (!vectorNull(jobs.running) && jobs.running.length != 0)
+        pthread_cond_wait(&jobs.done, &jobs.lock);
+
+    pthread_mutex_unlock(&jobs.lock);
+}
+
+void jobsList (void) {
+    pthread_mutex_lock(&jobs.lock);
+
+    if (!vectorNull(jobs.running)) {
+        double now = jobsNow();
+
+        for_vector (job* j, jobs.running, {
+            printf("[%d] running (%.1fs) %s\n", j->id, now - j->started, j->str);
+        })
+    }
+
+    pthread_mutex_unlock(&jobs.lock);
+}
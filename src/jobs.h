@@ -0,0 +1,23 @@
+#pragma once
+
+#include "forward.h"
+#include "runner.h"
+
+/*Run a statement in the background, on its own thread. If it's a let,
+  the variable is bound straight away to a future of the result, which
+  is waited for by anything that reads it.
+  Takes ownership of the (optimized) tree, and copies the string.*/
+void jobsStart (envCtx env, ast* tree, const char* str, bool display);
+
+/*Whether any jobs have finished that haven't yet been reported*/
+bool jobsFinished (void);
+
+/*Display the results of the jobs that have finished since the last
+  report (for those asked to display them), and forget them.*/
+void jobsReport (void);
+
+/*Block until every job has finished*/
+void jobsWait (void);
+
+/*List the jobs still running, with how long they've been going*/
+void jobsList (void);
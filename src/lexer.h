@@ -87,6 +87,24 @@ inline static void lexerEat (lexerCtx* ctx) {
 
 /*---- ----*/
 
+/*A colon followed by whitespace ends a word, as in "[x: y]", unless
+  the word is made only of symbols, as "|:" and "::" are*/
+inline static bool lexerColonEnds (lexerCtx* ctx) {
+    if (lexerCurrent(ctx) != ':')
+        return false;
+
+    char next = ctx->input[ctx->pos+1];
+
+    if (next && !isspace(next))
+        return false;
+
+    for (int i = 0; i < ctx->length; i++)
+        if (!ispunct(ctx->buffer[i]))
+            return true;
+
+    return false;
+}
+
 inline static tokenKind lexerCharOrStr (lexerCtx* ctx) {
     char quote = lexerCurrent(ctx);
     lexerSkip(ctx);
@@ -122,7 +140,7 @@ inline static tokenKind lexerWord (lexerCtx* ctx) {
         return tokenIntLit;
     }
 
-    if (lexerEOF(ctx))
+    if (lexerEOF(ctx) || (ctx->length && lexerColonEnds(ctx)))
         return tokenIntLit;
 
     /*Words can contain matching brackets and braces,
@@ -171,6 +189,10 @@ inline static tokenKind lexerWord (lexerCtx* ctx) {
         case '\n': case '\r':
         case '\t': case ' ':
             exit = true;
+
+        break;
+        case ':':
+            exit = lexerColonEnds(ctx);
         }
     } while (!exit && !lexerEOF(ctx));
 
@@ -186,6 +208,7 @@ inline static token lexerNext (lexerCtx* ctx) {
         return tokenMakeEOF();
 
     ctx->length = 0;
+    int start = ctx->pos;
 
     token tok = {
         .kind = tokenNormal,
@@ -199,6 +222,18 @@ inline static token lexerNext (lexerCtx* ctx) {
 
     break;
 
+    /*Regex literal, r"..."*/
+    case 'r':
+        if (ctx->input[ctx->pos+1] == '"') {
+            lexerSkip(ctx);
+            lexerCharOrStr(ctx);
+            tok.kind = tokenRegexLit;
+
+        } else
+            tok.kind = lexerWord(ctx);
+
+    break;
+
     /*"Word"*/
     default:
         tok.kind = lexerWord(ctx);
@@ -217,6 +252,11 @@ inline static token lexerNext (lexerCtx* ctx) {
 
     ctx->buffer[ctx->length++] = 0;
 
+    /*A lone * in brackets, "(*)", is the operator rather than a glob*/
+    if (   tok.kind == tokenNormal && !strcmp(tok.buffer, "*")
+        && start > 0 && ctx->input[start-1] == '(' && lexerCurrent(ctx) == ')')
+        tok.kind = tokenOp;
+
     /*Reassign the kind if the buffer matches an operator or keyword*/
     if (tok.kind == tokenNormal) {
         tokenKind newkind = (tokenKind) hashmapMap(&lexerKeywords, tok.buffer);
@@ -235,13 +275,13 @@ static inline void lexerKeywordsInit (void) {
     lexerKeywords = hashmapInit(1024, calloc);
 
     static const char* ops[] = {
-        "|", "|:", "|>", "&&", "||",
+        "|", "|:", "|?", "|/", "|>", "|+>", "&", "&&", "||",
         "==", "!=", "<", "<=", ">", ">=",
         /* * would override globs (todo)*/
         /* - would override the root (todo)*/
         "+", "++",
         "/", "%",
-        "->", "::"
+        "->", "::", ":"
     };
 
     static const char* kws[] = {
@@ -0,0 +1,446 @@
+#include "optimizer.h"
+
+#include <vector.h>
+
+#include "common.h"
+#include "type.h"
+#include "sym.h"
+#include "ast.h"
+#include "value.h"
+
+enum {
+    /*The largest lambda body, in nodes, that will be inlined*/
+    inlineMaxNodes = 24,
+    /*Inlined bodies are optimized again, which may inline more*/
+    inlineMaxDepth = 8
+};
+
+typedef struct optimizerCtx {
+    /*The lambdas enclosing the current node, innermost last*/
+    vector(ast*) fns;
+    int inlineDepth;
+} optimizerCtx;
+
+static void optimizer (optimizerCtx* ctx, ast* node);
+
+/*==== Internals ====*/
+
+static bool isLit (const ast* node) {
+    switch (node->kind) {
+    case astUnitLit:
+    case astIntLit:
+    case astFloatLit:
+    case astBoolLit:
+    case astStrLit:
+    case astRegexLit:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/*The scope of a lambda, which its args (and anything defined inside
+  it) belong to. Null if it has no args to find it by.*/
+static sym* fnScope (const ast* fn) {
+    ast* arg = vectorGet(fn->children, 0);
+    return arg && arg->symbol ? arg->symbol->parent : 0;
+}
+
+/*Replace a node, keeping its type*/
+static void replaceTyped (ast* node, ast* replacement) {
+    type* dt = node->dt;
+    astReplace(node, replacement);
+    node->dt = dt;
+}
+
+/*Gather the direct subexpressions of a node (not through lambdas)
+  into an array of at least astChildrenMax(node)*/
+static int astChildren (ast* node, ast** children) {
+    int n = 0;
+
+    if (node->l)
+        children[n++] = node->l;
+
+    if (node->r)
+        children[n++] = node->r;
+
+    for_vector (ast* child, node->children, {
+        children[n++] = child;
+    })
+
+    return n;
+}
+
+static int astChildrenMax (const ast* node) {
+    return node->children.length + 2;
+}
+
+/*Counts the nodes of a tree, or returns -1 if it contains a lambda*/
+static int astCountNoFns (const ast* node) {
+    if (node->kind == astFnLit)
+        return -1;
+
+    ast* children[astChildrenMax(node)];
+    int n = astChildren((ast*) node, children);
+    int count = 1;
+
+    for (int i = 0; i < n; i++) {
+        int childCount = astCountNoFns(children[i]);
+
+        if (childCount < 0)
+            return -1;
+
+        count += childCount;
+    }
+
+    return count;
+}
+
+/*==== Constants ====*/
+
+/*A variable bound by an earlier `let` to a simple value becomes a literal*/
+static void propagateConstant (ast* node) {
+    sym* symbol = node->symbol;
+
+    /*Only `let` bound (and builtin) symbols have a global value.
+      Don't wait for those still being computed in the background.*/
+    if (   !symbol || !symbol->val
+        || valueIsInvalid(symbol->val) || valueIsFuture(symbol->val))
+        return;
+
+    if (typeIsKind(type_Int, symbol->dt))
+        replaceTyped(node, astCreateIntLit(valueGetInt(symbol->val)));
+
+    else if (typeIsKind(type_Bool, symbol->dt))
+        replaceTyped(node, astCreateBoolLit(valueGetInt(symbol->val)));
+}
+
+static void foldArithmetic (ast* node) {
+    if (node->l->kind != astIntLit || node->r->kind != astIntLit)
+        return;
+
+    /*Same width as the runner uses*/
+    int l = node->l->literal.integer,
+        r = node->r->literal.integer;
+
+    int result;
+
+    switch (node->op) {
+    case opAdd: result = l + r; break;
+    case opSubtract: result = l - r; break;
+    case opMultiply: result = l * r; break;
+
+    /*Left for the runner, for the error*/
+    case opDivide:
+    case opModulo:
+        if (r == 0)
+            return;
+
+        result = node->op == opDivide ? l / r : l % r;
+        break;
+
+    default:
+        return;
+    }
+
+    replaceTyped(node, astCreateIntLit(result));
+}
+
+static void foldConcat (ast* node) {
+    ast *l = node->l, *r = node->r;
+
+    if (l->kind != astListLit || r->kind != astListLit)
+        return;
+
+    vector(ast*) elements = vectorInit(l->children.length + r->children.length, malloc);
+    vectorPushFromVector(&elements, l->children);
+    vectorPushFromVector(&elements, r->children);
+
+    /*The elements have moved, don't destroy them*/
+    l->children.length = r->children.length = 0;
+
+    replaceTyped(node, astCreateListLit(elements));
+}
+
+/*==== Inlining ====*/
+
+static void substituteArgs (ast* node, vector(sym*) params, vector(ast*) args) {
+    if (node->kind == astSymbol) {
+        int index = vectorFind(params, node->symbol);
+
+        if (index != -1)
+            astReplace(node, astDup(vectorGet(args, index), malloc));
+
+        return;
+    }
+
+    ast* children[astChildrenMax(node)];
+    int n = astChildren(node, children);
+
+    for (int i = 0; i < n; i++)
+        substituteArgs(children[i], params, args);
+}
+
+/*The symbols used by inlined code must be captured by the lambdas it
+  has been inlined into, as the parser would have done*/
+static void captureSymbols (optimizerCtx* ctx, ast* node) {
+    if (node->kind == astSymbol && node->symbol) {
+        bool capturing = false;
+
+        for_vector (ast* fn, ctx->fns, {
+            if (capturing || !symIsInside(node->symbol, fnScope(fn))) {
+                capturing = true;
+
+                if (vectorFind(*fn->captured, node->symbol) == -1)
+                    vectorPush(fn->captured, node->symbol);
+            }
+        })
+    }
+
+    ast* children[astChildrenMax(node)];
+    int n = astChildren(node, children);
+
+    for (int i = 0; i < n; i++)
+        captureSymbols(ctx, children[i]);
+}
+
+/*Inline a call of a small lambda bound by an earlier `let`, given only
+  literals and variables (so nothing is evaluated more than it was).
+  Returns whether it did.*/
+static bool inlineCall (optimizerCtx* ctx, ast* node) {
+    if (   (node->flags & flagUnixInvocation)
+        || node->r->kind != astSymbol
+        || !node->r->symbol
+        || !node->r->symbol->val)
+        return false;
+
+    /*Captures can't be added to a lambda without a scope*/
+    for_vector (ast* fn, ctx->fns, {
+        if (!fnScope(fn))
+            return false;
+    })
+
+    vector(sym*) params;
+    const ast* body;
+
+    if (   !valueGetASTClosure(node->r->symbol->val, &params, &body)
+        || params.length != node->children.length)
+        return false;
+
+    int size = astCountNoFns(body);
+
+    if (size < 0 || size > inlineMaxNodes)
+        return false;
+
+    for_vector (ast* arg, node->children, {
+        if (!isLit(arg) && arg->kind != astSymbol)
+            return false;
+    })
+
+    ast* inlined = astDup(body, malloc);
+    substituteArgs(inlined, params, node->children);
+
+    replaceTyped(node, inlined);
+    captureSymbols(ctx, node);
+
+    return true;
+}
+
+/*==== Hoisting ====*/
+
+typedef struct hoistCtx {
+    ast* fn;
+    sym* scope;
+} hoistCtx;
+
+static bool isHoistable (const ast* node) {
+    switch (node->kind) {
+    case astBOP:
+    case astFnApp:
+    case astListLit:
+    case astTupleLit:
+    case astDictLit:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/*Move a subexpression into a `let` run when the closure first needs it,
+  leaving a reference to it in its place*/
+static void hoistNode (hoistCtx* ctx, ast* node) {
+    sym* symbol = symAdd(ctx->scope, "<hoisted>");
+    symbol->dt = node->dt;
+
+    ast* init = malloci(sizeof(ast), node);
+    ast* ref = astCreateSymbol(symbol);
+    ref->dt = node->dt;
+
+    *node = *ref;
+    free(ref);
+
+    if (!ctx->fn->hoisted) {
+        ctx->fn->hoisted = malloc(sizeof(vector));
+        *ctx->fn->hoisted = vectorInit(4, malloc);
+    }
+
+    vectorPush(ctx->fn->hoisted, astCreateLet(symbol, init));
+}
+
+/*Returns whether a subexpression doesn't depend on the args of the
+  lambda (nor have effects). If it does, then any of its subexpressions
+  that don't are hoisted.*/
+static bool hoistInvariants (hoistCtx* ctx, ast* node) {
+    bool invariant;
+
+    switch (node->kind) {
+    case astSymbol:
+        return    node->symbol && !node->symbol->effects
+               && !symIsInside(node->symbol, ctx->scope);
+
+    /*Not looked inside*/
+    case astFnLit:
+        return false;
+
+    case astFnApp:
+        invariant = !(node->flags & flagUnixInvocation);
+        break;
+
+    case astBOP:
+        /*The right side is only run depending on the left, so nothing
+          is hoisted out of it (nor the whole) to be run regardless*/
+        if (node->op == opLogicalAnd || node->op == opLogicalOr) {
+            if (hoistInvariants(ctx, node->l) && isHoistable(node->l))
+                hoistNode(ctx, node->l);
+
+            return false;
+        }
+
+        /*Writes to a file each time*/
+        invariant = node->op != opWrite && node->op != opAppend;
+        break;
+
+    default:
+        invariant = true;
+    }
+
+    ast* children[astChildrenMax(node)];
+    bool childInvariant[astChildrenMax(node)];
+    int n = astChildren(node, children);
+
+    for (int i = 0; i < n; i++) {
+        childInvariant[i] = hoistInvariants(ctx, children[i]);
+        invariant &= childInvariant[i];
+    }
+
+    if (!invariant) {
+        for (int i = 0; i < n; i++) {
+            if (childInvariant[i] && isHoistable(children[i]))
+                hoistNode(ctx, children[i]);
+        }
+    }
+
+    return invariant;
+}
+
+static void hoistFromMapped (ast* fn) {
+    hoistCtx ctx = {
+        .fn = fn,
+        .scope = fnScope(fn)
+    };
+
+    if (!ctx.scope)
+        return;
+
+    if (hoistInvariants(&ctx, fn->r) && isHoistable(fn->r))
+        hoistNode(&ctx, fn->r);
+}
+
+/*==== ====*/
+
+static void optimizeBOP (ast* node) {
+    switch (node->op) {
+    case opAdd:
+    case opSubtract:
+    case opMultiply:
+    case opDivide:
+    case opModulo:
+        foldArithmetic(node);
+        break;
+
+    case opConcat:
+        foldConcat(node);
+        break;
+
+    /*The lambda is called for every element, hoist what it can*/
+    case opPipe:
+    case opPipeZip:
+    case opFilter:
+    case opReduce: {
+        bool mapped =    (node->flags & flagListApplication)
+                      || node->op == opFilter || node->op == opReduce;
+
+        if (mapped && node->r->kind == astFnLit)
+            hoistFromMapped(node->r);
+
+        break;
+    }
+
+    default:
+        ;
+    }
+}
+
+static void optimizer (optimizerCtx* ctx, ast* node) {
+    /*Optimize the subexpressions first*/
+
+    if (node->kind == astFnLit) {
+        vectorPush(&ctx->fns, node);
+        optimizer(ctx, node->r);
+        vectorPop(&ctx->fns);
+        return;
+    }
+
+    ast* children[astChildrenMax(node)];
+    int n = astChildren(node, children);
+
+    for (int i = 0; i < n; i++)
+        optimizer(ctx, children[i]);
+
+    switch (node->kind) {
+    case astSymbol:
+        propagateConstant(node);
+        break;
+
+    case astBOP:
+        optimizeBOP(node);
+        break;
+
+    case astFnApp:
+        if (ctx->inlineDepth < inlineMaxDepth && inlineCall(ctx, node)) {
+            ctx->inlineDepth++;
+            optimizer(ctx, node);
+            ctx->inlineDepth--;
+        }
+
+        break;
+
+    default:
+        ;
+    }
+}
+
+/*==== ====*/
+
+void optimize (ast* tree) {
+    optimizerCtx ctx = {
+        .fns = vectorInit(4, malloc),
+        .inlineDepth = 0
+    };
+
+    optimizer(&ctx, tree);
+
+    vectorFree(&ctx.fns);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "forward.h"
+
+/*Rewrite a typed AST into an equivalent one that is cheaper to run.
+    - Arithmetic and concatenation of literals are folded.
+    - Variables bound to simple values by earlier `let`s are replaced
+      with literals.
+    - Calls of small lambdas bound by earlier `let`s are inlined.
+    - Subexpressions of a lambda that is mapped over a list, which don't
+      depend on its args, are hoisted out to be run only once, when
+      first needed. Not out of conditionally run operands.*/
+void optimize (ast* tree);
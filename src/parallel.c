@@ -0,0 +1,96 @@
+/*The collector must know of any threads that hold GC references*/
+#define GC_THREADS
+/*For sysconf*/
+#define _XOPEN_SOURCE 700
+
+#include "parallel.h"
+
+#include <unistd.h>
+#include <pthread.h>
+#include <gc.h>
+#include <common.h>
+
+#include "terminal.h"
+
+enum {
+    parallelMaxThreads = 64
+};
+
+int parallelThreads (void) {
+    static int threads = 0;
+
+    if (!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads =   online < 1 ? 1
+                  : online > parallelMaxThreads ? parallelMaxThreads : online;
+    }
+
+    return threads;
+}
+
+typedef struct parallelCtx {
+    parallelBody body;
+    void* ctx;
+
+    int n, chunkSize;
+    /*The next chunk to be claimed by a thread*/
+    _Atomic int nextChunk;
+
+    /*That of the thread which asked for the work*/
+    cancelToken* cancel;
+} parallelCtx;
+
+/*Claim chunks until there are none left*/
+static void* parallelWorker (parallelCtx* work) {
+    threadCancelToken = work->cancel;
+
+    while (true) {
+        int start = work->nextChunk++ * work->chunkSize;
+
+        if (start >= work->n)
+            break;
+
+        int end = start + work->chunkSize;
+        work->body(work->ctx, start, end > work->n ? work->n : end);
+    }
+
+    return 0;
+}
+
+void parallelFor (int n, int chunkSize, parallelBody body, void* ctx) {
+    if (!precond(chunkSize > 0) || n <= 0)
+        return;
+
+    int chunks = intdiv_roundup(n, chunkSize);
+    int threads = chunks < parallelThreads() ? chunks : parallelThreads();
+
+    /*Still a chunk at a time, as the body may depend on the chunking*/
+    if (threads <= 1) {
+        for (int start = 0; start < n; start += chunkSize)
+            body(ctx, start, start+chunkSize > n ? n : start+chunkSize);
+
+        return;
+    }
+
+    parallelCtx work = {
+        .body = body, .ctx = ctx,
+        .n = n, .chunkSize = chunkSize,
+        .nextChunk = 0,
+        .cancel = threadCancelToken
+    };
+
+    /*This thread works too, so one fewer is started*/
+    pthread_t workers[threads-1];
+    int started = 0;
+
+    for (; started < threads-1; started++) {
+        if (pthread_create(&workers[started], 0, (void* (*)(void*)) parallelWorker, &work))
+            /*Fewer threads then, the work still gets done*/
+            break;
+    }
+
+    parallelWorker(&work);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], 0);
+}
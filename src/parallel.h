@@ -0,0 +1,17 @@
+#pragma once
+
+#include "common.h"
+
+/*Called on a contiguous range of indices, [start, end)*/
+typedef void (*parallelBody)(void* ctx, int start, int end);
+
+/*The number of threads parallel work is spread across*/
+int parallelThreads (void);
+
+/*Divide the indices [0, n) into chunks of (at most) chunkSize and run
+  the body on each of them, spread across threads. Returns once all are
+  done. If there's only one chunk, it is run on the calling thread.
+
+  The body may allocate GC objects, the threads are registered with
+  the collector.*/
+void parallelFor (int n, int chunkSize, parallelBody body, void* ctx);
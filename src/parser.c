@@ -4,15 +4,19 @@
 #include <string.h>
 
 #include "paths.h"
+#include "regex.h"
 
 #include "sym.h"
 #include "ast.h"
 #include "type.h"
 
 static ast* parseExpr (parserCtx* ctx);
+static ast* parseTypeHint (parserCtx* ctx, ast* node);
+static ast* parseBOP (parserCtx* ctx, int level);
+static ast* parseBOPRest (parserCtx* ctx, int level, ast* node);
 
 /**
- * Type = (   Int | File | ( "[" Type "]" )
+ * Type = (   Int | Bool | Str | File | Regex | ( "[" Type [ ":" Type ] "]" )
  *          | ( "(" Type [{ "," Type }] ")" ) )
  *        [ "->" Type ]
  *
@@ -28,12 +32,28 @@ static type* parseType (parserCtx* ctx, bool allowFns) {
     if (try_match(ctx, "Int"))
         dt = typeUnitary(ctx->ts, type_Int);
 
+    else if (try_match(ctx, "Bool"))
+        dt = typeUnitary(ctx->ts, type_Bool);
+
+    else if (try_match(ctx, "Str"))
+        dt = typeUnitary(ctx->ts, type_Str);
+
     else if (try_match(ctx, "File"))
         dt = typeUnitary(ctx->ts, type_File);
 
-    /*List*/
+    else if (try_match(ctx, "Regex"))
+        dt = typeUnitary(ctx->ts, type_Regex);
+
+    /*List or Dict*/
     else if (try_match(ctx, "[")) {
-        dt = typeList(ctx->ts, parseType(ctx, true));
+        dt = parseType(ctx, true);
+
+        if (try_match(ctx, ":"))
+            dt = typeDict(ctx->ts, dt, parseType(ctx, true));
+
+        else
+            dt = typeList(ctx->ts, dt);
+
         match(ctx, "]");
 
     } else if (try_match(ctx, "(")) {
@@ -202,18 +222,28 @@ static bool isPathToken (const char* str) {
 }
 
 /**
- * Atom =   ( "(" [ Expr [{ "," Expr }] ] ")" )
- *        | ( "[" [{ Expr }] "]" )
- *        | FnLit | Path | <Str> | Symbol
+ * Atom =   ( "(" [ Expr [{ "," Expr }] | <Op> ] ")" )
+ *        | ( "[" [ Expr [{ "," Expr }] ] "]" )
+ *        | ( "[" ( ":" | ( Key ":" Expr [{ "," Key ":" Expr }] ) ) "]" )
+ *        | FnLit | Path | <Str> | <Regex> | Symbol
  */
 static ast* parseAtom (parserCtx* ctx) {
     ast* node;
 
+    sym* symbol;
+
     if (try_match(ctx, "(")) {
         /*Empty brackets => unit literal*/
         if (see(ctx, ")"))
             node = astCreateUnitLit();
 
+        /*Bracketed operator, a reference to the function of that name*/
+        else if (   see_kind(ctx, tokenOp)
+                 && (symbol = symLookup(ctx->global, ctx->current.buffer))) {
+            node = parseSymbol(ctx, symbol);
+            accept(ctx);
+        }
+
         else {
             node = parseExpr(ctx);
 
@@ -231,15 +261,43 @@ static ast* parseAtom (parserCtx* ctx) {
 
         match(ctx, ")");
 
-    /*List literal*/
+    /*List or dict literal*/
     } else if (try_match(ctx, "[")) {
         vector(ast*) nodes = vectorInit(4, malloc);
 
-        if (waiting_for(ctx, "]")) do {
-            vectorPush(&nodes, parseExpr(ctx));
-        } while (try_match(ctx, ","));
+        /*Empty dict*/
+        if (try_match(ctx, ":"))
+            node = astCreateDictLit(nodes);
+
+        else if (!waiting_for(ctx, "]"))
+            node = astCreateListLit(nodes);
 
-        node = astCreateListLit(nodes);
+        else {
+            /*Keys bind tighter than the pipe level, so the first
+              element can be parsed until a ":" says it is a key*/
+            ast* first = parseBOP(ctx, 1);
+
+            if (try_match(ctx, ":")) {
+                vectorPush(&nodes, first);
+                vectorPush(&nodes, parseExpr(ctx));
+
+                while (try_match(ctx, ",")) {
+                    vectorPush(&nodes, parseBOP(ctx, 1));
+                    match(ctx, ":");
+                    vectorPush(&nodes, parseExpr(ctx));
+                }
+
+                node = astCreateDictLit(nodes);
+
+            } else {
+                vectorPush(&nodes, parseTypeHint(ctx, parseBOPRest(ctx, 0, first)));
+
+                while (try_match(ctx, ","))
+                    vectorPush(&nodes, parseExpr(ctx));
+
+                node = astCreateListLit(nodes);
+            }
+        }
 
         match(ctx, "]");
 
@@ -258,9 +316,22 @@ static ast* parseAtom (parserCtx* ctx) {
         node = astCreateStrLit(ctx->current.buffer);
         accept(ctx);
 
-    } else if (see_kind(ctx, tokenNormal)) {
-        sym* symbol;
+    } else if (see_kind(ctx, tokenRegexLit)) {
+        char* message;
+        regex* re = regexCompile(ctx->current.buffer, &message);
+
+        if (re)
+            node = astCreateRegexLit(re);
+
+        else {
+            error(ctx)("%s, in r\"%s\"\n", message, ctx->current.buffer);
+            free(message);
+            node = astCreateInvalid();
+        }
+
+        accept(ctx);
 
+    } else if (see_kind(ctx, tokenNormal)) {
         if (isPathToken(ctx->current.buffer))
             node = parsePath(ctx);
 
@@ -342,7 +413,7 @@ static ast* parseFnApp (parserCtx* ctx) {
 
 /**
  * BOP = Pipe
- * Pipe    = Logical  [{ "|" | "|>" Logical }]
+ * Pipe    = Logical  [{ "|" | "|:" | "|?" | "|/" | "|>" | "|+>" | ":" Logical }]
  * Logical = Equality [{ "&&" | "||" Equality }]
  * Equality = Sum     [{ "==" | "!=" | "<" | "<=" | ">" | ">=" Sum }]
  * Sum     = Product  [{ "+" | "-" | "++" Product }]
@@ -366,7 +437,11 @@ static ast* parseBOP (parserCtx* ctx, int level) {
         return parseFnApp(ctx);
 
     /* (2) The left hand side is the production one level up*/
-    ast* node = parseBOP(ctx, level+1);
+    return parseBOPRest(ctx, level, parseBOP(ctx, level+1));
+}
+
+/*The operators of a level following a left hand side already parsed*/
+static ast* parseBOPRest (parserCtx* ctx, int level, ast* node) {
     opKind op;
 
     /* (3) Accept operators associated with this level, and store
@@ -374,7 +449,11 @@ static ast* parseBOP (parserCtx* ctx, int level) {
     while (  level == 0
              ? (op =   try_match(ctx, "|") ? opPipe
                      : try_match(ctx, "|:") ? opPipeZip
-                     : try_match(ctx, "|>") ? opWrite : opNull)
+                     : try_match(ctx, "|?") ? opFilter
+                     : try_match(ctx, "|/") ? opReduce
+                     : try_match(ctx, "|>") ? opWrite
+                     : try_match(ctx, "|+>") ? opAppend
+                     : try_match(ctx, ":") ? opLookup : opNull)
            : level == 1
              ? (op =   try_match(ctx, "&&") ? opLogicalAnd
                      : try_match(ctx, "||") ? opLogicalOr : opNull)
@@ -402,8 +481,21 @@ static ast* parseBOP (parserCtx* ctx, int level) {
     return node;
 }
 
+/**
+ * Expr = BOP [ "::" Type ]
+ *
+ * The type hint gives the type expected of the expression. Rows of
+ * strings can be given the type of a table, which converts them.
+ */
 static ast* parseExpr (parserCtx* ctx) {
-    return parseBOP(ctx, 0);
+    return parseTypeHint(ctx, parseBOP(ctx, 0));
+}
+
+static ast* parseTypeHint (parserCtx* ctx, ast* node) {
+    if (try_match(ctx, "::"))
+        node = astCreateTypeHint(node, parseType(ctx, true));
+
+    return node;
 }
 
 /**
@@ -430,14 +522,23 @@ static ast* parseLet (parserCtx* ctx) {
 }
 
 /**
- * Statement = Let | Expr
+ * Statement = ( Let | Expr ) [ "&" ]
+ *
+ * A trailing & runs the statement in the background.
  */
 static ast* parseStatement (parserCtx* ctx) {
+    ast* node;
+
     if (see(ctx, "let"))
-        return parseLet(ctx);
+        node = parseLet(ctx);
 
     else
-        return parseExpr(ctx);
+        node = parseExpr(ctx);
+
+    if (try_match(ctx, "&"))
+        node->flags |= flagBackground;
+
+    return node;
 }
 
 static ast* parseS (parserCtx* ctx) {
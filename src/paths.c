@@ -9,6 +9,7 @@
 #include <errno.h>
 
 #include <limits.h>
+#include <sys/stat.h>
 #include <nicestat.h>
 
 #include "common.h"
@@ -33,6 +34,15 @@ bool pathIsDir (const char* path) {
     return !error && file.mode == file_dir;
 }
 
+int64_t pathGetMTime (const char* path) {
+    struct stat file;
+
+    if (stat(path, &file))
+        return 0;
+
+    return (int64_t) file.st_mtim.tv_sec*1000000000 + file.st_mtim.tv_nsec;
+}
+
 char* getWorkingDir (alloc_t alloc) {
     int buffer_size = 256;
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <errno.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #include <common.h>
@@ -11,6 +12,10 @@ char* pathGetAbsolute (const char* path, malloc_t malloc);
 /*Stats the path to see if it's a directory. Returns false for non-files.*/
 bool pathIsDir (const char* path);
 
+/*The time a file was last modified, in nanoseconds since the epoch.
+  Zero if it couldn't be stat'd.*/
+int64_t pathGetMTime (const char* path);
+
 /*Get the current working directory.
   Fails if there are permission issues.*/
 char* getWorkingDir (alloc_t alloc);
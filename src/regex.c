@@ -0,0 +1,1046 @@
+/*For memmem, memrchr and vasprintf*/
+#define _GNU_SOURCE
+
+#include "regex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <hashmap.h>
+
+#include "common.h"
+
+enum {
+    regexMaxInsts = 16*1024,
+    /*Each state has a table of 256 transitions, so this is about 2MB*/
+    regexMaxStates = 1024,
+    regexMaxRepeat = 1000
+};
+
+/*==== Byte sets ====*/
+
+typedef struct byteSet {
+    uint64_t bits[4];
+} byteSet;
+
+static bool byteSetHas (const byteSet* set, unsigned char c) {
+    return set->bits[c >> 6] >> (c & 63) & 1;
+}
+
+static void byteSetAdd (byteSet* set, unsigned char c) {
+    set->bits[c >> 6] |= (uint64_t) 1 << (c & 63);
+}
+
+static void byteSetAddRange (byteSet* set, unsigned char from, unsigned char to) {
+    for (int c = from; c <= to; c++)
+        byteSetAdd(set, c);
+}
+
+static void byteSetUnion (byteSet* set, const byteSet* with) {
+    for (int i = 0; i < 4; i++)
+        set->bits[i] |= with->bits[i];
+}
+
+static void byteSetInvert (byteSet* set) {
+    for (int i = 0; i < 4; i++)
+        set->bits[i] = ~set->bits[i];
+}
+
+/*The only byte in the set, or -1 if there isn't exactly one*/
+static int byteSetOnly (const byteSet* set) {
+    int count = 0, only = -1;
+
+    for (int i = 0; i < 4; i++) {
+        count += __builtin_popcountll(set->bits[i]);
+
+        if (set->bits[i])
+            only = 64*i + __builtin_ctzll(set->bits[i]);
+    }
+
+    return count == 1 ? only : -1;
+}
+
+/*==== Parsing ====*/
+
+typedef enum nodeKind {
+    nodeSet, nodeConcat, nodeAlt, nodeRepeat, nodeBOL, nodeEOL
+} nodeKind;
+
+/*Nodes are referred to by their index, as the array may move.
+  Children are a linked list through next, -1 terminated.*/
+typedef struct node {
+    nodeKind kind;
+    /*Set*/
+    byteSet set;
+    /*Concat Alt, or the one child of Repeat*/
+    int first, last;
+    int next;
+    /*Repeat: max is -1 if unbounded*/
+    int min, max;
+} node;
+
+typedef struct regexParser {
+    const char* pos;
+    node* nodes;
+    int nodeNo, capacity;
+    /*Only the first error is kept*/
+    char* error;
+} regexParser;
+
+static void regexError (regexParser* p, const char* format, ...) {
+    if (p->error)
+        return;
+
+    va_list args;
+    va_start(args, format);
+
+    if (vasprintf(&p->error, format, args) < 0)
+        p->error = strdup("Bad regex");
+
+    va_end(args);
+}
+
+static int newNode (regexParser* p, nodeKind kind) {
+    if (p->nodeNo == p->capacity)
+        p->nodes = realloc(p->nodes, sizeof(node) * (p->capacity = p->capacity*2 + 16));
+
+    p->nodes[p->nodeNo] = (node) {.kind = kind, .first = -1, .last = -1, .next = -1};
+    return p->nodeNo++;
+}
+
+static void addChild (regexParser* p, int parent, int child) {
+    node* n = &p->nodes[parent];
+
+    if (n->first < 0)
+        n->first = child;
+
+    else
+        p->nodes[n->last].next = child;
+
+    n->last = child;
+}
+
+static int newSetNode (regexParser* p, const byteSet* set) {
+    int n = newNode(p, nodeSet);
+    p->nodes[n].set = *set;
+    return n;
+}
+
+static int parseAlt (regexParser* p);
+
+static int hexDigit (char c) {
+    return   c >= '0' && c <= '9' ? c - '0'
+           : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10
+           : -1;
+}
+
+/*Adds the bytes an escape stands for to a set. Returns the byte if
+  it was a single one, else -1 (a class, or an error).*/
+static int parseEscape (regexParser* p, byteSet* set) {
+    /*Skip the backslash*/
+    p->pos++;
+    char c = *p->pos++;
+
+    byteSet class = {};
+    bool negated = isupper((unsigned char) c);
+
+    switch (tolower((unsigned char) c)) {
+    case 'd':
+        byteSetAddRange(&class, '0', '9');
+        break;
+
+    case 'w':
+        byteSetAddRange(&class, 'a', 'z');
+        byteSetAddRange(&class, 'A', 'Z');
+        byteSetAddRange(&class, '0', '9');
+        byteSetAdd(&class, '_');
+        break;
+
+    case 's':
+        byteSetAddRange(&class, '\t', '\r');
+        byteSetAdd(&class, ' ');
+        break;
+
+    default: {
+        int byte = -1;
+
+        switch (c) {
+        case 't': byte = '\t'; break;
+        case 'n': byte = '\n'; break;
+        case 'r': byte = '\r'; break;
+        case 'f': byte = '\f'; break;
+        case 'v': byte = '\v'; break;
+
+        case 'x': {
+            int high = hexDigit(p->pos[0]),
+                low = high < 0 ? -1 : hexDigit(p->pos[1]);
+
+            if (low < 0)
+                regexError(p, "\\x needs two hex digits");
+
+            else {
+                byte = high*16 + low;
+                p->pos += 2;
+            }
+
+            break;
+        }
+
+        case 0:
+            p->pos--;
+            regexError(p, "Trailing backslash");
+            break;
+
+        default:
+            if (isalnum((unsigned char) c))
+                regexError(p, "Unknown escape, \\%c", c);
+
+            else
+                byte = (unsigned char) c;
+        }
+
+        if (byte >= 0)
+            byteSetAdd(set, byte);
+
+        return byte;
+    }}
+
+    if (negated)
+        byteSetInvert(&class);
+
+    byteSetUnion(set, &class);
+    return -1;
+}
+
+/*A byte of a class, which may be escaped. Classes (\d etc) are added to
+  the set directly and give -1.*/
+static int parseClassByte (regexParser* p, byteSet* set) {
+    if (*p->pos == '\\') {
+        byteSet escaped = {};
+        int byte = parseEscape(p, &escaped);
+
+        if (byte < 0)
+            byteSetUnion(set, &escaped);
+
+        return byte;
+    }
+
+    return (unsigned char) *p->pos++;
+}
+
+static int parseClass (regexParser* p) {
+    /*Skip the [*/
+    p->pos++;
+
+    bool negated = *p->pos == '^';
+
+    if (negated)
+        p->pos++;
+
+    byteSet set = {};
+
+    /*A ] straight away is part of the class*/
+    for (bool first = true; first || *p->pos != ']'; first = false) {
+        if (!*p->pos || p->error) {
+            regexError(p, "Missing ]");
+            return newSetNode(p, &set);
+        }
+
+        int from = parseClassByte(p, &set);
+
+        if (from < 0)
+            continue;
+
+        /*A range, unless the - is at the end*/
+        if (p->pos[0] == '-' && p->pos[1] && p->pos[1] != ']') {
+            p->pos++;
+            int to = parseClassByte(p, &set);
+
+            if (to < from) {
+                regexError(p, "Bad range in a class");
+                return newSetNode(p, &set);
+            }
+
+            byteSetAddRange(&set, from, to);
+
+        } else
+            byteSetAdd(&set, from);
+    }
+
+    p->pos++;
+
+    if (negated)
+        byteSetInvert(&set);
+
+    return newSetNode(p, &set);
+}
+
+static int parseAtom (regexParser* p) {
+    byteSet set = {};
+
+    switch (*p->pos) {
+    case '(': {
+        p->pos++;
+
+        if (!strncmp(p->pos, "?:", 2))
+            p->pos += 2;
+
+        else if (*p->pos == '?')
+            regexError(p, "Unsupported group, (%.2s", p->pos);
+
+        int group = parseAlt(p);
+
+        if (*p->pos == ')')
+            p->pos++;
+
+        else
+            regexError(p, "Missing )");
+
+        return group;
+    }
+
+    case '[':
+        return parseClass(p);
+
+    case '.':
+        p->pos++;
+        byteSetInvert(&set);
+        set.bits['\n' >> 6] &= ~((uint64_t) 1 << ('\n' & 63));
+        return newSetNode(p, &set);
+
+    case '^':
+        p->pos++;
+        return newNode(p, nodeBOL);
+
+    case '$':
+        p->pos++;
+        return newNode(p, nodeEOL);
+
+    case '\\':
+        parseEscape(p, &set);
+        return newSetNode(p, &set);
+
+    case '*': case '+': case '?':
+        regexError(p, "Nothing to repeat before %c", *p->pos);
+        p->pos++;
+        return newSetNode(p, &set);
+
+    default:
+        byteSetAdd(&set, *p->pos++);
+        return newSetNode(p, &set);
+    }
+}
+
+/*{m} {m,} or {m,n}. Anything else isn't a repetition, and the { is
+  taken literally.*/
+static bool parseBounds (regexParser* p, int* min, int* max) {
+    const char* pos = p->pos+1;
+    char* end;
+
+    if (!isdigit((unsigned char) *pos))
+        return false;
+
+    long from = strtol(pos, &end, 10), to = from;
+    pos = end;
+
+    if (*pos == ',') {
+        pos++;
+
+        if (isdigit((unsigned char) *pos)) {
+            to = strtol(pos, &end, 10);
+            pos = end;
+
+        } else
+            to = -1;
+    }
+
+    if (*pos != '}')
+        return false;
+
+    if (from > regexMaxRepeat || to > regexMaxRepeat || (to >= 0 && to < from))
+        regexError(p, "Bad repetition, {%.*s", (int) (pos - p->pos), p->pos+1);
+
+    p->pos = pos+1;
+    *min = from;
+    *max = to;
+    return true;
+}
+
+static int parseRepeat (regexParser* p) {
+    int atom = parseAtom(p);
+
+    for (;;) {
+        int min, max;
+
+        switch (*p->pos) {
+        case '*': min = 0, max = -1, p->pos++; break;
+        case '+': min = 1, max = -1, p->pos++; break;
+        case '?': min = 0, max = 1, p->pos++; break;
+
+        case '{':
+            if (parseBounds(p, &min, &max))
+                break;
+
+            return atom;
+
+        default:
+            return atom;
+        }
+
+        /*Lazy repetitions match the same strings*/
+        if (*p->pos == '?')
+            p->pos++;
+
+        int repeat = newNode(p, nodeRepeat);
+        p->nodes[repeat].min = min;
+        p->nodes[repeat].max = max;
+        addChild(p, repeat, atom);
+        atom = repeat;
+    }
+}
+
+static int parseConcat (regexParser* p) {
+    int concat = newNode(p, nodeConcat);
+
+    while (*p->pos && *p->pos != '|' && *p->pos != ')' && !p->error)
+        addChild(p, concat, parseRepeat(p));
+
+    return concat;
+}
+
+static int parseAlt (regexParser* p) {
+    int first = parseConcat(p);
+
+    if (*p->pos != '|')
+        return first;
+
+    int alt = newNode(p, nodeAlt);
+    addChild(p, alt, first);
+
+    while (*p->pos == '|' && !p->error) {
+        p->pos++;
+        addChild(p, alt, parseConcat(p));
+    }
+
+    return alt;
+}
+
+/*==== Compiling ====*/
+
+/*A Pike VM program. Split continues at both x and y, Jmp at x.*/
+typedef enum instKind {
+    instByte, instSplit, instJmp, instMatch, instBOL, instEOL
+} instKind;
+
+typedef struct inst {
+    instKind kind;
+    int x, y;
+    /*Byte*/
+    byteSet set;
+} inst;
+
+/*Instructions needed for a node, stopping once it is too many*/
+static long regexSizeImpl (const regexParser* p, int n);
+
+static long regexSize (const regexParser* p, int n) {
+    long size = regexSizeImpl(p, n);
+    return size > regexMaxInsts ? regexMaxInsts+1 : size;
+}
+
+static long regexSizeImpl (const regexParser* p, int n) {
+    const node* nd = &p->nodes[n];
+    long size = 0;
+
+    switch (nd->kind) {
+    case nodeSet:
+    case nodeBOL:
+    case nodeEOL:
+        return 1;
+
+    case nodeConcat:
+    case nodeAlt:
+        for (int child = nd->first; child >= 0 && size <= regexMaxInsts; child = p->nodes[child].next)
+            size += regexSize(p, child) + (nd->kind == nodeAlt ? 2 : 0);
+
+        return size;
+
+    case nodeRepeat: {
+        long child = regexSize(p, nd->first);
+        size = nd->min * child + (nd->max < 0 ? child + 2 : (nd->max - nd->min) * (child + 1));
+        return size;
+    }}
+
+    return 0;
+}
+
+typedef struct regexCompiler {
+    const regexParser* p;
+    inst* insts;
+    int instNo;
+} regexCompiler;
+
+static int emit (regexCompiler* c, instKind kind) {
+    c->insts[c->instNo] = (inst) {.kind = kind};
+    return c->instNo++;
+}
+
+static void compile (regexCompiler* c, int n) {
+    const node* nd = &c->p->nodes[n];
+
+    switch (nd->kind) {
+    case nodeSet:
+        c->insts[emit(c, instByte)].set = nd->set;
+        break;
+
+    case nodeBOL:
+        emit(c, instBOL);
+        break;
+
+    case nodeEOL:
+        emit(c, instEOL);
+        break;
+
+    case nodeConcat:
+        for (int child = nd->first; child >= 0; child = c->p->nodes[child].next)
+            compile(c, child);
+
+        break;
+
+    /*Split to each alternative but the last, which jump to the end*/
+    case nodeAlt: {
+        int jmps = -1;
+
+        for (int child = nd->first; child >= 0; child = c->p->nodes[child].next) {
+            bool last = c->p->nodes[child].next < 0;
+            int split = last ? -1 : emit(c, instSplit);
+
+            if (!last)
+                c->insts[split].x = split+1;
+
+            compile(c, child);
+
+            if (!last) {
+                /*Jmps to be patched are linked through x*/
+                int jmp = emit(c, instJmp);
+                c->insts[jmp].x = jmps;
+                jmps = jmp;
+
+                c->insts[split].y = c->instNo;
+            }
+        }
+
+        for (int jmp = jmps, next; jmp >= 0; jmp = next) {
+            next = c->insts[jmp].x;
+            c->insts[jmp].x = c->instNo;
+        }
+
+        break;
+    }
+
+    case nodeRepeat:
+        for (int i = 0; i < nd->min; i++)
+            compile(c, nd->first);
+
+        if (nd->max < 0) {
+            int split = emit(c, instSplit);
+            c->insts[split].x = split+1;
+            compile(c, nd->first);
+            c->insts[emit(c, instJmp)].x = split;
+            c->insts[split].y = c->instNo;
+
+        } else {
+            /*Each optional copy can skip to the end*/
+            int splits = -1;
+
+            for (int i = nd->min; i < nd->max; i++) {
+                int split = emit(c, instSplit);
+                c->insts[split].x = split+1;
+                c->insts[split].y = splits;
+                splits = split;
+                compile(c, nd->first);
+            }
+
+            for (int split = splits, next; split >= 0; split = next) {
+                next = c->insts[split].y;
+                c->insts[split].y = c->instNo;
+            }
+        }
+
+        break;
+    }
+}
+
+/*==== Literal prefilter ====*/
+
+/*The longest run of single bytes in the top level of the pattern, which
+  any match must contain. Whether it is also the prefix of any match,
+  the start of the string (after a ^), or the whole pattern.*/
+typedef struct regexLiteral {
+    char* str;
+    size_t length;
+    bool prefix, anchored, all;
+} regexLiteral;
+
+static regexLiteral regexFindLiteral (const regexParser* p, int root) {
+    const node* top = &p->nodes[root];
+    regexLiteral best = {};
+
+    if (top->kind != nodeConcat)
+        return best;
+
+    char run[regexMaxInsts];
+    size_t length = 0;
+    bool atPrefix = true, atStart = false, anchors = false, breaks = false;
+
+    for (int child = top->first; ; child = p->nodes[child].next) {
+        const node* nd = child >= 0 ? &p->nodes[child] : 0;
+        int byte = nd && nd->kind == nodeSet ? byteSetOnly(&nd->set) : -1;
+
+        if (byte >= 0) {
+            run[length++] = byte;
+            continue;
+        }
+
+        if (length > best.length) {
+            free(best.str);
+            best = (regexLiteral) {
+                .str = malloc(length), .length = length,
+                .prefix = atPrefix, .anchored = atStart
+            };
+            memcpy(best.str, run, length);
+        }
+
+        if (!nd)
+            break;
+
+        /*Anchors take up no room in the run*/
+        if (nd->kind == nodeBOL || nd->kind == nodeEOL) {
+            atStart = nd->kind == nodeBOL && atPrefix && !length;
+            anchors = true;
+
+        } else {
+            breaks = true;
+            atStart = false;
+            length = 0;
+        }
+
+        atPrefix = false;
+    }
+
+    best.all = best.length && !anchors && !breaks;
+    return best;
+}
+
+/*==== Lazy DFA ====*/
+
+/*A state is the set of instructions that consume a byte, or finish,
+  that the program might be at. The transitions out of it are filled in
+  as they are first taken, null until then.*/
+typedef struct regexState {
+    struct regexState* _Atomic next[256];
+    bool match, matchAtEnd;
+    /*Matched, or dead (no pcs left, only possible if anchored)*/
+    bool finished;
+    int pcNo;
+    int pcs[];
+} regexState;
+
+typedef struct pcSet {
+    int *dense, *sparse;
+    int n;
+} pcSet;
+
+typedef struct regex {
+    char* pattern;
+    inst* insts;
+    int instNo;
+
+    regexLiteral literal;
+
+    /*States are added under the lock. The transitions are read without.*/
+    pthread_mutex_t lock;
+    hashmap(int) stateIndices;
+    regexState* states[regexMaxStates];
+    int stateNo;
+    pcSet scratch;
+    int* stack;
+
+    /*At the start of the string, and where a match might start after it*/
+    const regexState *start, *midStart;
+} regex;
+
+static void pcSetInit (pcSet* set, int size) {
+    *set = (pcSet) {.dense = calloc(size, sizeof(int)), .sparse = calloc(size, sizeof(int))};
+}
+
+static void pcSetFree (pcSet* set) {
+    free(set->dense);
+    free(set->sparse);
+}
+
+static bool pcSetHas (const pcSet* set, int pc) {
+    int index = set->sparse[pc];
+    return index < set->n && set->dense[index] == pc;
+}
+
+/*Add the instructions reachable from a pc without consuming a byte.
+  ^ and $ are passed only at the start or end of the string.*/
+static void closure (const regex* re, pcSet* set, int* stack, int pc, bool atStart, bool atEnd) {
+    int top = 0;
+    stack[top++] = pc;
+
+    while (top) {
+        pc = stack[--top];
+
+        if (pcSetHas(set, pc))
+            continue;
+
+        set->sparse[pc] = set->n;
+        set->dense[set->n++] = pc;
+
+        const inst* in = &re->insts[pc];
+
+        switch (in->kind) {
+        case instSplit:
+            stack[top++] = in->y;
+            stack[top++] = in->x;
+            break;
+
+        case instJmp:
+            stack[top++] = in->x;
+            break;
+
+        case instBOL:
+            if (atStart)
+                stack[top++] = pc+1;
+
+            break;
+
+        case instEOL:
+            if (atEnd)
+                stack[top++] = pc+1;
+
+            break;
+
+        default:
+            ;
+        }
+    }
+}
+
+/*Where the program might be after a byte, with a match also allowed to
+  start just after it*/
+static void step (const regex* re, const int* pcs, int pcNo, unsigned char c,
+                  pcSet* to, int* stack) {
+    to->n = 0;
+
+    for (int i = 0; i < pcNo; i++) {
+        const inst* in = &re->insts[pcs[i]];
+
+        if (in->kind == instByte && byteSetHas(&in->set, c))
+            closure(re, to, stack, pcs[i]+1, false, false);
+    }
+
+    closure(re, to, stack, 0, false, false);
+}
+
+/*The instructions of a set that matter to a state, in order.
+  Returns how many.*/
+static int statePcs (const regex* re, const pcSet* set, int* pcs) {
+    int pcNo = 0;
+
+    for (int pc = 0; pc < re->instNo; pc++) {
+        instKind kind = re->insts[pc].kind;
+
+        if (   (kind == instByte || kind == instMatch || kind == instEOL)
+            && pcSetHas(set, pc))
+            pcs[pcNo++] = pc;
+    }
+
+    return pcNo;
+}
+
+/*Whether reaching the end of the string here is a match, through $s*/
+static bool matchesAtEnd (const regex* re, const int* pcs, int pcNo, bool atStart,
+                          pcSet* scratch, int* stack) {
+    int matchPc = re->instNo-1;
+    scratch->n = 0;
+
+    for (int i = 0; i < pcNo; i++) {
+        if (pcs[i] == matchPc)
+            return true;
+
+        else if (re->insts[pcs[i]].kind == instEOL)
+            closure(re, scratch, stack, pcs[i], atStart, true);
+    }
+
+    return pcSetHas(scratch, matchPc);
+}
+
+/*Find or add the state for a set, giving its index+1. 0 if there's no
+  room for another. Called under the lock.*/
+static int addState (regex* re, const pcSet* set, bool atStart) {
+    int pcs[re->instNo];
+    int pcNo = statePcs(re, set, pcs);
+
+    char* key = malloc(12*pcNo + 2);
+    int length = sprintf(key, "%c", atStart ? '^' : '-');
+
+    for (int i = 0; i < pcNo; i++)
+        length += sprintf(key+length, "%d,", pcs[i]);
+
+    int index = (intptr_t) hashmapMap(&re->stateIndices, key);
+
+    if (index || re->stateNo == regexMaxStates) {
+        free(key);
+        return index;
+    }
+
+    regexState* state = calloc(1, sizeof(regexState) + sizeof(int)*pcNo);
+    state->pcNo = pcNo;
+    memcpy(state->pcs, pcs, sizeof(int)*pcNo);
+
+    state->match = pcSetHas(set, re->instNo-1);
+    state->finished = state->match || !pcNo;
+
+    pcSet scratch;
+    pcSetInit(&scratch, re->instNo);
+    state->matchAtEnd = matchesAtEnd(re, pcs, pcNo, atStart, &scratch, re->stack);
+    pcSetFree(&scratch);
+
+    re->states[re->stateNo++] = state;
+    hashmapAdd(&re->stateIndices, key, (void*) (intptr_t) re->stateNo);
+    free(key);
+
+    return re->stateNo;
+}
+
+/*Take a transition that hasn't been yet. Null if the states are full.*/
+static const regexState* addTransition (const regex* constre, const regexState* from, unsigned char c) {
+    /*Only the states and the scratch space are modified, under the lock*/
+    regex* re = (regex*) constre;
+
+    pthread_mutex_lock(&re->lock);
+
+    regexState* to = atomic_load(&from->next[c]);
+
+    if (!to) {
+        step(re, from->pcs, from->pcNo, c, &re->scratch, re->stack);
+        int index = addState(re, &re->scratch, false);
+
+        /*Only visible to other threads once the state is complete*/
+        if (index) {
+            to = re->states[index-1];
+            atomic_store((regexState* _Atomic*) &from->next[c], to);
+        }
+    }
+
+    pthread_mutex_unlock(&re->lock);
+
+    return to;
+}
+
+/*Run the program without the DFA, from a state, once no more states
+  fit. Each byte is as slow as building a state, but this is rare.*/
+static bool simulate (const regex* re, const regexState* from, const char* str, const char* end) {
+    pcSet set, scratch;
+    pcSetInit(&set, re->instNo);
+    pcSetInit(&scratch, re->instNo);
+    int* stack = malloc(sizeof(int) * (2*re->instNo + 2));
+    int* pcs = malloc(sizeof(int) * re->instNo);
+
+    int pcNo = from->pcNo;
+    memcpy(pcs, from->pcs, sizeof(int)*pcNo);
+
+    bool match = false;
+
+    for (; str < end; str++) {
+        step(re, pcs, pcNo, *str, &set, stack);
+        pcNo = statePcs(re, &set, pcs);
+
+        if ((match = pcSetHas(&set, re->instNo-1)))
+            break;
+    }
+
+    if (!match)
+        match = matchesAtEnd(re, pcs, pcNo, false, &scratch, stack);
+
+    pcSetFree(&set);
+    pcSetFree(&scratch);
+    free(stack);
+    free(pcs);
+
+    return match;
+}
+
+static const char* findLiteral (const regexLiteral* literal, const char* str, const char* end) {
+    return literal->length == 1
+        ? memchr(str, literal->str[0], end - str)
+        : memmem(str, end - str, literal->str, literal->length);
+}
+
+bool regexMatch (const regex* re, const char* str, size_t length) {
+    const char *pos = str,
+               *end = str + length;
+
+    const regexLiteral* literal = &re->literal;
+
+    if (literal->anchored) {
+        if (length < literal->length || memcmp(str, literal->str, literal->length))
+            return false;
+
+    } else if (literal->length) {
+        const char* found = findLiteral(literal, str, end);
+
+        if (!found || literal->all)
+            return found;
+
+        if (literal->prefix)
+            pos = found;
+    }
+
+    const regexState* state = pos == str ? re->start : re->midStart;
+    /*Not part way into a match, where it can skip to the next literal*/
+    const regexState* skipFrom = literal->prefix ? re->midStart : 0;
+
+    for (; pos < end; pos++) {
+        if (state->finished)
+            return state->match;
+
+        else if (state == skipFrom) {
+            if (!(pos = findLiteral(literal, pos, end)))
+                return false;
+        }
+
+        const regexState* to = atomic_load_explicit(&state->next[(unsigned char) *pos], memory_order_acquire);
+
+        if (!to)
+            to = addTransition(re, state, *pos);
+
+        if (!to)
+            return simulate(re, state, pos, end);
+
+        state = to;
+    }
+
+    return state->match || state->matchAtEnd;
+}
+
+const char* regexFindLine (const regex* re, const char* str, const char* end, const char** lineEnd_out) {
+    const regexLiteral* literal = &re->literal;
+    bool skip = literal->length && !literal->anchored;
+
+    while (str < end) {
+        const char* line = str;
+
+        /*Only the line holding the next literal might match*/
+        if (skip) {
+            const char* found = findLiteral(literal, str, end);
+
+            if (!found)
+                return 0;
+
+            const char* newline = memrchr(str, '\n', found - str);
+            line = newline ? newline+1 : str;
+        }
+
+        const char* eol = memchr(line, '\n', end - line);
+        const char* lineEnd = eol ? eol : end;
+
+        if (lineEnd != line && lineEnd[-1] == '\r')
+            lineEnd--;
+
+        if (regexMatch(re, line, lineEnd - line)) {
+            *lineEnd_out = lineEnd;
+            return line;
+        }
+
+        str = eol ? eol+1 : end;
+    }
+
+    return 0;
+}
+
+const char* regexGetPattern (const regex* re) {
+    return re->pattern;
+}
+
+/*==== Compiling ====*/
+
+static pthread_mutex_t regexesLock = PTHREAD_MUTEX_INITIALIZER;
+static hashmap(regex*) regexes;
+static bool regexesInited = false;
+
+static regex* regexCreate (const char* pattern, regexParser* p, int root) {
+    regex* re = calloc(1, sizeof(regex));
+    re->pattern = strdup(pattern);
+
+    regexCompiler c = {
+        .p = p,
+        .insts = malloc(sizeof(inst) * (regexSize(p, root) + 1))
+    };
+
+    compile(&c, root);
+    emit(&c, instMatch);
+
+    re->insts = c.insts;
+    re->instNo = c.instNo;
+
+    re->literal = regexFindLiteral(p, root);
+
+    pthread_mutex_init(&re->lock, 0);
+    re->stateIndices = hashmapInit(64, calloc);
+    pcSetInit(&re->scratch, re->instNo);
+    re->stack = malloc(sizeof(int) * (2*re->instNo + 2));
+
+    closure(re, &re->scratch, re->stack, 0, true, false);
+    re->start = re->states[addState(re, &re->scratch, true)-1];
+
+    re->scratch.n = 0;
+    closure(re, &re->scratch, re->stack, 0, false, false);
+    re->midStart = re->states[addState(re, &re->scratch, false)-1];
+
+    return re;
+}
+
+regex* regexCompile (const char* pattern, char** error_out) {
+    pthread_mutex_lock(&regexesLock);
+
+    if (!regexesInited) {
+        regexes = hashmapInit(64, calloc);
+        regexesInited = true;
+    }
+
+    regex* re = hashmapMap(&regexes, pattern);
+
+    if (!re) {
+        regexParser p = {.pos = pattern};
+        int root = parseAlt(&p);
+
+        if (*p.pos == ')')
+            regexError(&p, "Unmatched )");
+
+        if (!p.error && regexSize(&p, root) >= regexMaxInsts)
+            regexError(&p, "Regex too large");
+
+        if (p.error)
+            *error_out = p.error;
+
+        else {
+            re = regexCreate(pattern, &p, root);
+            hashmapAdd(&regexes, re->pattern, re);
+        }
+
+        free(p.nodes);
+    }
+
+    pthread_mutex_unlock(&regexesLock);
+
+    return re;
+}
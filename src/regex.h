@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "forward.h"
+
+/*Compile a regular expression. The same pattern is only ever compiled
+  once, and the result lives until the program exits.
+
+  The syntax is the usual extended one: | * + ? {m} {m,} {m,n}, groups
+  (optionally (?:...)), classes [a-z] [^...], . (anything but a newline),
+  ^ and $ (the start and end of the string), and the escapes \d \w \s
+  \D \W \S \t \n \r \f \v \xHH. Returns null and an error message, which
+  must be freed, for a bad pattern.*/
+regex* regexCompile (const char* pattern, char** error_out);
+
+/*Whether the regex matches anywhere in [str, str+length). Safe to call
+  from many threads at once.
+
+  A deterministic automaton is built lazily as it is needed, so a scan
+  over lots of text costs a table lookup per byte, once warmed up.
+  Text without the longest literal the pattern requires is rejected
+  without running it at all.*/
+bool regexMatch (const regex* re, const char* str, size_t length);
+
+/*Find the first line in [str, end) that the regex matches, as in
+  regexMatch, and give its start. The end of the line, before any \r\n,
+  is given through lineEnd_out. Null if there is none.
+
+  Text that doesn't contain the literal the regex needs is skipped
+  without being split into lines.*/
+const char* regexFindLine (const regex* re, const char* str, const char* end, const char** lineEnd_out);
+
+const char* regexGetPattern (const regex* re);
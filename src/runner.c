@@ -1,5 +1,6 @@
 #include "runner.h"
 
+#include <stdarg.h>
 #include <gc.h>
 
 #include "dirctx.h"
@@ -9,8 +10,22 @@
 #include "type.h"
 #include "value.h"
 
+#include "terminal.h"
 #include "invoke.h"
 #include "builtins.h"
+#include "table.h"
+#include "parallel.h"
+#include "serialize.h"
+#include "dict.h"
+
+enum {
+    /*Elements per chunk of parallel work, for calls of unknown cost*/
+    runnerChunkSize = 16,
+    /*And for the known, cheap combining fns of a reduction*/
+    runnerReduceChunkSize = 1024,
+    /*The least room given to each read of programs' output, as lines*/
+    runUnixReadSize = 64*1024
+};
 
 static value* getSymbolValue (envCtx* env, sym* symbol) {
     /*Look it up in the symbol environment
@@ -23,8 +38,11 @@ static value* getSymbolValue (envCtx* env, sym* symbol) {
 
         value* result = vectorGet(env->values, index);
 
-        precond(result);
-        return result;
+        if (!precond(result))
+            return valueCreateInvalid();
+
+        /*Hoisted, and computed when first needed*/
+        return valueAwait(result);
 
     /*Otherwise we can just access the global value*/
     } else {
@@ -35,14 +53,27 @@ static value* getSymbolValue (envCtx* env, sym* symbol) {
             return valueCreateInvalid();
         }
 
-        return val;
+        /*Bound by a background job which may not be done yet*/
+        return valueAwait(val);
     }
 
 }
 
+/*An expression hoisted out of a lambda, and the env it's run in*/
+typedef struct hoistedCtx {
+    envCtx env;
+    const ast* init;
+} hoistedCtx;
+
+static value* runHoisted (hoistedCtx* ctx) {
+    return run(&ctx->env, ctx->init);
+}
+
 static value* runFnLit (envCtx* env, const ast* node) {
-    /*Actual args = captures + explicit args*/
-    int argNo = node->captured->length + node->children.length;
+    int hoistedNo = node->hoisted ? node->hoisted->length : 0;
+
+    /*Actual args = captures + hoisted + explicit args*/
+    int argNo = node->captured->length + hoistedNo + node->children.length;
 
     /*These two vectors form a simple map from symbol to value, hence
       their elements must correspond.*/
@@ -53,6 +84,12 @@ static value* runFnLit (envCtx* env, const ast* node) {
 
     vectorPushFromVector(&argSymbols, *node->captured);
 
+    if (node->hoisted) {
+        for_vector (ast* let, *node->hoisted, {
+            vectorPush(&argSymbols, let->symbol);
+        })
+    }
+
     for_vector (ast* arg, node->children, {
         if (!precond(arg->symbol))
             continue;
@@ -66,10 +103,24 @@ static value* runFnLit (envCtx* env, const ast* node) {
         vectorPush(&argValues, getSymbolValue(env, capture));
     })
 
+    /*Evaluate the hoisted expressions once for all the calls, but only
+      when first needed: the lambda may never be called, or they may be
+      errors that the lambda guards against*/
+    if (node->hoisted) {
+        for_vector (ast* let, *node->hoisted, {
+            hoistedCtx* hoisted = GC_MALLOC(sizeof(hoistedCtx));
+            hoisted->env = *env;
+            hoisted->init = astDup(let->r, GC_malloc);
+
+            value* deferred = valueCreateDeferred(hoisted, (deferredFn) runHoisted);
+            vectorPush(&argValues, deferred);
+        })
+    }
+
     /*Duplicate the body*/
     ast* body = astDup(node->r, GC_malloc);
 
-    return valueCreateASTClosure(argSymbols, argValues, body);
+    return valueCreateASTClosure(argSymbols, argValues, body, env->dirs);
 }
 
 static value* runTupleLit (envCtx* env, const ast* node) {
@@ -96,6 +147,22 @@ static value* runListLit (envCtx* env, const ast* node) {
     return valueStoreArray(node->children.length, results);
 }
 
+static value* runDictLit (envCtx* env, const ast* node) {
+    dict* table = dictCreate(node->children.length/2);
+
+    for (int i = 0; i+1 < node->children.length; i += 2) {
+        const value *key = run(env, vectorGet(node->children, i)),
+                    *val = run(env, vectorGet(node->children, i+1));
+
+        if (valueIsInvalid(key))
+            return valueCreateInvalid();
+
+        dictSet(table, key, val);
+    }
+
+    return valueStoreDict(table);
+}
+
 static value* runFileLit (envCtx* env, const ast* node) {
     const char* str = node->literal.str;
 
@@ -130,6 +197,7 @@ static value* runLit (envCtx* env, const ast* node) {
     case astFloatLit: return valueCreateFloat(node->literal.number);
     case astBoolLit: return valueCreateInt(node->literal.truth);
     case astStrLit: return valueCreateStr(node->literal.str);
+    case astRegexLit: return valueCreateRegex(node->literal.regex);
     /*This one thrown in too because it's similarly simple*/
     case astInvalid: return valueCreateUnit();
 
@@ -143,6 +211,16 @@ static value* runSymbol (envCtx* env, const ast* node) {
     return getSymbolValue(env, node->symbol);
 }
 
+static value* runTypeHint (envCtx* env, const ast* node) {
+    value* result = run(env, node->l);
+
+    if (node->flags & flagTableConversion)
+        return tableConvert(result, node->dt, env->dirs->workingDirReal);
+
+    else
+        return result;
+}
+
 bool unixSerialize (vector(const char*)* args, value* v, type* dt) {
     const char* str;
 
@@ -189,44 +267,345 @@ bool unixSerialize (vector(const char*)* args, value* v, type* dt) {
     vectorPush(args, str);
     return false;
 }
-static value* runClassicUnixApp (envCtx* env, const ast* node, const char* program) {
-    /*Create a vector of the (string) args,
-      bookended by the program name and a null-terminator.*/
+/*Create a vector of the (string) args of a program invocation,
+  bookended by the program name and a null-terminator. The node is
+  either an invocation or just a program, given no args.
+  The args that came from the longest list are the range [listStart,
+  listEnd), if the pointers are given.
+  Returns whether it failed.*/
+static bool unixCreateArgs (envCtx* env, const ast* node, vector(const char*)* args,
+                            int* listStart, int* listEnd) {
+    bool invocation = node->kind == astFnApp && (node->flags & flagUnixInvocation);
 
-    vector(const char*) args = vectorInit(node->children.length + 2, malloc);
+    const ast* programNode = invocation ? node->r : node;
+    value* program = run(env, programNode);
 
-    vectorPush(&args, program);
+    *args = vectorInit(invocation ? node->children.length + 2 : 2, malloc);
 
-    for_vector (ast* argNode, node->children, {
-        value* arg = run(env, argNode);
+    vectorPush(args, valueGetFilename(program));
 
-        /*Structured data must be lowered to strings*/
-        bool fail = unixSerialize(&args, arg, argNode->dt);
+    int longestStart = 0, longestEnd = 0;
 
-        if (fail)
-            return valueCreateInvalid();
+    if (invocation) {
+        for_vector (ast* argNode, node->children, {
+            value* arg = run(env, argNode);
+            int start = args->length;
+            type* elements;
+
+            /*Structured data must be lowered to strings*/
+            bool fail = unixSerialize(args, arg, argNode->dt);
+
+            if (fail) {
+                vectorFree(args);
+                return true;
+            }
+
+            if (   typeIsListOf(argNode->dt, &elements)
+                && args->length - start > longestEnd - longestStart) {
+                longestStart = start;
+                longestEnd = args->length;
+            }
+        })
+    }
+
+    if (listStart && listEnd) {
+        *listStart = longestStart;
+        *listEnd = longestEnd;
+    }
+
+    /*A list cut short, the program mustn't be given only some of it*/
+    if (cancelled()) {
+        vectorFree(args);
+        return true;
+    }
+
+    vectorPush(args, 0);
+
+    return false;
+}
+
+/*Point to the strings making up the input to a program, a Str or the
+  lines of a [Str], so they can be written without copying them first.
+  GC allocated, which keeps the strings alive.*/
+static struct iovec* unixCreateInput (const value* v, type* dt, int* n) {
+    static char newline[] = "\n";
+
+    if (typeIsKind(type_Str, dt)) {
+        struct iovec* input = GC_MALLOC(sizeof(struct iovec));
+        input->iov_base = (char*) valueGetStrWithLength(v, &input->iov_len);
+        *n = 1;
+        return input;
+    }
+
+    vector(value*) lines = valueGetVector(v);
+    struct iovec* input = GC_MALLOC(sizeof(struct iovec) * (2*lines.length + 1));
+    *n = 0;
+
+    for_vector (value* line, lines, {
+        input[*n].iov_base = (char*) valueGetStrWithLength(line, &input[*n].iov_len);
+        input[*n+1].iov_base = newline;
+        input[*n+1].iov_len = 1;
+        *n += 2;
     })
 
-    vectorPush(&args, 0);
+    return input;
+}
 
-    /*Invoke the program*/
+/*The output of programs, read a line at a time as they are asked for*/
+typedef struct unixLinesCtx {
+    invokeReader* reader;
+    /*Read but not yet split off, [buffer+start, buffer+length)*/
+    char* buffer;
+    size_t start, length, capacity;
+} unixLinesCtx;
 
-    value* result;
+static void unixLinesClose (unixLinesCtx* ctx) {
+    if (ctx->reader)
+        invokeReaderClose(ctx->reader);
+
+    ctx->reader = 0;
+}
+
+/*Left unread, the programs are ended by SIGPIPE when the stream goes*/
+static void unixLinesFinalize (void* obj, void* data) {
+    (void) data;
+    unixLinesClose(obj);
+}
+
+static value* unixLinesNext (unixLinesCtx* ctx) {
+    while (true) {
+        char *start = ctx->buffer + ctx->start,
+             *end = ctx->buffer + ctx->length;
+        char* eol = memchr(start, '\n', end-start);
+        bool ended = !ctx->reader;
+
+        if (eol || (ended && start != end)) {
+            if (!eol)
+                eol = end;
+
+            /*Without a carriage return either, as lines does*/
+            size_t length = (eol != start && eol[-1] == '\r' ? eol-1 : eol) - start;
+
+            char* line = GC_MALLOC_ATOMIC(length+1);
+            memcpy(line, start, length);
+            line[length] = 0;
+
+            ctx->start = eol == end ? ctx->length : (size_t) (eol+1 - ctx->buffer);
+            return valueStoreStr(line, length, 0);
+        }
+
+        else if (ended)
+            return 0;
+
+        /*Keep the partial line at the front, and make room after it*/
+        ctx->length -= ctx->start;
+        memmove(ctx->buffer, start, ctx->length);
+        ctx->start = 0;
+
+        if (ctx->capacity - ctx->length < runUnixReadSize) {
+            ctx->capacity = 2*ctx->capacity + runUnixReadSize;
+            ctx->buffer = GC_REALLOC(ctx->buffer, ctx->capacity);
+        }
+
+        ssize_t readsize = invokeReaderRead(ctx->reader, ctx->buffer + ctx->length,
+                                            ctx->capacity - ctx->length);
+
+        /*Picked up again where it left off*/
+        if (readsize < 0)
+            return 0;
+
+        else if (readsize == 0)
+            unixLinesClose(ctx);
+
+        ctx->length += readsize;
+    }
+}
+
+/*Piped programs give their output as a string, unless lines is given
+  and set, asking for it to be split into lines. If that could be done
+  lazily it gives a stream of them and leaves lines set, otherwise it
+  clears it and it's left to the caller.*/
+static value* runUnixStages (const ast* node, int n, char** argvs[], struct iovec* input, int inputs,
+                             bool* lines) {
+    bool lazy = lines && *lines && !input && !(node->flags & flagUnixSynchronous);
+
+    if (lines)
+        *lines = lazy;
 
     if (node->flags & flagUnixSynchronous)
-        result = valueCreateInt(invokeSyncronously((char**) args.buffer));
+        return valueCreateInt(invokePipelineSyncronously(n, argvs, input, inputs));
 
-    else {
-        /*Run the program*/
-        FILE* programOutput = invokePiped((char**) args.buffer);
+    if (lazy) {
+        invokeReader* reader = invokePipelineReader(n, argvs);
 
-        if (!precond(programOutput))
+        /*Already reported*/
+        if (!reader)
             return valueCreateInvalid();
 
-        /*Read the pipe*/
-        char* output = readall(programOutput, gcalloc);
+        unixLinesCtx* ctx = GC_MALLOC(sizeof(unixLinesCtx));
+        *ctx = (unixLinesCtx) {.reader = reader};
+        GC_REGISTER_FINALIZER(ctx, unixLinesFinalize, 0, 0, 0);
 
-        result = valueCreateStr(output);
+        return valueCreateStream(ctx, (streamNextFn) unixLinesNext);
+    }
+
+    /*Run the programs, reading their output*/
+    char* output = invokePipelinePiped(n, argvs, input, inputs, gcalloc);
+
+    /*Already reported*/
+    if (!output)
+        return valueCreateInvalid();
+
+    return valueStoreStr(output, strlen(output), 0);
+}
+
+static size_t unixArgSize (const char* arg) {
+    return strlen(arg) + 1 + sizeof(char*);
+}
+
+/*Whether there are too many args from a list for one go*/
+static bool unixArgsTooLong (vector(const char*) args, int listStart, int listEnd) {
+    if (listStart == listEnd)
+        return false;
+
+    size_t size = 0;
+
+    for (int i = 0; i < args.length-1; i++)
+        size += unixArgSize(vectorGet(args, i));
+
+    return (long) size > invokeArgLimit();
+}
+
+/*Split up the args of a program into batches which each fit in the
+  space for args, like xargs. Each gets the args either side of the
+  range from a list, and as many from it as fit.
+  Returns the argvs of the batches, all GC allocated.*/
+static vector(char**) unixBatchArgs (vector(const char*) args, int listStart, int listEnd) {
+    /*Not including the null-terminator*/
+    int argc = args.length-1;
+
+    size_t fixedSize = sizeof(char*);
+
+    for (int i = 0; i < argc; i++) {
+        if (i < listStart || i >= listEnd)
+            fixedSize += unixArgSize(vectorGet(args, i));
+    }
+
+    long limit = invokeArgLimit() - fixedSize;
+
+    vector(char**) batches = vectorInit(4, GC_malloc);
+
+    for (int start = listStart; start < listEnd || batches.length == 0;) {
+        /*At least one from the list, even if it's too long*/
+        int end = start+1;
+        size_t size = unixArgSize(vectorGet(args, start));
+
+        for (; end < listEnd; end++) {
+            size += unixArgSize(vectorGet(args, end));
+
+            if ((long) size > limit)
+                break;
+        }
+
+        /*Before, the list, after, null*/
+        int batchc = listStart + (end-start) + (argc-listEnd);
+        char** argv = GC_MALLOC(sizeof(char*) * (batchc+1));
+
+        memcpy(argv, args.buffer, sizeof(char*) * listStart);
+        memcpy(argv+listStart, args.buffer+start, sizeof(char*) * (end-start));
+        memcpy(argv+listStart+(end-start), args.buffer+listEnd, sizeof(char*) * (argc-listEnd));
+        argv[batchc] = 0;
+
+        vectorPush(&batches, argv);
+        start = end;
+    }
+
+    return batches;
+}
+
+/*Run the batches of a program, fanning out to as many at once as the
+  env allows. Their output comes in order, as if they were one program.
+  The exit status is the first that isn't zero.*/
+static value* runUnixBatches (envCtx* env, bool synchronous, vector(char**) argvs) {
+    int fanout = env->fanout > 1 ? env->fanout : 1;
+
+    /*One at a time, straight to the terminal*/
+    if (synchronous && fanout == 1) {
+        int status = 0;
+
+        for_vector (char** argv, argvs, {
+            if (cancelled())
+                return valueCreateInvalid();
+
+            int batchStatus = invokeSyncronously(argv);
+
+            if (!status)
+                status = batchStatus;
+        })
+
+        return valueCreateInt(status);
+    }
+
+    char** outputs = GC_MALLOC(sizeof(char*) * argvs.length);
+    int* statuses = GC_MALLOC_ATOMIC(sizeof(int) * argvs.length);
+
+    invokeFanOut(argvs.length, (char***) argvs.buffer, fanout, outputs, statuses, gcalloc);
+
+    int status = 0;
+    size_t length = 0;
+
+    for (int i = 0; i < argvs.length; i++) {
+        /*Already reported*/
+        if (!outputs[i])
+            return valueCreateInvalid();
+
+        if (!status)
+            status = statuses[i];
+
+        length += strlen(outputs[i]);
+    }
+
+    if (synchronous) {
+        for (int i = 0; i < argvs.length; i++)
+            fputs(outputs[i], stdout);
+
+        fflush(stdout);
+        return valueCreateInt(status);
+    }
+
+    char* output = GC_MALLOC_ATOMIC(length+1);
+    output[0] = 0;
+
+    for (int i = 0, at = 0; i < argvs.length; i++) {
+        strcpy(output+at, outputs[i]);
+        at += strlen(outputs[i]);
+    }
+
+    return valueStoreStr(output, length, 0);
+}
+
+/*lines as for runUnixStages*/
+static value* runClassicUnixApp (envCtx* env, const ast* node, bool* lines) {
+    vector(const char*) args;
+    int listStart, listEnd;
+
+    if (unixCreateArgs(env, node, &args, &listStart, &listEnd))
+        return valueCreateInvalid();
+
+    value* result;
+
+    if (unixArgsTooLong(args, listStart, listEnd)) {
+        if (lines)
+            *lines = false;
+
+        bool synchronous = node->flags & flagUnixSynchronous;
+        result = runUnixBatches(env, synchronous, unixBatchArgs(args, listStart, listEnd));
+    }
+
+    /*Invoke the program*/
+    else {
+        char** argv = (char**) args.buffer;
+        result = runUnixStages(node, 1, &argv, 0, 0, lines);
     }
 
     vectorFree(&args);
@@ -235,35 +614,195 @@ static value* runClassicUnixApp (envCtx* env, const ast* node, const char* progr
 }
 
 static value* runFnApp (envCtx* env, const ast* node) {
+    if (node->flags & flagUnixInvocation)
+        return runClassicUnixApp(env, node, 0);
+
     value* result = run(env, node->r);
 
-    if (node->flags & flagUnixInvocation)
-        result = runClassicUnixApp(env, node, valueGetFilename(result));
+    for_vector (ast* argNode, node->children, {
+        value* arg = run(env, argNode);
+        result = valueCall(result, arg);
+    })
+
+    return result;
+}
+
+/*Programs connected by pipes, maybe given a string for the stdin of
+  the first. Only the output of the last is read by the shell (or none,
+  if synchronous). lines as for runUnixStages.*/
+static value* runUnixPipeline (envCtx* env, const ast* node, bool* lines) {
+    /*Count the stages, nested to the left*/
+    const ast* first = node->l;
+    int n = 2;
+
+    for (; first->kind == astBOP && (first->flags & flagUnixPipeline); first = first->l)
+        n++;
+
+    /*Not a program, but its input*/
+    bool hasInput = !(first->kind == astFnApp && (first->flags & flagUnixInvocation));
+
+    if (hasInput)
+        n--;
+
+    vector(const char*) args[n];
+    char** argvs[n];
+    int listStart, listEnd;
+
+    /*Fill them in from the last*/
+    const ast* stage = node;
+
+    for (int i = n-1; i >= 0; i--) {
+        const ast* invocation = stage == first ? stage : stage->r;
+
+        if (unixCreateArgs(env, invocation, &args[i], &listStart, &listEnd)) {
+            for (int j = i+1; j < n; j++)
+                vectorFree(&args[j]);
+
+            return valueCreateInvalid();
+        }
+
+        argvs[i] = (char**) args[i].buffer;
+
+        if (stage != first)
+            stage = stage->l;
+    }
+
+    value* inputValue = hasInput ? run(env, first) : 0;
+    int skipped = 0;
+
+    /*If the first program needs splitting up, the output of its
+      batches becomes the input of the rest*/
+    if (!hasInput && unixArgsTooLong(args[0], listStart, listEnd)) {
+        inputValue = runUnixBatches(env, false, unixBatchArgs(args[0], listStart, listEnd));
+        skipped = 1;
+    }
+
+    value* result;
+
+    if (inputValue && lines)
+        *lines = false;
+
+    if (inputValue && (valueIsInvalid(inputValue) || cancelled()))
+        result = valueCreateInvalid();
 
     else {
-        for_vector (ast* argNode, node->children, {
-            value* arg = run(env, argNode);
-            result = valueCall(result, arg);
-        })
+        struct iovec* input = 0;
+        int inputs = 0;
+
+        if (inputValue)
+            input = unixCreateInput(inputValue, first->dt, &inputs);
+
+        result = runUnixStages(node, n-skipped, argvs+skipped, input, inputs, lines);
     }
 
+    for (int i = 0; i < n; i++)
+        vectorFree(&args[i]);
+
     return result;
 }
 
 /*---- Binary operators ----*/
 
-static value* pipeCall (const ast* node, const value* fn, const value* arg) {
+static value* pipeCall (bool zip, const value* fn, const value* arg) {
     value* result = valueCall(fn, arg);
 
-    if (node->op == opPipeZip)
+    if (zip)
         result = valueStoreTuple(2, result, arg);
 
     return result;
 }
 
+typedef struct mapCtx {
+    const value* fn;
+    bool zip;
+    vector(const value*) elements;
+    value** results;
+} mapCtx;
+
+static void mapChunk (mapCtx* ctx, int start, int end) {
+    for (int i = start; i < end && !cancelled(); i++)
+        ctx->results[i] = pipeCall(ctx->zip, ctx->fn, vectorGet(ctx->elements, i));
+}
+
+/*Apply a fn to the elements in parallel, one at a time per thread as
+  they're each slow, then add the results in order*/
+static void mapElements (const value* fn, bool zip, vector(const value*) elements, vector(value*)* results) {
+    mapCtx ctx = {
+        .fn = fn, .zip = zip,
+        .elements = elements,
+        .results = GC_MALLOC(sizeof(value*) * (elements.length + 1))
+    };
+
+    parallelFor(elements.length, 1, (parallelBody) mapChunk, &ctx);
+
+    for (int i = 0; i < elements.length; i++)
+        vectorPush(results, ctx.results[i] ? ctx.results[i] : valueCreateInvalid());
+}
+
+/*The state of an implicit map over a stream*/
+typedef struct lazyMapCtx {
+    const value* fn;
+    bool zip;
+    valueIter source;
+
+    /*Builtins worth running in parallel are mapped a batch at a time,
+      the results waiting here to be read*/
+    bool parallel;
+    vector(value*) ready;
+    int readyPos;
+
+    /*Read from the source but not mapped, having been cancelled. It is
+      mapped again if the stream is picked up again.*/
+    vector(const value*) batch;
+    const value* pending;
+} lazyMapCtx;
+
+static value* lazyMapNext (lazyMapCtx* ctx) {
+    if (!ctx->parallel) {
+        const value* element = ctx->pending ? ctx->pending : valueIterRead(&ctx->source);
+
+        if (!element)
+            return 0;
+
+        value* result = pipeCall(ctx->zip, ctx->fn, element);
+        ctx->pending = cancelled() ? element : 0;
+
+        return ctx->pending ? 0 : result;
+    }
+
+    int batchSize = parallelThreads() * 4;
+
+    while (ctx->readyPos == ctx->ready.length && !cancelled()) {
+        for (const value* element;
+             ctx->batch.length < batchSize && (element = valueIterRead(&ctx->source));)
+            vectorPush(&ctx->batch, element);
+
+        if (ctx->batch.length == 0)
+            return 0;
+
+        ctx->ready.length = ctx->readyPos = 0;
+        mapElements(ctx->fn, ctx->zip, ctx->batch, &ctx->ready);
+
+        /*Some results are missing, keep the batch*/
+        if (cancelled())
+            ctx->ready.length = 0;
+
+        else
+            ctx->batch.length = 0;
+    }
+
+    /*Cancelled*/
+    if (ctx->readyPos == ctx->ready.length)
+        return 0;
+
+    return vectorGet(ctx->ready, ctx->readyPos++);
+}
+
 static value* runPipe (envCtx* env, const ast* node, const value* arg, const value* fn) {
     (void) env;
 
+    bool zip = node->op == opPipeZip;
+
     /*Implicit map*/
     if (node->flags & flagListApplication) {
         valueIter iter;
@@ -271,16 +810,273 @@ static value* runPipe (envCtx* env, const ast* node, const value* arg, const val
         if (valueGetIterator(arg, &iter))
             return valueCreateInvalid();
 
+        bool parallel = builtinIsParallel(fn);
+
+        /*Map a stream only as its elements are asked for*/
+        if (valueIsLazy(arg)) {
+            lazyMapCtx* ctx = GC_MALLOC(sizeof(lazyMapCtx));
+            *ctx = (lazyMapCtx) {
+                .fn = fn, .zip = zip, .source = iter,
+                .parallel = parallel,
+                .ready = vectorInit(parallel ? parallelThreads() * 4 : 1, GC_malloc),
+                .batch = vectorInit(parallel ? parallelThreads() * 4 : 1, GC_malloc)
+            };
+
+            return valueCreateStream(ctx, (streamNextFn) lazyMapNext);
+        }
+
         vector(value*) results = vectorInit(valueGuessIterableLength(arg), GC_malloc);
 
+        if (parallel) {
+            mapElements(fn, zip, valueGetVector(arg), &results);
+            return cancelled() ? valueCreateInvalid() : valueStoreVector(results);
+        }
+
         /*Apply it to each element*/
-        for (const value* element; (element = valueIterRead(&iter));)
-            vectorPush(&results, pipeCall(node, fn, element));
+        for (const value* element; (element = valueIterRead(&iter));) {
+            if (cancelled())
+                return valueCreateInvalid();
+
+            vectorPush(&results, pipeCall(zip, fn, element));
+        }
 
         return valueStoreVector(results);
 
     } else
-        return pipeCall(node, fn, arg);
+        return pipeCall(zip, fn, arg);
+}
+
+/*---- Filter and reduce ----*/
+
+typedef struct filterCtx {
+    const value* predicate;
+    vector(const value*) elements;
+    bool* keep;
+} filterCtx;
+
+static void filterChunk (filterCtx* ctx, int start, int end) {
+    /*The rest are left out, the result is thrown away*/
+    for (int i = start; i < end && !cancelled(); i++)
+        ctx->keep[i] = valueGetInt(valueCall(ctx->predicate, vectorGet(ctx->elements, i)));
+}
+
+/*Test the elements in parallel, then add the ones kept to the results,
+  in their original order*/
+static void filterElements (const value* predicate, vector(const value*) elements, vector(value*)* results) {
+    filterCtx ctx = {
+        .predicate = predicate,
+        .elements = elements,
+        .keep = GC_MALLOC_ATOMIC(elements.length + 1)
+    };
+
+    memset(ctx.keep, 0, elements.length);
+
+    parallelFor(elements.length, runnerChunkSize, (parallelBody) filterChunk, &ctx);
+
+    for_vector_indexed (i, value* element, elements, {
+        if (ctx.keep[i])
+            vectorPush(results, element);
+    })
+}
+
+/*A stream is filtered a batch at a time, so the consumer can still
+  stop it early*/
+typedef struct lazyFilterCtx {
+    const value* predicate;
+    valueIter source;
+    /*Filtered but not yet read*/
+    vector(value*) ready;
+    int readyPos;
+    /*Read from the source but not filtered, having been cancelled, as
+      in lazyMapCtx*/
+    vector(const value*) batch;
+    /*Starts small, for consumers that only want the first few, and
+      doubles with each batch up to lazyFilterMaxBatch()*/
+    int batchSize;
+} lazyFilterCtx;
+
+static int lazyFilterMaxBatch (void) {
+    return parallelThreads() * runnerChunkSize * 4;
+}
+
+static value* lazyFilterNext (lazyFilterCtx* ctx) {
+    while (ctx->readyPos == ctx->ready.length && !cancelled()) {
+        for (const value* element;
+             ctx->batch.length < ctx->batchSize && (element = valueIterRead(&ctx->source));)
+            vectorPush(&ctx->batch, element);
+
+        if (ctx->batch.length == 0)
+            return 0;
+
+        ctx->ready.length = ctx->readyPos = 0;
+        filterElements(ctx->predicate, ctx->batch, &ctx->ready);
+
+        /*Those not tested were left out, keep the batch*/
+        if (cancelled())
+            ctx->ready.length = 0;
+
+        else {
+            ctx->batch.length = 0;
+
+            int max = lazyFilterMaxBatch();
+            ctx->batchSize = ctx->batchSize*2 < max ? ctx->batchSize*2 : max;
+        }
+    }
+
+    /*Cancelled*/
+    if (ctx->readyPos == ctx->ready.length)
+        return 0;
+
+    return vectorGet(ctx->ready, ctx->readyPos++);
+}
+
+static value* runFilter (envCtx* env, const ast* node, const value* list, const value* predicate) {
+    (void) env, (void) node;
+
+    if (valueIsLazy(list)) {
+        lazyFilterCtx* ctx = GC_MALLOC(sizeof(lazyFilterCtx));
+        *ctx = (lazyFilterCtx) {
+            .predicate = predicate,
+            .ready = vectorInit(runnerChunkSize, GC_malloc),
+            .batch = vectorInit(lazyFilterMaxBatch(), GC_malloc),
+            .batchSize = runnerChunkSize
+        };
+
+        if (valueGetIterator(list, &ctx->source))
+            return valueCreateInvalid();
+
+        return valueCreateStream(ctx, (streamNextFn) lazyFilterNext);
+    }
+
+    vector(const value*) elements = valueGetVector(list);
+    vector(value*) results = vectorInit(elements.length, GC_malloc);
+
+    filterElements(predicate, elements, &results);
+
+    /*Those not tested were left out*/
+    if (cancelled())
+        return valueCreateInvalid();
+
+    return valueStoreVector(results);
+}
+
+typedef struct reduceCtx {
+    builtinBinaryFn combine;
+    vector(const value*) elements;
+    /*The reduction of each chunk*/
+    value** partials;
+} reduceCtx;
+
+static void reduceChunk (reduceCtx* ctx, int start, int end) {
+    value* result = vectorGet(ctx->elements, start);
+
+    for (int i = start+1; i < end && !cancelled(); i++)
+        result = ctx->combine(result, vectorGet(ctx->elements, i));
+
+    ctx->partials[start / runnerReduceChunkSize] = result;
+}
+
+static value* runReduce (envCtx* env, const ast* node, const value* list, const value* fn) {
+    (void) env, (void) node;
+
+    vector(const value*) elements = valueGetVector(list);
+
+    /*No identity element to give*/
+    if (elements.length == 0)
+        return valueCreateInvalid();
+
+    builtinBinaryFn combine = builtinGetAssociative(fn);
+
+    /*An associative fn can reduce chunks independently, in parallel,
+      and then reduce the results of those*/
+    if (combine) {
+        int chunks = intdiv_roundup(elements.length, runnerReduceChunkSize);
+
+        reduceCtx ctx = {
+            .combine = combine,
+            .elements = elements,
+            .partials = GC_MALLOC(chunks * sizeof(value*))
+        };
+
+        parallelFor(elements.length, runnerReduceChunkSize, (parallelBody) reduceChunk, &ctx);
+
+        if (cancelled())
+            return valueCreateInvalid();
+
+        value* result = ctx.partials[0];
+
+        for (int i = 1; i < chunks; i++)
+            result = combine(result, ctx.partials[i]);
+
+        return result;
+
+    /*Otherwise, a left fold*/
+    } else {
+        value* result = vectorGet(elements, 0);
+
+        for (int i = 1; i < elements.length; i++) {
+            if (cancelled())
+                return valueCreateInvalid();
+
+            result = valueCall(valueCall(fn, result), vectorGet(elements, i));
+        }
+
+        /*The last call may have been cut short*/
+        return cancelled() ? valueCreateInvalid() : result;
+    }
+}
+
+/*---- ----*/
+
+static value* runWrite (envCtx* env, const ast* node, const value* from, const value* to) {
+    (void) env;
+
+    type* elements;
+
+    if (typeIsKind(type_File, node->l->dt))
+        return builtinCopyFile(from, to);
+
+    else if (typeIsListOf(node->l->dt, &elements) && typeIsKind(type_File, elements))
+        return builtinCopyFiles(from, to);
+
+    /*Rather than leave an empty file*/
+    if (valueIsInvalid(from))
+        return valueCreateInvalid();
+
+    const char* error;
+
+    if (!serializeToFile(valueGetFilename(to), node->op == opAppend, (value*) from, node->l->dt, &error)) {
+        fprintf(stderr, "error: couldn't write to %s: %s\n", valueGetDisplayFilename(to), error);
+        return valueCreateInvalid();
+    }
+
+    return (value*) to;
+}
+
+static int stderrprintf (const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vfprintf(stderr, format, args);
+    va_end(args);
+    return length;
+}
+
+static value* runLookup (envCtx* env, const ast* node, const value* table, const value* key) {
+    (void) env, (void) node;
+
+    if (valueIsInvalid(table) || valueIsInvalid(key))
+        return valueCreateInvalid();
+
+    const value* result = dictGet(valueGetDict(table), key);
+
+    if (!result) {
+        fprintf(stderr, "error: no entry for ");
+        valuePrintWith(key, stderrprintf);
+        fprintf(stderr, " in the dict\n");
+        return valueCreateInvalid();
+    }
+
+    return (value*) result;
 }
 
 static value* runArithmetic (envCtx* env, const ast* node, const value* left, const value* right) {
@@ -319,7 +1115,31 @@ static value* runConcat (envCtx* env, const ast* node, const value* left, const
     return valueStoreVector(result);
 }
 
+/*Whether the node runs programs and gives their output*/
+static bool runIsUnixOutput (const ast* node) {
+    bool programs =    (node->kind == astFnApp && (node->flags & flagUnixInvocation))
+                    || (node->kind == astBOP && (node->flags & flagUnixPipeline));
+
+    return programs && !(node->flags & flagUnixSynchronous);
+}
+
 static value* runBOP (envCtx* env, const ast* node) {
+    if (node->flags & flagUnixPipeline)
+        return runUnixPipeline(env, node, 0);
+
+    /*Programs split into lines are read as the lines are needed, so
+      that the rest of their output can be left unread*/
+    if (node->op == opPipe && !(node->flags & flagListApplication) && runIsUnixOutput(node->l)) {
+        const value* right = run(env, node->r);
+        bool lines = builtinIsLines(right);
+
+        const value* left =   node->l->kind == astBOP
+                            ? runUnixPipeline(env, node->l, &lines)
+                            : runClassicUnixApp(env, node->l, &lines);
+
+        return lines ? (value*) left : runPipe(env, node, left, right);
+    }
+
     const value *left = run(env, node->l),
                 *right = run(env, node->r);
 
@@ -328,6 +1148,14 @@ static value* runBOP (envCtx* env, const ast* node) {
     case opPipeZip:
         return runPipe(env, node, left, right);
 
+    case opFilter: return runFilter(env, node, left, right);
+    case opReduce: return runReduce(env, node, left, right);
+    case opWrite:
+    case opAppend:
+        return runWrite(env, node, left, right);
+
+    case opLookup: return runLookup(env, node, left, right);
+
     case opAdd:
     case opSubtract:
     case opMultiply:
@@ -362,6 +1190,7 @@ value* run (envCtx* env, const ast* node) {
         [astFnLit] = runFnLit,
         [astTupleLit] = runTupleLit,
         [astListLit] = runListLit,
+        [astDictLit] = runDictLit,
         [astFileLit] = runFileLit,
         [astGlobLit] = runGlobLit,
         /*Common handler*/
@@ -371,11 +1200,13 @@ value* run (envCtx* env, const ast* node) {
         [astFloatLit] = runLit,
         [astBoolLit] = runLit,
         [astStrLit] = runLit,
+        [astRegexLit] = runLit,
         /*---*/
         [astSymbol] = runSymbol,
         [astFnApp] = runFnApp,
         [astBOP] = runBOP,
-        [astLet] = runLet
+        [astLet] = runLet,
+        [astTypeHint] = runTypeHint
     };
 
     handler_t handler;
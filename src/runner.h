@@ -11,6 +11,9 @@ typedef struct envCtx {
     vector(sym*) values;
 
     dirCtx* dirs;
+    /*How many batches of a program, split up to fit its args in
+      ARG_MAX, may run at once. Zero is taken as one.*/
+    int fanout;
 } envCtx;
 
 /*Assumes well-formed input. In particular, the AST should be typed.*/
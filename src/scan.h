@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*Find the first of either of two bytes in [str, end). Returns end if
+  there is neither.
+
+  Sixteen bytes are compared at once where SSE2 is available, which is
+  what makes scanning delimited text (mostly bytes that are neither)
+  fast.*/
+static inline const char* scanFor2 (const char* str, const char* end, char a, char b) {
+#ifdef __SSE2__
+    const __m128i as = _mm_set1_epi8(a),
+                  bs = _mm_set1_epi8(b);
+
+    for (; end - str >= 16; str += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) str);
+        int found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, as),
+                                                   _mm_cmpeq_epi8(block, bs)));
+
+        if (found)
+            return str + __builtin_ctz(found);
+    }
+#endif
+
+    for (; str < end; str++)
+        if (*str == a || *str == b)
+            return str;
+
+    return end;
+}
+
+static inline bool scanIsSpace (char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*Find the first ASCII whitespace byte in [str, end), or end*/
+static inline const char* scanForSpace (const char* str, const char* end) {
+#ifdef __SSE2__
+    /*Whitespace is all at or below a space, as are only the other
+      control characters, which are rare*/
+    const __m128i spaces = _mm_set1_epi8(' ');
+
+    while (end - str >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) str);
+        int found = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(block, spaces), block));
+
+        for (; found; found &= found-1) {
+            const char* candidate = str + __builtin_ctz(found);
+
+            if (scanIsSpace(*candidate))
+                return candidate;
+        }
+
+        str += 16;
+    }
+#endif
+
+    for (; str < end; str++)
+        if (scanIsSpace(*str))
+            return str;
+
+    return end;
+}
@@ -0,0 +1,554 @@
+/*For vasprintf*/
+#define _GNU_SOURCE
+
+#include "serialize.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector.h>
+
+#include "terminal.h"
+
+#include "type.h"
+#include "value.h"
+#include "dict.h"
+#include "display.h"
+
+outputMode outputResultMode = outputDisplay;
+
+bool outputModeParse (const char* name, outputMode* mode_out) {
+    static const struct {
+        const char* name;
+        outputMode mode;
+    } modes[] = {
+        {"display", outputDisplay},
+        {"ndjson", outputNDJSON},
+        {"tsv", outputTSV},
+        {"raw", outputRaw}
+    };
+
+    for (size_t i = 0; i < sizeof(modes)/sizeof(*modes); i++) {
+        if (!strcmp(name, modes[i].name)) {
+            *mode_out = modes[i].mode;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void outputResult (value* result, type* resultType) {
+    if (outputResultMode == outputDisplay)
+        displayResult(result, resultType);
+
+    else
+        serializeResult(stdout, outputResultMode, result, resultType);
+}
+
+/*==== Text ====*/
+
+typedef void (*serialPutter)(FILE* file, const char* str, size_t length);
+
+static void putRaw (FILE* file, const char* str, size_t length) {
+    fwrite(str, 1, length, file);
+}
+
+/*Without the quotes*/
+static void putJSON (FILE* file, const char* str, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    size_t start = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = str[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        fwrite(str+start, 1, i-start, file);
+        start = i+1;
+
+        switch (c) {
+        case '"': fputs("\\\"", file); break;
+        case '\\': fputs("\\\\", file); break;
+        case '\n': fputs("\\n", file); break;
+        case '\t': fputs("\\t", file); break;
+        case '\r': fputs("\\r", file); break;
+        default:
+            fprintf(file, "\\u00%c%c", hex[c >> 4], hex[c & 0xf]);
+        }
+    }
+
+    fwrite(str+start, 1, length-start, file);
+}
+
+/*Keeps a field to its row and column*/
+static void putTSV (FILE* file, const char* str, size_t length) {
+    size_t start = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        const char* escape =   str[i] == '\t' ? "\\t"
+                             : str[i] == '\n' ? "\\n"
+                             : str[i] == '\r' ? "\\r"
+                             : str[i] == '\\' ? "\\\\"
+                             : 0;
+
+        if (!escape)
+            continue;
+
+        fwrite(str+start, 1, i-start, file);
+        fputs(escape, file);
+        start = i+1;
+    }
+
+    fwrite(str+start, 1, length-start, file);
+}
+
+/*valuePrintWith only takes a printf, so these are where it prints to*/
+static _Thread_local struct {
+    FILE* file;
+    serialPutter put;
+} serialPrintTo;
+
+static int serialPrintf (const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    char* str;
+    int length = vasprintf(&str, format, args);
+
+    va_end(args);
+
+    if (length < 0)
+        return 0;
+
+    serialPrintTo.put(serialPrintTo.file, str, length);
+    free(str);
+
+    return length;
+}
+
+/*==== Formats ====*/
+
+/*How to write a value of some type, worked out from the type once*/
+
+typedef struct serialFormat serialFormat;
+
+struct serialFormat {
+    void (*write)(const serialFormat* format, FILE* file, const value* v);
+    /*Where strings go through, escaping them for the mode*/
+    serialPutter put;
+    /*List: the format of the elements. Tuple or row: that of each field.
+      Dict: that of its entries, each written as a (key, value) tuple.*/
+    serialFormat** fields;
+    int fieldNo;
+};
+
+static void writeInt (const serialFormat* format, FILE* file, const value* v) {
+    (void) format;
+    fprintf(file, "%lld", (long long) valueGetInt(v));
+}
+
+static void writeBool (const serialFormat* format, FILE* file, const value* v) {
+    (void) format;
+    fputs(valueGetInt(v) ? "true" : "false", file);
+}
+
+/*Floats, and anything else with no better way of writing it*/
+static void writePrinted (const serialFormat* format, FILE* file, const value* v) {
+    serialPrintTo.file = file;
+    serialPrintTo.put = format->put;
+    valuePrintWith(v, serialPrintf);
+}
+
+static void writeStr (const serialFormat* format, FILE* file, const value* v) {
+    size_t length;
+    const char* str = valueGetStrWithLength(v, &length);
+    format->put(file, str, length);
+}
+
+static void writeFilename (const serialFormat* format, FILE* file, const value* v) {
+    const char* filename = valueGetDisplayFilename(v);
+    format->put(file, filename, strlen(filename));
+}
+
+static void writeQuoted (const serialFormat* format, FILE* file, const value* v) {
+    const serialFormat* unquoted = format->fields[0];
+
+    fputc('"', file);
+    unquoted->write(unquoted, file, v);
+    fputc('"', file);
+}
+
+static void writeNull (const serialFormat* format, FILE* file, const value* v) {
+    (void) format, (void) v;
+    fputs("null", file);
+}
+
+static void writeValue (const serialFormat* format, FILE* file, const value* v) {
+    /*Left as an empty field, outside of JSON*/
+    if (valueIsInvalid(v)) {
+        if (format->put == putJSON)
+            fputs("null", file);
+
+    } else
+        format->write(format, file, v);
+}
+
+/*JSON arrays, for both lists and tuples*/
+static void writeArray (const serialFormat* format, FILE* file, const value* v) {
+    fputc('[', file);
+
+    for_iterable_value_indexed (i, const value* element, v, {
+        if (i != 0)
+            fputc(',', file);
+
+        writeValue(format->fields[format->fieldNo == 1 ? 0 : i], file, element);
+    })
+
+    fputc(']', file);
+}
+
+/*A tuple as tab separated fields*/
+static void writeFields (const serialFormat* format, FILE* file, const value* v) {
+    for (int i = 0; i < format->fieldNo; i++) {
+        if (i != 0)
+            fputc('\t', file);
+
+        writeValue(format->fields[i], file, valueGetTupleNth(v, i));
+    }
+}
+
+/*A Dict within a field, as a JSON array of [key, value] arrays*/
+static void writeEntries (const serialFormat* format, FILE* file, const value* v) {
+    const dict* table = valueGetDict(v);
+
+    fputc('[', file);
+
+    for (int i = 0; i < dictGetLength(table); i++) {
+        if (i != 0)
+            fputc(',', file);
+
+        const value *key, *val;
+        dictGetNth(table, i, &key, &val);
+        writeValue(format->fields[0], file, valueStoreTuple(2, key, val));
+    }
+
+    fputc(']', file);
+}
+
+static serialFormat* serialCompileFormat (type* dt, outputMode mode);
+static serialFormat* serialCompileEntry (type* keys, type* values, outputMode mode);
+
+static serialFormat* serialCompileComposite (type* dt, serialFormat* format, outputMode mode) {
+    type* elements;
+    vector(type*) tuple;
+
+    if (typeIsListOf(dt, &elements)) {
+        format->fieldNo = 1;
+        format->fields = malloc(sizeof(serialFormat*));
+        format->fields[0] = serialCompileFormat(elements, mode);
+
+    } else if (typeIsTupleOf(dt, &tuple)) {
+        format->fieldNo = tuple.length;
+        format->fields = malloc(sizeof(serialFormat*) * tuple.length);
+
+        for_vector_indexed (i, type* field, tuple, {
+            format->fields[i] = serialCompileFormat(field, mode);
+        })
+    }
+
+    return format;
+}
+
+static serialFormat* serialCompileFormat (type* dt, outputMode mode) {
+    serialFormat* format = calloc(1, sizeof(serialFormat));
+    format->put =   mode == outputNDJSON ? putJSON
+                  : mode == outputTSV ? putTSV
+                  : putRaw;
+
+    format->write =   typeIsKind(type_Int, dt) ? writeInt
+                    : typeIsKind(type_Bool, dt) ? writeBool
+                    : typeIsKind(type_Str, dt) ? writeStr
+                    : typeIsKind(type_File, dt) ? writeFilename
+                    : writePrinted;
+
+    type *keys, *values;
+
+    /*Lists and tuples within a field are written as JSON, which never
+      has a tab or newline to get confused with those between fields*/
+    if (typeIsKind(type_List, dt) || typeIsKind(type_Tuple, dt)) {
+        format->write = writeArray;
+        format->put = putJSON;
+        return serialCompileComposite(dt, format, outputNDJSON);
+
+    } else if (typeIsDictOf(dt, &keys, &values)) {
+        format->write = writeEntries;
+        format->put = putJSON;
+        format->fieldNo = 1;
+        format->fields = malloc(sizeof(serialFormat*));
+        format->fields[0] = serialCompileEntry(keys, values, outputNDJSON);
+        return format;
+
+    } else if (mode != outputNDJSON)
+        return format;
+
+    else if (typeIsKind(type_Unit, dt))
+        format->write = writeNull;
+
+    /*Anything but a JSON number or bool is quoted: the same format,
+      made the only field of a quoting one*/
+    else if (   !typeIsKind(type_Int, dt) && !typeIsKind(type_Bool, dt)
+             && !typeIsKind(type_Float, dt)) {
+        serialFormat* quoted = calloc(1, sizeof(serialFormat));
+        quoted->write = writeQuoted;
+        quoted->put = putJSON;
+        quoted->fieldNo = 1;
+        quoted->fields = malloc(sizeof(serialFormat*));
+        quoted->fields[0] = format;
+        return quoted;
+    }
+
+    return format;
+}
+
+/*The top level of a row: outside of JSON, tuples become fields*/
+static serialFormat* serialCompileRow (type* dt, outputMode mode) {
+    if (mode == outputNDJSON || !typeIsKind(type_Tuple, dt))
+        return serialCompileFormat(dt, mode);
+
+    serialFormat* format = calloc(1, sizeof(serialFormat));
+    format->write = writeFields;
+    format->put = mode == outputTSV ? putTSV : putRaw;
+    return serialCompileComposite(dt, format, mode);
+}
+
+/*An entry of a Dict, as a row of it would be if it were a list of
+  (key, value) tuples*/
+static serialFormat* serialCompileEntry (type* keys, type* values, outputMode mode) {
+    serialFormat* format = calloc(1, sizeof(serialFormat));
+    format->write = mode == outputNDJSON ? writeArray : writeFields;
+    format->put =   mode == outputNDJSON ? putJSON
+                  : mode == outputTSV ? putTSV
+                  : putRaw;
+
+    format->fieldNo = 2;
+    format->fields = malloc(sizeof(serialFormat*) * 2);
+    format->fields[0] = serialCompileFormat(keys, mode);
+    format->fields[1] = serialCompileFormat(values, mode);
+    return format;
+}
+
+static void serialFormatFree (serialFormat* format) {
+    for (int i = 0; i < format->fieldNo; i++)
+        serialFormatFree(format->fields[i]);
+
+    free(format->fields);
+    free(format);
+}
+
+/*==== Results ====*/
+
+/*Rows read from a stream are flushed as they come, for whoever is
+  reading, unless the file is written all at once*/
+static void serializeRows (FILE* file, outputMode mode, value* result, type* resultType, bool flushRows) {
+    if (!precond(mode != outputDisplay) || typeIsKind(type_Unit, resultType))
+        return;
+
+    type *elements, *keys, *values;
+
+    /*A raw string is written exactly as it is, e.g. a file's contents*/
+    if (mode == outputRaw && typeIsKind(type_Str, resultType)) {
+        if (!valueIsInvalid(result))
+            writeStr(&(serialFormat) {.put = putRaw}, file, result);
+
+    /*Lists give a row (line) per element, written as they're read*/
+    } else if (typeIsListOf(resultType, &elements) && !valueIsInvalid(result)) {
+        serialFormat* row = serialCompileRow(elements, mode);
+
+        /*Streams may be slow to produce, so pass on each row as it comes*/
+        bool lazy = flushRows && valueIsLazy(result);
+
+        for_iterable_value (const value* element, result, {
+            if (cancelled() || ferror(file))
+                break;
+
+            writeValue(row, file, element);
+            fputc('\n', file);
+
+            if (lazy)
+                fflush(file);
+        })
+
+        serialFormatFree(row);
+
+    /*Dicts give a row per entry, its key then its value*/
+    } else if (typeIsDictOf(resultType, &keys, &values) && !valueIsInvalid(result)) {
+        serialFormat* row = serialCompileEntry(keys, values, mode);
+        const dict* table = valueGetDict(result);
+
+        for (int i = 0; i < dictGetLength(table) && !cancelled() && !ferror(file); i++) {
+            const value *key, *val;
+            dictGetNth(table, i, &key, &val);
+
+            writeValue(row, file, valueStoreTuple(2, key, val));
+            fputc('\n', file);
+        }
+
+        serialFormatFree(row);
+
+    } else {
+        serialFormat* row = serialCompileRow(resultType, mode);
+        writeValue(row, file, result);
+        fputc('\n', file);
+        serialFormatFree(row);
+    }
+
+    fflush(file);
+}
+
+void serializeResult (FILE* file, outputMode mode, value* result, type* resultType) {
+    serializeRows(file, mode, result, resultType, true);
+}
+
+/*==== Files ====*/
+
+enum {
+    /*Writes are this large, and page aligned*/
+    serialBufferSize = 1024*1024,
+    serialBufferAlign = 4096,
+    serialTempTries = 100
+};
+
+static outputMode serialModeOfFilename (const char* filename) {
+    const char *name = strrchr(filename, '/'),
+               *extension = strrchr(name ? name : filename, '.');
+
+    return   !extension ? outputRaw
+           : !strcmp(extension, ".tsv") ? outputTSV
+           : !strcmp(extension, ".ndjson") || !strcmp(extension, ".jsonl") ? outputNDJSON
+           : outputRaw;
+}
+
+/*A new file beside the one it will replace, in the same directory so
+  that it can be renamed over it. Its name is written to tempname, which
+  must have room for PATH_MAX chars.*/
+static int serialOpenTemp (const char* filename, char* tempname) {
+    static _Atomic unsigned int tempNo = 0;
+
+    const char* slash = strrchr(filename, '/');
+    int dirLength = slash ? slash - filename + 1 : 0;
+
+    for (int tries = 0; tries < serialTempTries; tries++) {
+        int length = snprintf(tempname, PATH_MAX, "%.*s.%s.%d-%u", dirLength, filename,
+                              filename + dirLength, (int) getpid(), tempNo++);
+
+        if (length >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+
+        /*The umask applies, as to any new file*/
+        int fd = open(tempname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+    }
+
+    return -1;
+}
+
+static int serialWrite (int fd, outputMode mode, value* result, type* resultType) {
+    FILE* file = fdopen(fd, "w");
+
+    if (!file) {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+
+    char* buffer = 0;
+
+    if (!posix_memalign((void**) &buffer, serialBufferAlign, serialBufferSize))
+        setvbuf(file, buffer, _IOFBF, serialBufferSize);
+
+    errno = 0;
+    serializeRows(file, mode, result, resultType, false);
+
+    int error =   ferror(file) ? (errno ? errno : EIO)
+                : cancelled() ? ECANCELED
+                : 0;
+
+    if (fclose(file) && !error)
+        error = errno;
+
+    free(buffer);
+    return error;
+}
+
+bool serializeToFile (const char* filename, bool append, value* result, type* resultType, const char** error_out) {
+    outputMode mode = serialModeOfFilename(filename);
+    struct stat st;
+    bool exists = !stat(filename, &st);
+
+    if (exists && S_ISDIR(st.st_mode)) {
+        *error_out = "it is a directory";
+        return false;
+
+    } else if (append) {
+        int fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        int error = fd < 0 ? errno : serialWrite(fd, mode, result, resultType);
+
+        if (error)
+            *error_out = strerror(error);
+
+        return !error;
+
+    /*Devices, FIFOs and the like are written to in place, as they
+      can't be replaced by renaming*/
+    } else if (exists && !S_ISREG(st.st_mode)) {
+        int fd = open(filename, O_WRONLY | O_TRUNC | O_CLOEXEC);
+        int error = fd < 0 ? errno : serialWrite(fd, mode, result, resultType);
+
+        if (error)
+            *error_out = strerror(error);
+
+        return !error;
+    }
+
+    /*Replace what a symlink points to, not the link*/
+    char real[PATH_MAX], tempname[PATH_MAX];
+
+    if (exists && realpath(filename, real))
+        filename = real;
+
+    int fd = serialOpenTemp(filename, tempname);
+
+    if (fd < 0) {
+        *error_out = strerror(errno);
+        return false;
+    }
+
+    /*Keeping the permissions of the file replaced*/
+    if (exists)
+        fchmod(fd, st.st_mode & 07777);
+
+    int error = serialWrite(fd, mode, result, resultType);
+
+    if (!error && rename(tempname, filename))
+        error = errno;
+
+    if (error) {
+        *error_out = strerror(error);
+        unlink(tempname);
+        return false;
+    }
+
+    return true;
+}
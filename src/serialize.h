@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "forward.h"
+
+typedef enum outputMode {
+    /*For people, see display.h*/
+    outputDisplay,
+    /*For other programs: a line per row of a list result*/
+    outputNDJSON,
+    outputTSV,
+    /*Strings and files unquoted and unescaped*/
+    outputRaw
+} outputMode;
+
+/*How results are written out, chosen once at startup*/
+extern outputMode outputResultMode;
+
+/*Look up an output mode by name. Returns false if there isn't one.*/
+bool outputModeParse (const char* name, outputMode* mode_out);
+
+/*Write a result the way the output mode says*/
+void outputResult (value* result, type* resultType);
+
+/*Write a value to a file in a serialized mode, row by row as the rows
+  are read (rather than the result being measured up first). Nothing is
+  written for unit results.*/
+void serializeResult (FILE* file, outputMode mode, value* result, type* resultType);
+
+/*Write a value into a file, as |> and |+> do, in the mode its extension
+  suggests: .tsv and .ndjson (or .jsonl) as those modes, anything else
+  raw. Rows go through a large buffer as they're read, so a long list
+  isn't measured up first, nor a large string copied.
+
+  A file is replaced atomically: the value is written beside it, into a
+  temporary file which takes its place once complete, so that it is
+  never seen half written. Appending writes to the end as it goes.
+
+  Returns false and the reason, a static string, if it couldn't.*/
+bool serializeToFile (const char* filename, bool append, value* result, type* resultType, const char** error_out);
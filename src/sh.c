@@ -22,12 +22,15 @@
 #include "lexer.h"
 #include "parser.h"
 #include "analyzer.h"
+#include "optimizer.h"
 
 #include "ast-printer.h"
 
 #include "value.h"
 #include "runner.h"
 #include "display.h"
+#include "serialize.h"
+#include "jobs.h"
 
 _Atomic unsigned int internalerrors = 0;
 
@@ -36,6 +39,8 @@ _Atomic unsigned int internalerrors = 0;
 typedef struct compilerCtx {
     typeSys ts;
     dirCtx dirs;
+    /*See envCtx*/
+    int fanout;
 
     sym* global;
 } compilerCtx;
@@ -72,6 +77,7 @@ compilerCtx compilerInit (void) {
     return (compilerCtx) {
         .ts = typesInit(),
         .dirs = dirsInit(),
+        .fanout = 1,
         .global = symInit()
     };
 }
@@ -92,12 +98,30 @@ void tush (compilerCtx* ctx, const char* str, bool display) {
     ast* tree = compile(ctx, str, &errors);
 
     if (errors == 0 && no_errors_recently(internalerrors)) {
+        optimize(tree);
+
+        envCtx env = {.dirs = &ctx->dirs, .fanout = ctx->fanout};
+
+        /*The job owns the tree now*/
+        if (tree->flags & flagBackground) {
+            jobsStart(env, tree, str, display);
+            return;
+        }
+
+        /*Only a Ctrl-C from now on cancels it*/
+        terminalInterrupts = 0;
+
         /*Run the AST*/
-        envCtx env = {.dirs = &ctx->dirs};
         value* result = run(&env, tree);
 
-        if (display)
-            displayResult(result, tree->dt);
+        if (display && !terminalInterrupts)
+            outputResult(result, tree->dt);
+
+        /*Either running or displaying it was cut short*/
+        if (terminalInterrupts) {
+            fprintf(stderr, "\ninterrupted\n");
+            terminalInterrupts = 0;
+        }
     }
 
     astDestroy(tree);
@@ -129,7 +153,7 @@ void replCD (compilerCtx* compiler, const char* input) {
 
     /*Types fine, try running it*/
     else {
-        value* result = run(&(envCtx) {.dirs = &compiler->dirs}, tree);
+        value* result = run(&(envCtx) {.dirs = &compiler->dirs, .fanout = compiler->fanout}, tree);
 
         if (!result || valueIsInvalid(result))
             ;
@@ -157,6 +181,20 @@ void replAST (compilerCtx* compiler, const char* input) {
     astDestroy(tree);
 }
 
+/*   :opt <expr>
+  Displays the syntax tree of a program after optimization.*/
+void replOpt (compilerCtx* compiler, const char* input) {
+    int errors = 0;
+    ast* tree = compile(compiler, input, &errors);
+
+    if (tree && !errors) {
+        optimize(tree);
+        printAST(tree);
+    }
+
+    astDestroy(tree);
+}
+
 /*   :type <expr>
   Displays the type of an expression, without running it*/
 void replType (compilerCtx* compiler, const char* input) {
@@ -198,6 +236,111 @@ void replMemStats (compilerCtx* compiler, const char* input) {
 #endif // GC_VERSION_MAJOR
 }
 
+/*   :hash [<command>]
+  Shows where a command was found in the search paths or, if not
+  given, how many commands were found in each of them.*/
+void replHash (compilerCtx* compiler, const char* input) {
+    dirCtx* dirs = &compiler->dirs;
+
+    while (isspace(*input))
+        input++;
+
+    if (*input) {
+        const char* path = dirsSearch(dirs, input);
+
+        if (path)
+            printf("%s/%s\n", path, input);
+
+        else
+            repl_errorf("no command named '%s' in the search paths\n", input);
+
+        return;
+    }
+
+    if (!dirs->commandsBuilt)
+        dirsHashCommands(dirs);
+
+    for_vector (const char* dir, dirs->searchPaths, {
+        int count = 0;
+
+        for_vector (const char* name, dirs->commandNames, {
+            count += hashmapMap(&dirs->commands, name) == dir;
+        })
+
+        printf("%6d  %s\n", count, dir);
+    })
+
+    printf("%6d  total\n", dirs->commandNames.length);
+}
+
+/*   :rehash
+  Forgets the commands found in the search paths, so that they will
+  be searched for again.*/
+void replRehash (compilerCtx* compiler, const char* input) {
+    for (; *input; input++) {
+        if (!isspace(*input)) {
+            repl_errorf(":rehash takes no arguments, given %s\n", input);
+            return;
+        }
+    }
+
+    dirsRehash(&compiler->dirs);
+}
+
+/*   :parallel [<n>]
+  Shows or sets how many batches of a program may run at once, when
+  its args have been split up to fit.*/
+void replParallel (compilerCtx* compiler, const char* input) {
+    char* end;
+    long fanout = strtol(input, &end, 10);
+
+    for (; *end; end++) {
+        if (!isspace(*end)) {
+            repl_errorf(":parallel takes a number, given %s\n", input);
+            return;
+        }
+    }
+
+    if (end == input)
+        printf("%d\n", compiler->fanout);
+
+    else if (fanout < 1)
+        repl_errorf(":parallel takes a positive number, given %ld\n", fanout);
+
+    else
+        compiler->fanout = fanout;
+}
+
+/*   :jobs
+  Lists the background jobs still running.*/
+void replJobs (compilerCtx* compiler, const char* input) {
+    (void) compiler, (void) input;
+    jobsList();
+}
+
+/*   :more [<n>]
+  Shows the next rows of the last result that were left out, a
+  screenful or n of them.*/
+void replMore (compilerCtx* compiler, const char* input) {
+    (void) compiler;
+
+    char* end;
+    long rows = strtol(input, &end, 10);
+
+    for (; *end; end++) {
+        if (!isspace(*end)) {
+            repl_errorf(":more takes a number, given %s\n", input);
+            return;
+        }
+    }
+
+    if (end != input && rows < 1)
+        repl_errorf(":more takes a positive number, given %ld\n", rows);
+
+    else if (!displayMore(rows))
+        repl_errorf("nothing more to show\n");
+}
+
 typedef struct replCommand {
     const char* name;
     size_t length;
@@ -207,7 +350,13 @@ typedef struct replCommand {
 static replCommand commands[] = {
     {"cd", strlen("cd"), replCD},
     {"ast", strlen("ast"), replAST},
+    {"opt", strlen("opt"), replOpt},
     {"type", strlen("type"), replType},
+    {"hash", strlen("hash"), replHash},
+    {"rehash", strlen("rehash"), replRehash},
+    {"parallel", strlen("parallel"), replParallel},
+    {"jobs", strlen("jobs"), replJobs},
+    {"more", strlen("more"), replMore},
     {"mem-stats", strlen("mem-stats"), replMemStats}
 };
 
@@ -270,6 +419,33 @@ void writePrompt (promptCtx* prompt, const char* wdir, const char* homedir) {
     free(wdir_contr);
 }
 
+/*Called by readline now and then while it waits for input, and when
+  a signal interrupts it*/
+static int replEventHook (void) {
+    /*A Ctrl-C at the prompt discards the line being edited*/
+    if (terminalInterrupts) {
+        terminalInterrupts = 0;
+
+        rl_replace_line("", false);
+        rl_point = 0;
+
+        fputc('\n', rl_outstream);
+        rl_on_new_line();
+        rl_redisplay();
+    }
+
+    /*Jobs finishing are shown straight away, above a fresh prompt*/
+    if (jobsFinished()) {
+        /*Clear the line being edited, it gets redrawn after*/
+        printf("\r\033[K");
+        jobsReport();
+        rl_on_new_line();
+        rl_redisplay();
+    }
+
+    return 0;
+}
+
 void repl (compilerCtx* compiler) {
     const char* homedir = getHomeDir();
 
@@ -286,7 +462,12 @@ void repl (compilerCtx* compiler) {
     promptCtx prompt = {.size = 1024};
     prompt.str = malloc(prompt.size);
 
+    rl_event_hook = replEventHook;
+    rl_signal_event_hook = replEventHook;
+
     while (true) {
+        jobsReport();
+
         /*Regenerate the prompt (if necessary)*/
         writePrompt(&prompt, compiler->dirs.workingDirDisplay, homedir);
 
@@ -333,17 +514,38 @@ int main (int argc, char** argv) {
     compilerCtx compiler = compilerInit();
     addBuiltins(&compiler.ts, compiler.global);
 
-    if (argc == 1)
+    /*The options come before the command*/
+    int args = 1;
+
+    const char* outputOption = "--output=";
+
+    if (argc > 1 && !strncmp(argv[1], outputOption, strlen(outputOption))) {
+        const char* mode = argv[1] + strlen(outputOption);
+
+        if (!outputModeParse(mode, &outputResultMode)) {
+            fprintf(stderr, "Unknown output mode '%s', expected display, ndjson, tsv or raw\n", mode);
+            compilerFree(&compiler);
+            return 1;
+        }
+
+        args++;
+    }
+
+    if (argc == args)
         repl(&compiler);
 
-    else if (argc == 2)
-        tush(&compiler, argv[1], true);
+    else if (argc == args+1)
+        tush(&compiler, argv[args], true);
 
     else {
-        char* input = strjoinwith(argc, argv, " ", malloc);
+        char* input = strjoinwith(argc-args, argv+args, " ", malloc);
         tush(&compiler, input, true);
         free(input);
     }
 
+    /*Don't leave any jobs unfinished*/
+    jobsWait();
+    jobsReport();
+
     compilerFree(&compiler);
 }
@@ -18,6 +18,9 @@ typedef struct sym {
     char* name;
     type* dt;
     value* val;
+    /*Calling it has effects, such as writing files, so the optimizer
+      leaves it where it is*/
+    bool effects;
 
     sym* parent;
     vector(sym*) children;
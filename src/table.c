@@ -0,0 +1,382 @@
+/*For O_CLOEXEC*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "table.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gc.h>
+#include <vector.h>
+
+#include "scan.h"
+
+#include "type.h"
+#include "value.h"
+
+enum {
+    tableBlockSize = 64*1024
+};
+
+/*==== Reading ====*/
+
+/*The unread part of the file is [start, length) of the buffer. Of that,
+  up to scanned has been searched for the end of the row, with quoted
+  saying whether the scan finished inside quotes.*/
+typedef struct tableReader {
+    int fd;
+    char delimiter;
+    bool ended;
+
+    char* buffer;
+    size_t start, scanned, length, capacity;
+    bool quoted;
+} tableReader;
+
+static void tableReaderClose (tableReader* reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+/*Streams that are abandoned before they end still close their file*/
+static void tableReaderFinalize (void* reader, void* data) {
+    (void) data;
+    tableReaderClose(reader);
+}
+
+/*Read another block, first moving the unread part to the front (or a
+  bigger buffer, if a row doesn't fit). Sets ended at the end of the file.*/
+static void tableFill (tableReader* reader) {
+    size_t unread = reader->length - reader->start;
+
+    /*Always leave room for a terminator after the last field*/
+    if (unread + tableBlockSize + 1 > reader->capacity) {
+        reader->capacity = 2*(unread + tableBlockSize + 1);
+        char* buffer = GC_MALLOC_ATOMIC(reader->capacity);
+
+        if (unread)
+            memcpy(buffer, reader->buffer + reader->start, unread);
+
+        reader->buffer = buffer;
+
+    } else
+        memmove(reader->buffer, reader->buffer + reader->start, unread);
+
+    reader->scanned -= reader->start;
+    reader->length = unread;
+    reader->start = 0;
+
+    ssize_t got;
+
+    do {
+        got = read(reader->fd, reader->buffer + reader->length, tableBlockSize);
+    } while (got < 0 && errno == EINTR);
+
+    if (got <= 0) {
+        reader->ended = true;
+        tableReaderClose(reader);
+
+    } else
+        reader->length += got;
+}
+
+/*Find the newline ending the row that starts at start, if it has been
+  read. Newlines inside quotes are part of a field. A "" inside quotes
+  leaves and reenters them, which comes to the same thing.*/
+static bool tableFindRowEnd (tableReader* reader, size_t* rowEnd_out) {
+    const char *str = reader->buffer + reader->scanned,
+               *end = reader->buffer + reader->length;
+
+    for (; (str = scanFor2(str, end, '"', '\n')) != end; str++) {
+        if (*str == '"')
+            reader->quoted = !reader->quoted;
+
+        else if (!reader->quoted) {
+            *rowEnd_out = str - reader->buffer;
+            reader->scanned = *rowEnd_out + 1;
+            return true;
+        }
+    }
+
+    reader->scanned = reader->length;
+    return false;
+}
+
+/*Split a row, [str, end), into fields. This writes over the row, to
+  unescape quotes and terminate each field. Returns null for a blank line.*/
+static value* tableSplitRow (char* str, char* end, char delimiter) {
+    if (end != str && end[-1] == '\r')
+        end--;
+
+    if (end == str)
+        return 0;
+
+    vector(value*) fields = vectorInit(8, GC_malloc);
+
+    for (;;) {
+        /*Where the field is written, and the rest of it read from*/
+        char *field = str,
+             *rest = str;
+
+        if (rest != end && *rest == '"') {
+            char* to = field;
+            rest++;
+
+            for (char* quote; (quote = memchr(rest, '"', end - rest)); ) {
+                memmove(to, rest, quote - rest);
+                to += quote - rest;
+                rest = quote+1;
+
+                /*An escaped quote, or the end of the quotes*/
+                if (rest != end && *rest == '"') {
+                    *to++ = '"';
+                    rest++;
+
+                } else
+                    break;
+            }
+
+            /*Anything else up to the delimiter is kept as is*/
+            char* delimiter_ = memchr(rest, delimiter, end - rest);
+            char* fieldEnd = delimiter_ ? delimiter_ : end;
+
+            memmove(to, rest, fieldEnd - rest);
+            to += fieldEnd - rest;
+            rest = fieldEnd;
+            *to = 0;
+
+        } else {
+            char* delimiter_ = memchr(rest, delimiter, end - rest);
+            rest = delimiter_ ? delimiter_ : end;
+        }
+
+        bool last = rest == end;
+        *rest = 0;
+
+        vectorPush(&fields, valueCreateStr(field));
+
+        if (last)
+            break;
+
+        str = rest+1;
+    }
+
+    return valueStoreVector(fields);
+}
+
+static value* tableNext (tableReader* reader) {
+    for (;;) {
+        size_t rowEnd;
+        value* row = 0;
+
+        if (tableFindRowEnd(reader, &rowEnd)) {
+            row = tableSplitRow(reader->buffer + reader->start, reader->buffer + rowEnd,
+                                reader->delimiter);
+            reader->start = rowEnd+1;
+
+        /*A last row without a newline*/
+        } else if (reader->ended) {
+            if (reader->start == reader->length)
+                return 0;
+
+            row = tableSplitRow(reader->buffer + reader->start, reader->buffer + reader->length,
+                                reader->delimiter);
+            reader->start = reader->scanned = reader->length;
+
+        } else
+            tableFill(reader);
+
+        if (row)
+            return row;
+    }
+}
+
+static char tableGuessDelimiter (const char* filename, tableReader* reader) {
+    const char* extension = strrchr(filename, '.');
+
+    if (extension && (!strcmp(extension, ".tsv") || !strcmp(extension, ".tab")))
+        return '\t';
+
+    else if (extension && !strcmp(extension, ".csv"))
+        return ',';
+
+    /*Look at the first line*/
+    tableFill(reader);
+
+    const char *line = reader->buffer,
+               *lineEnd = memchr(line, '\n', reader->length);
+
+    if (!lineEnd)
+        lineEnd = line + reader->length;
+
+    bool tabs = memchr(line, '\t', lineEnd - line),
+         commas = memchr(line, ',', lineEnd - line);
+
+    return tabs && !commas ? '\t' : ',';
+}
+
+value* tableRead (const char* filename) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return valueCreateInvalid();
+
+    tableReader* reader = GC_MALLOC(sizeof(tableReader));
+    *reader = (tableReader) {.fd = fd};
+
+    GC_REGISTER_FINALIZER(reader, tableReaderFinalize, 0, 0, 0);
+
+    reader->delimiter = tableGuessDelimiter(filename, reader);
+
+    return valueCreateStream(reader, (streamNextFn) tableNext);
+}
+
+/*==== Typing ====*/
+
+/*Parse a field, or return null if it isn't one of this type*/
+typedef value* (*tableFieldFn)(char* str, const char* workingDir);
+
+static value* tableFieldStr (char* str, const char* workingDir) {
+    (void) workingDir;
+    return valueCreateStr(str);
+}
+
+static value* tableFieldInt (char* str, const char* workingDir) {
+    (void) workingDir;
+
+    char* end;
+    errno = 0;
+    long long integer = strtoll(str, &end, 10);
+
+    while (*end == ' ')
+        end++;
+
+    if (end == str || *end || errno)
+        return 0;
+
+    return valueCreateInt(integer);
+}
+
+static value* tableFieldBool (char* str, const char* workingDir) {
+    (void) workingDir;
+
+    if (!strcasecmp(str, "true") || !strcmp(str, "1"))
+        return valueCreateInt(true);
+
+    else if (!strcasecmp(str, "false") || !strcmp(str, "0"))
+        return valueCreateInt(false);
+
+    else
+        return 0;
+}
+
+static value* tableFieldFile (char* str, const char* workingDir) {
+    if (!*str)
+        return 0;
+
+    return valueCreateFile(str, str[0] == '/' ? 0 : workingDir);
+}
+
+static tableFieldFn tableGetFieldFn (type* dt) {
+    return   typeIsKind(type_Str, dt) ? tableFieldStr
+           : typeIsKind(type_Int, dt) ? tableFieldInt
+           : typeIsKind(type_Bool, dt) ? tableFieldBool
+           : typeIsKind(type_File, dt) ? tableFieldFile
+           : 0;
+}
+
+bool tableCanConvert (type* from, type* to) {
+    type *fromRows, *fields, *toRows;
+    vector(type*) tuple;
+
+    bool rowsOfStrs =    typeIsListOf(from, &fromRows)
+                      && typeIsListOf(fromRows, &fields)
+                      && typeIsKind(type_Str, fields);
+
+    if (   !rowsOfStrs
+        || !typeIsListOf(to, &toRows)
+        || !typeIsTupleOf(toRows, &tuple))
+        return false;
+
+    for_vector (type* field, tuple, {
+        if (!tableGetFieldFn(field))
+            return false;
+    })
+
+    return true;
+}
+
+typedef struct tableConversion {
+    valueIter rows;
+    const char* workingDir;
+    int fieldNo;
+    tableFieldFn* fields;
+} tableConversion;
+
+/*Fields that don't fit their type are left invalid*/
+static value* tableConvertRow (tableConversion* conversion, const value* row, bool* fits_out) {
+    value* fields[conversion->fieldNo];
+    *fits_out = true;
+
+    for (int i = 0; i < conversion->fieldNo; i++) {
+        const value* str = valueGetTupleNth(row, i);
+        fields[i] = str ? conversion->fields[i]((char*) valueGetStr(str), conversion->workingDir) : 0;
+
+        if (!fields[i]) {
+            fields[i] = valueCreateInvalid();
+            *fits_out = false;
+        }
+    }
+
+    return valueStoreArray(conversion->fieldNo, fields);
+}
+
+static value* tableConvertNext (tableConversion* conversion) {
+    const value* row = valueIterRead(&conversion->rows);
+
+    if (!row)
+        return 0;
+
+    bool fits;
+    value* converted = tableConvertRow(conversion, row, &fits);
+
+    /*Skip a header*/
+    if (!fits && conversion->rows.index == 0) {
+        if (!(row = valueIterRead(&conversion->rows)))
+            return 0;
+
+        converted = tableConvertRow(conversion, row, &fits);
+    }
+
+    return converted;
+}
+
+value* tableConvert (const value* rows, type* to, const char* workingDir) {
+    type* toRows;
+    vector(type*) tuple;
+
+    if (   !precond(typeIsListOf(to, &toRows) && typeIsTupleOf(toRows, &tuple))
+        || valueIsInvalid(rows))
+        return valueCreateInvalid();
+
+    tableConversion* conversion = GC_MALLOC(sizeof(tableConversion));
+    *conversion = (tableConversion) {
+        .workingDir = workingDir,
+        .fieldNo = tuple.length,
+        .fields = GC_MALLOC_ATOMIC(sizeof(tableFieldFn) * tuple.length)
+    };
+
+    valueGetIterator(rows, &conversion->rows);
+
+    for_vector_indexed (i, type* field, tuple, {
+        conversion->fields[i] = tableGetFieldFn(field);
+    })
+
+    return valueCreateStream(conversion, (streamNextFn) tableConvertNext);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "forward.h"
+
+/*Read a CSV or TSV file as a list of rows of fields, [[Str]]. The file
+  is read a block at a time as the rows are asked for, so taking the
+  first few rows of a huge file only reads its start.
+
+  Fields are separated by tabs if the file is named .tsv or .tab, or if
+  its first line has tabs but no commas. Otherwise by commas. Fields may
+  be quoted, with "" for a quote, and can then contain newlines.
+  Returns an invalid value if the file can't be opened.*/
+value* tableRead (const char* filename);
+
+/*Whether rows of strings can be converted to rows of the given type:
+  a tuple of Str, Int, Bool and File fields*/
+bool tableCanConvert (type* from, type* to);
+
+/*Convert a list of rows of strings to tuples of the fields of a type
+  that tableCanConvert allows, lazily. A first row that doesn't fit the
+  types is taken to be a header, and left out.
+  Files are relative to a (GC allocated) directory.*/
+value* tableConvert (const value* rows, type* to, const char* workingDir);
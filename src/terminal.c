@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <sys/ioctl.h>
 
+cancelToken terminalInterrupts = 0;
+_Thread_local cancelToken* threadCancelToken = &terminalInterrupts;
+
 unsigned int getWindowWidth (void) {
     struct winsize size;
     ioctl(0, TIOCGWINSZ, &size);
@@ -12,6 +15,13 @@ unsigned int getWindowWidth (void) {
     return size.ws_col;
 }
 
+unsigned int getWindowHeight (void) {
+    struct winsize size;
+    ioctl(0, TIOCGWINSZ, &size);
+
+    return size.ws_row;
+}
+
 static int vfprintf_style (FILE* file, const char* roformat, va_list args) {
     int printed = 0;
 
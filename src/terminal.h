@@ -2,6 +2,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #define styleBlack   "\e[1;30m"
 #define styleRed     "\e[1;31m"
@@ -15,7 +16,27 @@
 
 void terminalInit (void);
 
+/*==== Cancellation ====*/
+
+/*Counts the requests for some work to stop. Work checks the token of
+  its thread at the points where it iterates, and winds down early,
+  giving an invalid value.*/
+typedef _Atomic int cancelToken;
+
+/*Counts Ctrl-Cs, reset before each command*/
+extern cancelToken terminalInterrupts;
+
+/*The token checked by this thread. Every thread starts with the
+  terminal's; background jobs have their own, and threads helping with
+  some work should take that of the thread they help.*/
+extern _Thread_local cancelToken* threadCancelToken;
+
+static inline bool cancelled (void) {
+    return threadCancelToken && *threadCancelToken != 0;
+}
+
 unsigned int getWindowWidth (void);
+unsigned int getWindowHeight (void);
 
 int printf_style (const char* format, ...);
 int fprintf_style (FILE* file, const char* format, ...);
@@ -3,7 +3,8 @@
 #include "common.h"
 
 typedef enum tokenKind {
-    tokenNormal, tokenOp, tokenKeyword, tokenIntLit, tokenStrLit, tokenCharLit, tokenEOF
+    tokenNormal, tokenOp, tokenKeyword, tokenIntLit, tokenStrLit, tokenCharLit,
+    tokenRegexLit, tokenEOF
 } tokenKind;
 
 typedef struct token {
@@ -14,6 +14,10 @@ typedef struct type {
         type* elements;
         /*Tuple*/
         vector(type*) types;
+        /*Dict*/
+        struct {
+            type *keys, *values;
+        };
         /*Forall*/
         struct {
             type* typevar;
@@ -28,7 +32,7 @@ typedef struct type {
 
 static inline bool typeKindIsntUnitary (typeKind kind) {
     return    kind == type_Fn || kind == type_List || kind == type_Tuple
-           || kind == type_Var || kind == type_Forall;
+           || kind == type_Dict || kind == type_Var || kind == type_Forall;
 }
 
 /*==== Unification ====*/
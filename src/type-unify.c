@@ -200,6 +200,10 @@ static bool typeUnifies (typeSys* ts, inferences* infs, const type* l, const typ
         case type_List:
             return typeUnifies(ts, infs, l->elements, r->elements);
 
+        case type_Dict:
+            return    typeUnifies(ts, infs, l->keys, r->keys)
+                   && typeUnifies(ts, infs, l->values, r->values);
+
         case type_Tuple:
             if (l->types.length != r->types.length)
                 return false;
@@ -237,6 +241,11 @@ static type* typeMakeSubs (typeSys* ts, const inferences* infs, const type* dt)
         return typeList(ts, typeMakeSubs(ts, infs, dt->elements));
     }
 
+    case type_Dict: {
+        return typeDict(ts, typeMakeSubs(ts, infs, dt->keys),
+                            typeMakeSubs(ts, infs, dt->values));
+    }
+
     case type_Tuple: {
         vector(type*) types = vectorInit(dt->types.length, malloc);
 
@@ -61,6 +61,12 @@ type* typeTuple (typeSys* ts, vector(type*) types) {
     });
 }
 
+type* typeDict (typeSys* ts, type* keys, type* values) {
+    return typeNonUnitary(ts, type_Dict, (type) {
+        .keys = keys, .values = values
+    });
+}
+
 type* typeVar (typeSys* ts) {
     return typeNonUnitary(ts, type_Var, (type) {});
 }
@@ -139,6 +145,7 @@ static const char* typeGetStrImpl (strCtx* ctx, type* dt, bool implicitQuantifie
     case type_Bool: return "Bool";
     case type_Str: return "Str";
     case type_File: return "File";
+    case type_Regex: return "Regex";
     case type_Invalid: return "<invalid>";
     case type_KindNo: return "<KindNo, not real>";
 
@@ -170,6 +177,18 @@ static const char* typeGetStrImpl (strCtx* ctx, type* dt, bool implicitQuantifie
         return dt->str;
     }
 
+    case type_Dict: {
+        const char *keys = typeGetStrImpl(ctx, dt->keys, false),
+                   *values = typeGetStrImpl(ctx, dt->values, false);
+
+        bool allocSuccess = 0 != asprintf(&dt->str, "[%s: %s]", keys, values);
+
+        if (!precond(allocSuccess))
+            return "[ : ]";
+
+        return dt->str;
+    }
+
     case type_Tuple: {
         /*Note: VLA*/
         const char* typeStrs[dt->types.length];
@@ -288,6 +307,10 @@ bool typeIsEqual (const type* l, const type* r) {
         case type_List:
             return typeIsEqual(l->elements, r->elements);
 
+        case type_Dict:
+            return    typeIsEqual(l->keys, r->keys)
+                   && typeIsEqual(l->values, r->values);
+
         case type_Tuple:
             if (l->types.length != r->types.length)
                 return false;
@@ -342,8 +365,9 @@ bool typeAppliesToFn (typeSys* ts, const type* arg, const type* fn, type** resul
     else if (fn->kind == type_Fn) {
         applies = typeIsEqual(fn->from, arg);
 
-    /*The function is quantified, so find the types which satisfy this application*/
-    } else if (fn->kind == type_Forall && fn->dt->kind == type_Fn) {
+    /*The function is quantified (over any number of typevars), so find
+      the types which satisfy this application*/
+    } else if (fn->kind == type_Forall) {
         fn = unifyArgWithFn(ts, arg, fn);
 		applies = fn != 0;
 
@@ -387,6 +411,21 @@ bool typeIsTupleOf (const type* dt, vector(const type*)* types) {
         return false;
 }
 
+bool typeIsDictOf (const type* dt, type** keys, type** values) {
+    if (!precond(dt))
+        return false;
+
+    seeThroughQuantifier(&dt);
+
+    if (dt->kind == type_Dict) {
+        *keys = dt->keys;
+        *values = dt->values;
+        return true;
+
+    } else
+        return false;
+}
+
 bool typeCanUnify (typeSys* ts, const type* l, const type* r, type** result) {
     *result = unifyMatching(ts, l, r);
     return *result != 0;
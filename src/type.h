@@ -6,8 +6,8 @@ typedef enum typeKind {
     type_Unit,
     type_Int, type_Float, type_Bool,
     type_Str,
-    type_File,
-    type_Fn, type_List, type_Tuple,
+    type_File, type_Regex,
+    type_Fn, type_List, type_Tuple, type_Dict,
     type_Var, type_Forall,
     type_Invalid,
     type_KindNo
@@ -37,6 +37,7 @@ type* typeUnitary (typeSys* ts, typeKind kind);
 type* typeFn (typeSys* ts, type* from, type* to);
 type* typeList (typeSys* ts, type* elements);
 type* typeTuple (typeSys* ts, vector(type*) types);
+type* typeDict (typeSys* ts, type* keys, type* values);
 
 type* typeVar (typeSys* ts);
 type* typeForall (typeSys* ts, type* typevar, type* dt);
@@ -67,5 +68,6 @@ bool typeAppliesToFn (typeSys* ts, const type* arg, const type* fn, type** resul
 
 bool typeIsListOf (const type* dt, type** elements);
 bool typeIsTupleOf (const type* dt, vector(const type*)* types);
+bool typeIsDictOf (const type* dt, type** keys, type** values);
 
 bool typeCanUnify (typeSys* ts, const type* l, const type* r, type** result);
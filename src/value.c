@@ -1,18 +1,40 @@
+/*For clock_gettime*/
+#define _XOPEN_SOURCE 700
+
 #include "value.h"
 
 #include <stdio.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <gc.h>
 #include <common.h>
 
 #include "sym.h"
+#include "regex.h"
 #include "runner.h"
+#include "terminal.h"
+#include "dict.h"
+#include "hash.h"
 
 typedef enum valueKind {
-    valueInvalid, valueUnit, valueInt, valueFloat, valueStr, valueFile,
+    valueInvalid, valueUnit, valueInt, valueFloat, valueStr, valueFile, valueRegex,
     valueFn, valueSimpleClosure, valueASTClosure,
-    valuePair, valueTriple, valueVector,
+    valuePair, valueTriple, valueVector, valueStream, valueFuture, valueDict
 } valueKind;
 
+typedef struct futureSync {
+    pthread_mutex_t lock;
+    pthread_cond_t resolved;
+    /*Null until resolved*/
+    value* result;
+    /*Deferred: how to compute it, and whether a thread is*/
+    deferredFn deferred;
+    void* deferredState;
+    bool computing;
+} futureSync;
+
 typedef struct value {
     valueKind kind;
 
@@ -27,6 +49,16 @@ typedef struct value {
         struct {
             const char* str;
             size_t strlen;
+            /*Null if GC allocated, see valueStoreStr*/
+            strReleaseFn strRelease;
+            /*A view of part of another string keeps that one alive.
+              It may not be null terminated, in which case valueGetStr
+              makes a terminated copy when asked, once. The copy is
+              published atomically as the view may be shared between
+              threads.*/
+            const value* strParent;
+            bool strTerminated;
+            _Atomic(const char*) strCopy;
         };
 
         /*File*/
@@ -38,6 +70,9 @@ typedef struct value {
             const char* absolute;
         };
 
+        /*Regex*/
+        const regex* re;
+
         /*Fn*/
         value* (*fnptr)(const value*);
 
@@ -52,11 +87,31 @@ typedef struct value {
             const vector(sym*)* argSymbols;
             const vector(value*)* argValues;
             ast* body;
+            /*For the paths and programs in the body*/
+            dirCtx* dirs;
         };
 
         /*Vector*/
         vector(value*) vec; //todo array(value*)
 
+        /*Stream*/
+        struct {
+            streamNextFn next;
+            void* streamState;
+            /*The elements produced so far*/
+            vector(value*) produced;
+            bool streamEnded;
+            /*Held while producing or reading the elements, as a stream
+              may be read by many threads at once*/
+            pthread_mutex_t* streamLock;
+        };
+
+        /*Future*/
+        futureSync* future;
+
+        /*Dict*/
+        const dict* table;
+
         /*Pair Triple*/
         struct {
             value *first, *second, *third;
@@ -79,7 +134,7 @@ value* valueCreateUnit (void) {
     return valueCreate(valueUnit, (value) {});
 }
 
-value* valueCreateInt (int integer) {
+value* valueCreateInt (int64_t integer) {
     return valueCreate(valueInt, (value) {
         .integer = integer
     });
@@ -95,7 +150,48 @@ value* valueCreateStr (char* str) {
     size_t length = strlen(str);
 
     return valueCreate(valueStr, (value) {
-        .str = strcpy(GC_MALLOC(length+1), str), .strlen = length
+        .str = strcpy(GC_MALLOC(length+1), str), .strlen = length,
+        .strTerminated = true
+    });
+}
+
+static void valueStrFinalize (void* str, void* data) {
+    (void) data;
+
+    value* v = str;
+    v->strRelease(v->str, v->strlen);
+}
+
+value* valueStoreStr (const char* str, size_t length, strReleaseFn release) {
+    value* v = valueCreate(valueStr, (value) {
+        .str = str, .strlen = length, .strRelease = release,
+        .strTerminated = true
+    });
+
+    if (release)
+        GC_REGISTER_FINALIZER(v, valueStrFinalize, 0, 0, 0);
+
+    return v;
+}
+
+value* valueCreateStrView (const value* parent, const char* str, size_t length) {
+    if (!precond(parent->kind == valueStr))
+        return valueCreateInvalid();
+
+    /*Views of views are of the original, which is null terminated, so
+      the byte after the view can be read*/
+    if (parent->strParent)
+        parent = parent->strParent;
+
+    return valueCreate(valueStr, (value) {
+        .str = str, .strlen = length, .strParent = parent,
+        .strTerminated = str[length] == 0
+    });
+}
+
+value* valueCreateRegex (const regex* re) {
+    return valueCreate(valueRegex, (value) {
+        .re = re
     });
 }
 
@@ -107,6 +203,26 @@ value* valueCreateFile (const char* filename, const char* relativeTo) {
     });
 }
 
+value* valueCreateFileIn (const value* dir, const char* name) {
+    if (!precond(dir && dir->kind == valueFile))
+        return valueCreateInvalid();
+
+    /*Inside ".", the name alone*/
+    const char* dirname = strcmp(dir->filename, ".") ? dir->filename : "";
+
+    size_t length = strlen(dirname) + strlen(name) + 2;
+    bool slash = dirname[0] && dirname[strlen(dirname)-1] != '/';
+
+    char* filename = GC_MALLOC_ATOMIC(length);
+    snprintf(filename, length, slash ? "%s/%s" : "%s%s", dirname, name);
+
+    return valueCreate(valueFile, (value) {
+        .filename = filename,
+        .relativeTo = dir->relativeTo,
+        .absolute = 0
+    });
+}
+
 value* valueCreateFn (value* (*fnptr)(const value*)) {
     return valueCreate(valueFn, (value) {
         .fnptr = fnptr
@@ -119,11 +235,13 @@ value* valueCreateSimpleClosure (const void* env, simpleClosureFn fnptr) {
     });
 }
 
-value* valueCreateASTClosure (vector(sym*) argSymbols, vector(value*) argValues, ast* body) {
+value* valueCreateASTClosure (vector(sym*) argSymbols, vector(value*) argValues, ast* body,
+                              dirCtx* dirs) {
     return valueCreate(valueASTClosure, (value) {
         .argSymbols = alloci(sizeof(vector), &argSymbols, GC_malloc),
         .argValues = alloci(sizeof(vector), &argValues, GC_malloc),
-        .body = body
+        .body = body,
+        .dirs = dirs
     });
 }
 
@@ -145,6 +263,48 @@ static value* valueCreateVector (vector(value*) elements) {
     });
 }
 
+value* valueCreateStream (void* state, streamNextFn next) {
+    pthread_mutex_t* lock = GC_MALLOC_ATOMIC(sizeof(pthread_mutex_t));
+    pthread_mutex_init(lock, 0);
+
+    return valueCreate(valueStream, (value) {
+        .next = next, .streamState = state,
+        .produced = vectorInit(16, GC_malloc),
+        .streamEnded = false,
+        .streamLock = lock
+    });
+}
+
+value* valueCreateFuture (void) {
+    futureSync* future = GC_MALLOC(sizeof(futureSync));
+    pthread_mutex_init(&future->lock, 0);
+    pthread_cond_init(&future->resolved, 0);
+    future->result = 0;
+
+    return valueCreate(valueFuture, (value) {
+        .future = future
+    });
+}
+
+value* valueCreateDeferred (void* state, deferredFn fn) {
+    value* v = valueCreateFuture();
+    v->future->deferred = fn;
+    v->future->deferredState = state;
+    return v;
+}
+
+void valueFutureResolve (value* v, value* result) {
+    if (!precond(v->kind == valueFuture && result))
+        return;
+
+    futureSync* future = v->future;
+
+    pthread_mutex_lock(&future->lock);
+    future->result = result;
+    pthread_cond_broadcast(&future->resolved);
+    pthread_mutex_unlock(&future->lock);
+}
+
 value* valueCreateInvalid (void) {
     static value* invalid;
 
@@ -200,6 +360,12 @@ value* valueStoreVector (vector(value*) v) {
     return valueCreateVector(v);
 }
 
+value* valueStoreDict (const dict* table) {
+    return valueCreate(valueDict, (value) {
+        .table = table
+    });
+}
+
 /*==== ====*/
 
 const char* valueKindGetStr (valueKind kind) {
@@ -212,9 +378,13 @@ const char* valueKindGetStr (valueKind kind) {
     case valueSimpleClosure: return "SimpleClosure";
     case valueASTClosure: return "ASTClosure";
     case valueFile: return "File";
+    case valueRegex: return "Regex";
     case valuePair: return "Pair";
     case valueTriple: return "Triple";
     case valueVector: return "Vector";
+    case valueStream: return "Stream";
+    case valueFuture: return "Future";
+    case valueDict: return "Dict";
     case valueInvalid: return "<Invalid value>";
     }
 
@@ -227,7 +397,57 @@ bool valueIsInvalid (const value* v) {
     return !v || v->kind == valueInvalid;
 }
 
-int valuePrintImpl (const value* v, printf_t printf) {
+bool valueIsFuture (const value* v) {
+    return v && v->kind == valueFuture;
+}
+
+value* valueAwait (value* v) {
+    if (!valueIsFuture(v))
+        return v;
+
+    futureSync* future = v->future;
+
+    pthread_mutex_lock(&future->lock);
+
+    while (!future->result && !cancelled()) {
+        /*Deferred, and no other thread is computing it*/
+        if (future->deferred && !future->computing) {
+            future->computing = true;
+            pthread_mutex_unlock(&future->lock);
+
+            value* result = future->deferred(future->deferredState);
+
+            pthread_mutex_lock(&future->lock);
+            future->computing = false;
+
+            /*Maybe incomplete, so left to be computed again*/
+            if (!cancelled())
+                future->result = result;
+
+            pthread_cond_broadcast(&future->resolved);
+            continue;
+        }
+
+        /*Waking now and then to see if the wait has been cancelled*/
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 50*1000*1000;
+
+        if (until.tv_nsec >= 1000*1000*1000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000*1000*1000;
+        }
+
+        pthread_cond_timedwait(&future->resolved, &future->lock, &until);
+    }
+
+    value* result = future->result ? future->result : valueCreateInvalid();
+    pthread_mutex_unlock(&future->lock);
+
+    return result;
+}
+
+int valuePrintWith (const value* v, printf_t printf) {
     if (!precond(v))
         return printf("<null>");
 
@@ -243,7 +463,7 @@ int valuePrintImpl (const value* v, printf_t printf) {
 
     case valueStr:
         //todo escape
-        return printf("\"%s\"", v->str);
+        return printf("\"%.*s\"", (int) v->strlen, v->str);
 
     case valueFn:
         return printf("<fn at %p>", v->fnptr);
@@ -257,6 +477,9 @@ int valuePrintImpl (const value* v, printf_t printf) {
     case valueFile:
         return printf("%s", v->filename);
 
+    case valueRegex:
+        return printf("r\"%s\"", regexGetPattern(v->re));
+
     case valuePair:
         return printf("<pair>");
 
@@ -266,6 +489,15 @@ int valuePrintImpl (const value* v, printf_t printf) {
     case valueVector:
         return printf("<vector of %d>", v->vec.length);
 
+    case valueStream:
+        return printf("<stream of %d so far>", v->produced.length);
+
+    case valueFuture:
+        return printf("<future>");
+
+    case valueDict:
+        return printf("<dict of %d>", dictGetLength(v->table));
+
     case valueInvalid:
         return printf("<invalid>");
     }
@@ -275,11 +507,11 @@ int valuePrintImpl (const value* v, printf_t printf) {
 }
 
 int valueGetWidthOfStr (const value* v) {
-    return valuePrintImpl(v, dryprintf);
+    return valuePrintWith(v, dryprintf);
 }
 
 int valuePrint (const value* v) {
-    return valuePrintImpl(v, printf);
+    return valuePrintWith(v, printf);
 }
 
 /*==== Kind specific operations ====*/
@@ -300,26 +532,45 @@ int64_t valueGetInt (const value* num) {
     return num->integer;
 }
 
-static const char* valueGetStrImpl (const value* str, size_t* length) {
-    if (!precond_valueKind(str, valueStr)) {
-        if (length)
-            *length = 0;
-
+const char* valueGetStr (const value* str) {
+    if (!precond_valueKind(str, valueStr))
         return "";
+
+    if (str->strTerminated)
+        return str->str;
+
+    _Atomic(const char*)* published = &((value*) str)->strCopy;
+    const char* copy = atomic_load_explicit(published, memory_order_acquire);
+
+    /*Threads racing to copy it all use whichever copy is published first*/
+    if (!copy) {
+        char* fresh = GC_MALLOC_ATOMIC(str->strlen+1);
+        memcpy(fresh, str->str, str->strlen);
+        fresh[str->strlen] = 0;
+
+        copy = atomic_compare_exchange_strong_explicit(published, &copy, fresh,
+                                                       memory_order_acq_rel, memory_order_acquire)
+               ? fresh : copy;
     }
 
-    if (length)
-        *length = str->strlen;
+    return copy;
+}
 
+const char* valueGetStrWithLength (const value* str, size_t* length) {
+    if (!precond_valueKind(str, valueStr)) {
+        *length = 0;
+        return "";
+    }
+
+    *length = str->strlen;
     return str->str;
 }
 
-const char* valueGetStr (const value* str) {
-    return valueGetStrImpl(str, 0);
-}
+const regex* valueGetRegex (const value* re) {
+    if (!precond_valueKind(re, valueRegex))
+        return 0;
 
-const char* valueGetStrWithLength (const value* str, size_t* length) {
-    return valueGetStrImpl(str, length);
+    return re->re;
 }
 
 value* valueCall (const value* fn, const value* arg) {
@@ -341,7 +592,7 @@ value* valueCall (const value* fn, const value* arg) {
 
         /*More args to come, store in another closure*/
         if (argValues.length < fn->argSymbols->length)
-            return valueCreateASTClosure(*fn->argSymbols, argValues, fn->body);
+            return valueCreateASTClosure(*fn->argSymbols, argValues, fn->body, fn->dirs);
 
         /*Enough, run the body with this environment*/
         else {
@@ -350,7 +601,8 @@ value* valueCall (const value* fn, const value* arg) {
 
             envCtx env = {
                 .symbols = *fn->argSymbols,
-                .values = argValues
+                .values = argValues,
+                .dirs = fn->dirs
             };
 
             return run(&env, fn->body);
@@ -362,6 +614,28 @@ value* valueCall (const value* fn, const value* arg) {
     }
 }
 
+bool valueGetASTClosure (const value* fn, vector(sym*)* args, const ast** body) {
+    if (!precond(fn) || fn->kind != valueASTClosure)
+        return false;
+
+    /*The values held must all be those of the globals captured.
+      An arg given would be bound to a symbol with no global value.*/
+    for_vector_indexed (i, value* held, *fn->argValues, {
+        sym* symbol = vectorGet(*fn->argSymbols, i);
+
+        if (symbol->val != held)
+            return false;
+    })
+
+    *args = vectorInit(fn->argSymbols->length, GC_malloc);
+
+    for (int i = fn->argValues->length; i < fn->argSymbols->length; i++)
+        vectorPush(args, vectorGet(*fn->argSymbols, i));
+
+    *body = fn->body;
+    return true;
+}
+
 static bool isFileish (const value* v) {
     return    v->kind == valueFile
            || v->kind == valueStr;
@@ -386,7 +660,7 @@ const char* valueGetFilename (const value* v) {
         return v->absolute;
 
     } else
-        return v->str;
+        return valueGetStr(v);
 }
 
 const char* valueGetDisplayFilename (const value* v) {
@@ -397,16 +671,163 @@ const char* valueGetDisplayFilename (const value* v) {
         return v->filename;
 
     else
-        return v->str;
+        return valueGetStr(v);
+}
+
+const dict* valueGetDict (const value* d) {
+    if (!precond_valueKind(d, valueDict))
+        return dictCreate(0);
+
+    return d->table;
+}
+
+static bool isTuple (const value* v) {
+    return    v->kind == valuePair
+           || v->kind == valueTriple
+           || v->kind == valueVector;
+}
+
+static int valueGetTupleLength (const value* tuple) {
+    return tuple->kind == valueVector ? tuple->vec.length : tuple->kind == valuePair ? 2 : 3;
+}
+
+uint64_t valueHash (const value* key) {
+    if (!precond(key))
+        return 0;
+
+    switch (key->kind) {
+    case valueInt:
+        return hashFast(&key->integer, sizeof(key->integer), valueInt);
+
+    case valueStr:
+        return hashFast(key->str, key->strlen, valueStr);
+
+    case valueFile: {
+        const char* filename = valueGetFilename(key);
+        return hashFast(filename, strlen(filename), valueFile);
+    }
+
+    case valuePair:
+    case valueTriple:
+    case valueVector: {
+        uint64_t hash = valuePair;
+
+        for (int i = 0, n = valueGetTupleLength(key); i < n; i++) {
+            uint64_t element = valueHash(valueGetTupleNth(key, i));
+            hash = hashFast(&element, sizeof(element), hash);
+        }
+
+        return hash;
+    }
+
+    default:
+        errprintf("Unhashable value kind, %s\n", valueKindGetStr(key->kind));
+        return 0;
+    }
+}
+
+bool valueIsEqual (const value* l, const value* r) {
+    if (!precond(l && r))
+        return false;
+
+    if (l == r)
+        return true;
+
+    if (isTuple(l) && isTuple(r)) {
+        int n = valueGetTupleLength(l);
+
+        if (n != valueGetTupleLength(r))
+            return false;
+
+        for (int i = 0; i < n; i++)
+            if (!valueIsEqual(valueGetTupleNth(l, i), valueGetTupleNth(r, i)))
+                return false;
+
+        return true;
+
+    } else if (l->kind != r->kind)
+        return false;
+
+    switch (l->kind) {
+    case valueInt:
+        return l->integer == r->integer;
+
+    case valueStr:
+        return l->strlen == r->strlen && !memcmp(l->str, r->str, l->strlen);
+
+    case valueFile:
+        return !strcmp(valueGetFilename(l), valueGetFilename(r));
+
+    default:
+        errprintf("Uncomparable value kind, %s\n", valueKindGetStr(l->kind));
+        return false;
+    }
 }
 
 /*---- Iterables ----*/
 
+/*Produce elements of a stream until it has more than n, or has ended.
+  Returns whether the nth element exists. The stream must be locked.*/
+static bool streamProduce (value* stream, int n) {
+    while (stream->produced.length <= n && !stream->streamEnded && !cancelled()) {
+        value* element = stream->next(stream->streamState);
+
+        if (element)
+            vectorPush(&stream->produced, element);
+
+        /*Stopped short, but not ended: it can be picked up again*/
+        else if (cancelled())
+            break;
+
+        else {
+            stream->streamEnded = true;
+            /*Let the producer's resources go*/
+            stream->streamState = 0;
+        }
+    }
+
+    return n < stream->produced.length;
+}
+
+/*The nth element, or null if there isn't one (yet)*/
+static value* streamGet (const value* stream, int n) {
+    pthread_mutex_lock(stream->streamLock);
+
+    value* element =   streamProduce((value*) stream, n)
+                     ? vectorGet(stream->produced, n) : 0;
+
+    pthread_mutex_unlock(stream->streamLock);
+    return element;
+}
+
+static int streamGetLength (const value* stream) {
+    pthread_mutex_lock(stream->streamLock);
+
+    streamProduce((value*) stream, INT_MAX);
+    int length = stream->produced.length;
+
+    pthread_mutex_unlock(stream->streamLock);
+    return length;
+}
+
+/*All of the elements, as far as it could be produced*/
+static vector(value*) streamGetAll (const value* stream) {
+    pthread_mutex_lock(stream->streamLock);
+
+    streamProduce((value*) stream, INT_MAX);
+    /*A copy, as the original may grow (and move) if it was cut short*/
+    vector(value*) produced = vectorDup(stream->produced, GC_malloc);
+
+    pthread_mutex_unlock(stream->streamLock);
+    return produced;
+}
+
 static bool isIterable (const value* iterable) {
     switch (iterable->kind) {
     case valuePair:
     case valueTriple:
     case valueVector:
+    case valueStream:
         return true;
     default:
         return false;
@@ -426,12 +847,26 @@ int valueGuessIterableLength (const value* iterable) {
     case valueVector:
         return iterable->vec.length;
 
+    case valueStream:
+        return streamGetLength(iterable);
+
     default:
         errprintf("Unhandled iterable kind, %s\n", valueKindGetStr(iterable->kind));
         return 3;
     }
 }
 
+bool valueIsLazy (const value* iterable) {
+    if (!precond(iterable) || iterable->kind != valueStream)
+        return false;
+
+    pthread_mutex_lock(iterable->streamLock);
+    bool ended = iterable->streamEnded;
+    pthread_mutex_unlock(iterable->streamLock);
+
+    return !ended;
+}
+
 bool valueGetIterator (const value* iterable, valueIter* iter) {
     if (!precond_value(iterable, isIterable)) {
         *iter = (valueIter) {.kind = iterInvalid};
@@ -441,13 +876,15 @@ bool valueGetIterator (const value* iterable, valueIter* iter) {
     switch (iterable->kind) {
     case valuePair:
     case valueTriple:
-    case valueVector: {
+    case valueVector:
+    case valueStream: {
         *iter = (valueIter) {
             .iterable = iterable, .index = -1
         };
 
         iter->kind =   iterable->kind == valuePair ? iterPair
-                     : iterable->kind == valueTriple ? iterTriple : iterVector;
+                     : iterable->kind == valueTriple ? iterTriple
+                     : iterable->kind == valueStream ? iterStream : iterVector;
 
         return false;
     }
@@ -467,12 +904,26 @@ const value* valueIterRead (valueIter* iterator) {
 }
 
 vector(const value*) valueGetVector (const value* iterable) {
-    if (   !precond_value(iterable, isIterable)
-        || !precond(iterable->kind == valueVector))
+    if (!precond_value(iterable, isIterable))
         /*Dummy vector*/
         return vectorInit(1, GC_malloc);
 
-    return iterable->vec;
+    /*Short lists may be stored as pairs and triples*/
+    if (iterable->kind == valuePair || iterable->kind == valueTriple) {
+        vector(value*) elements = vectorInit(3, GC_malloc);
+        vectorPush(&elements, iterable->first);
+        vectorPush(&elements, iterable->second);
+
+        if (iterable->kind == valueTriple)
+            vectorPush(&elements, iterable->third);
+
+        return elements;
+
+    } else if (iterable->kind == valueStream)
+        return streamGetAll(iterable);
+
+    else
+        return iterable->vec;
 }
 
 /*---- ----*/
@@ -495,6 +946,10 @@ const value* valueGetTupleNth (const value* tuple, int n) {
     case valueVector:
         return vectorGet(tuple->vec, n);
 
+    case valueStream:
+        /*Only produce as far as is asked for*/
+        return streamGet(tuple, n);
+
     default:
         errprintf("Unhandled iterable kind, %s\n", valueKindGetStr(tuple->kind));
         return valueCreateInvalid();
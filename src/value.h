@@ -9,7 +9,7 @@
 typedef struct value value;
 
 typedef enum iterKind {
-    iterVector, iterPair, iterTriple, iterInvalid
+    iterVector, iterPair, iterTriple, iterStream, iterInvalid
 } iterKind;
 
 typedef struct valueIter {
@@ -32,17 +32,38 @@ typedef struct valueIter {
 
 typedef value* (*simpleClosureFn)(const void* env, const value* arg);
 
+/*Produces the next element of a stream, or null once there are none left.*/
+typedef value* (*streamNextFn)(void* state);
+
+/*Computes the value of a deferred future, see valueCreateDeferred*/
+typedef value* (*deferredFn)(void* state);
+
 /*All objects given to these creators must be GC allocated*/
 
 value* valueCreateInvalid (void);
 value* valueCreateUnit (void);
-value* valueCreateInt (int integer);
+value* valueCreateInt (int64_t integer);
 value* valueCreateFloat (double number);
 /*Duplicates str*/
 value* valueCreateStr (char* str);
 
+/*Releases memory not allocated by the GC, e.g. a mapping*/
+typedef void (*strReleaseFn)(const char* str, size_t length);
+
+/*Part of another string, [str, str+length), sharing its memory*/
+value* valueCreateStrView (const value* parent, const char* str, size_t length);
+
+/*Takes a string of a known length, null terminated, without copying it.
+  It is either GC allocated (release is null) or released by the given
+  function once the value is collected.*/
+value* valueStoreStr (const char* str, size_t length, strReleaseFn release);
+
+value* valueCreateRegex (const regex* re);
+
 /*Duplicates the filename but takes the relative path, which must be GC allocated.*/
 value* valueCreateFile (const char* filename, const char* relativeTo);
+/*A file inside a directory, relative to the same place as it*/
+value* valueCreateFileIn (const value* dir, const char* name);
 
 value* valueCreateFn (value* (*fnptr)(const value*));
 value* valueCreateSimpleClosure (const void* env, simpleClosureFn fnptr);
@@ -52,38 +73,89 @@ value* valueCreateSimpleClosure (const void* env, simpleClosureFn fnptr);
       to value, hence their elements must correspond.
     - argSymbols contains first the captured symbols, then the args.
     - The expression can be evaluated once argValues is filled with all
-      the corresponding elements.*/
-value* valueCreateASTClosure (vector(sym*) argSymbols, vector(value*) argValues, ast* body);
+      the corresponding elements.
+    - dirs are those of the env it was created in, for the paths and
+      programs in the expression.*/
+value* valueCreateASTClosure (vector(sym*) argSymbols, vector(value*) argValues, ast* body,
+                              dirCtx* dirs);
 
 value* valueStoreTuple (int n, ...);
 value* valueStoreArray (int n, value** const array);
 /*Takes ownership of v*/
 value* valueStoreVector (vector(value*) v);
+value* valueStoreDict (const dict* table);
+
+/*A list whose elements are produced on demand, by calling next with
+  the (GC allocated) state. Elements are remembered once produced, so
+  the stream can be iterated any number of times, but nothing past what
+  is read is ever computed.*/
+value* valueCreateStream (void* state, streamNextFn next);
+
+/*A value being computed by another thread. Futures are only bound to
+  variables, and are waited for as they are read (see valueAwait).*/
+value* valueCreateFuture (void);
+
+/*Give a future its value, waking anything waiting for it*/
+void valueFutureResolve (value* future, value* result);
+
+/*A future computed by the first thread to wait for it, calling fn with
+  the (GC allocated) state, rather than by another thread. Any others
+  waiting meanwhile wait for that. If cancelled partway, it is computed
+  again by the next to wait.*/
+value* valueCreateDeferred (void* state, deferredFn fn);
 
 /*==== (Kind generic) Operations ====*/
 
 bool valueIsInvalid (const value* v);
 
+bool valueIsFuture (const value* v);
+
+/*Wait for the value of a future. Any other value is given back as is.*/
+value* valueAwait (value* v);
+
 /*Both of these return the width of the string representation of a value.
   valuePrint actually prints it.*/
 int valueGetWidthOfStr (const value* v);
 int valuePrint (const value* v);
+/*Prints using any printf-like fn, e.g. one writing to a buffer*/
+int valuePrintWith (const value* v, printf_t printf);
 
 /*==== Kind specific operations ====*/
 
 int64_t valueGetInt (const value* num);
+/*A view of another string is copied to null terminate it*/
 const char* valueGetStr (const value* str);
+/*Not necessarily null terminated*/
 const char* valueGetStrWithLength (const value* str, size_t* length_out);
 
+const regex* valueGetRegex (const value* re);
+
 value* valueCall (const value* fn, const value* arg);
 
+/*If the value is an ASTClosure which has only captured globals (so its
+  body means the same outside of it) and hasn't been given any args, get
+  the symbols of its args, and its body. Returns whether it was one.*/
+bool valueGetASTClosure (const value* fn, vector(sym*)* args_out, const ast** body_out);
+
 //todo can fail
 //fallback param?
 const char* valueGetFilename (const value* file);
 const char* valueGetDisplayFilename (const value* file);
 
+const dict* valueGetDict (const value* d);
+
+/*Hashing and equality of values that can be Dict keys: Ints, Bools,
+  Strs, Files and tuples of them. Files are compared by their full path.*/
+uint64_t valueHash (const value* key);
+bool valueIsEqual (const value* l, const value* r);
+
 /*---- Iterables ----*/
 
+/*Whether the value is a stream, which would be forced in full by
+  valueGuessIterableLength or valueGetVector.*/
+bool valueIsLazy (const value* iterable);
+
+/*Lazy lists are forced in full to find their length.*/
 int valueGuessIterableLength (const value* iterable);
 
 /*Get an iterator for an iterable value, through an out parameter.
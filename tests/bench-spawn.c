@@ -0,0 +1,72 @@
+/*For clock_gettime and fork*/
+#define _XOPEN_SOURCE 700
+
+#include "test.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gc.h>
+
+#include "src/invoke.h"
+
+/*Spawn latency against the size of the GC heap. fork copies the page
+  tables of the parent, so its cost grows with the heap, and is given
+  for comparison.*/
+
+enum {
+    spawns = 200,
+    heapStepMB = 256,
+    heapSteps = 4
+};
+
+static char* argv[] = {"/bin/true", 0};
+
+static double now (void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static int forkSyncronously (char** argv) {
+    pid_t child = fork();
+
+    if (child == 0) {
+        execv(argv[0], argv);
+        _exit(1);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    return WEXITSTATUS(status);
+}
+
+static double timeSpawns (int (*spawn)(char** argv)) {
+    double start = now();
+
+    for (int i = 0; i < spawns; i++)
+        expect(spawn(argv) == 0);
+
+    return (now() - start) / spawns * 1e6;
+}
+
+void bench_spawn (void) {
+    GC_INIT();
+
+    printf("%10s %12s %12s\n", "heap (MB)", "spawn (us)", "fork (us)");
+
+    for (int step = 0; step <= heapSteps; step++) {
+        if (step != 0) {
+            /*Touch every page so that it is mapped*/
+            size_t size = (size_t) heapStepMB << 20;
+            char* block = GC_MALLOC_ATOMIC(size);
+            require(block);
+            memset(block, 1, size);
+        }
+
+        printf("%10d %12.1f %12.1f\n", step*heapStepMB,
+               timeSpawns(invokeSyncronously), timeSpawns(forkSyncronously));
+    }
+}
+
+TEST_GLOBAL_SETUP(bench_spawn);
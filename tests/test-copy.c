@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+
+#include "test.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "src/copy.h"
+
+static char root[] = "/tmp/test-copy-XXXXXX";
+
+static const char* at (const char* name) {
+    static char paths[4][64];
+    static int next = 0;
+
+    char* path = paths[next++ % 4];
+    snprintf(path, sizeof(paths[0]), "%s/%s", root, name);
+    return path;
+}
+
+static bool sameContents (const char* left, const char* right) {
+    FILE *l = fopen(left, "rb"),
+         *r = fopen(right, "rb");
+    bool same = l && r;
+
+    for (int lc = 0, rc = 0; same && lc != EOF; ) {
+        lc = fgetc(l);
+        rc = fgetc(r);
+        same = lc == rc;
+    }
+
+    if (l) fclose(l);
+    if (r) fclose(r);
+    return same;
+}
+
+void test_copy (void) {
+    require(mkdtemp(root));
+    require(!mkdir(at("dir"), 0755));
+
+    /*More than a buffer's worth, not a multiple of it*/
+    FILE* file = fopen(at("original"), "wb");
+    require(file);
+
+    for (int i = 0; i < 3000001; i++)
+        fputc(i*31 % 251, file);
+
+    fclose(file);
+    chmod(at("original"), 0640);
+
+    const char* error = 0;
+    expect(copyFile(at("original"), at("copy"), &error));
+    expect(sameContents(at("original"), at("copy")));
+
+    mode_t mask = umask(0);
+    umask(mask);
+
+    struct stat st;
+    expect(!stat(at("copy"), &st) && (st.st_mode & 0777) == (0640 & ~mask));
+
+    /*Replacing what was there*/
+    expect(copyFile(at("dir/../original"), at("copy"), &error));
+    expect(sameContents(at("original"), at("copy")));
+
+    expect(!copyFile(at("original"), at("dir/../original"), &error));
+    expect_str_equal("they are the same file", error);
+    expect(sameContents(at("original"), at("copy")));
+
+    expect(!copyFile(at("dir"), at("copy2"), &error));
+    expect(!copyFile(at("missing"), at("copy2"), &error));
+    expect(access(at("copy2"), F_OK));
+
+    unlink(at("original"));
+    unlink(at("copy"));
+    rmdir(at("dir"));
+    rmdir(root);
+}
+
+TEST_GLOBAL_SETUP(test_copy)
@@ -0,0 +1,60 @@
+#include "test.h"
+
+#include <gc.h>
+
+#include "src/value.h"
+#include "src/dict.h"
+
+static value* strOf (const char* str) {
+    return valueStoreStr(str, strlen(str), 0);
+}
+
+void test_dict (void) {
+    GC_INIT();
+
+    /*Enough to grow it several times*/
+    enum {n = 10000};
+
+    dict* d = dictCreate(0);
+
+    for (int i = 0; i < n; i++)
+        dictSet(d, valueCreateInt(i*7), valueCreateInt(i));
+
+    expect(dictGetLength(d) == n);
+
+    bool found = true, missing = true;
+
+    for (int i = 0; i < n; i++) {
+        const value* v = dictGet(d, valueCreateInt(i*7));
+        found &= v && valueGetInt(v) == i;
+        missing &= !dictGet(d, valueCreateInt(i*7 + 1));
+    }
+
+    expect(found);
+    expect(missing);
+
+    /*Replacing a value keeps the entry where it was*/
+    dictSet(d, valueCreateInt(7), strOf("seven"));
+    expect(dictGetLength(d) == n);
+
+    const value *key, *val;
+    dictGetNth(d, 1, &key, &val);
+    expect(valueGetInt(key) == 7);
+    expect_str_equal("seven", valueGetStr(val));
+
+    /*Keys are compared by value: strings, views of them, and tuples*/
+    dict* s = dictCreate(2);
+    dictSet(s, strOf("ab"), valueCreateInt(1));
+    dictSet(s, valueStoreTuple(2, strOf("x"), valueCreateInt(2)), valueCreateInt(2));
+
+    const value* abc = strOf("abc");
+    const value* v = dictGet(s, valueCreateStrView(abc, valueGetStr(abc), 2));
+    expect(v && valueGetInt(v) == 1);
+    expect(!dictGet(s, abc));
+
+    v = dictGet(s, valueStoreTuple(2, strOf("x"), valueCreateInt(2)));
+    expect(v && valueGetInt(v) == 2);
+    expect(!dictGet(s, valueStoreTuple(2, strOf("x"), valueCreateInt(3))));
+}
+
+TEST_GLOBAL_SETUP(test_dict)
@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+
+#include "test.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "src/du.h"
+
+static char root[] = "/tmp/test-du-XXXXXX";
+
+static const char* at (const char* name) {
+    static char paths[8][64];
+    static int next = 0;
+
+    char* path = paths[next++ % 8];
+    snprintf(path, sizeof(paths[0]), "%s/%s", root, name);
+    return path;
+}
+
+static int64_t blocks (const char* name) {
+    struct stat st;
+    return lstat(at(name), &st) ? 0 : (int64_t) st.st_blocks * 512;
+}
+
+static void writeFile (const char* name, size_t size) {
+    int fd = open(at(name), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    require(fd >= 0);
+
+    char buffer[4096];
+    memset(buffer, 'x', sizeof(buffer));
+
+    for (size_t written = 0; written < size; written += sizeof(buffer))
+        require(write(fd, buffer, size - written < sizeof(buffer) ? size - written : sizeof(buffer)) > 0);
+
+    close(fd);
+}
+
+void test_du (void) {
+    require(mkdtemp(root));
+    require(!mkdir(at("a"), 0755) && !mkdir(at("a/b"), 0755) && !mkdir(at("c"), 0755));
+
+    writeFile("a/big", 100000);
+    writeFile("a/b/small", 5000);
+    require(!link(at("a/big"), at("c/link")));
+    require(!symlink("/usr", at("c/usr")));
+
+    const char* names[] = {"a", "c", "missing"};
+    const char* filenames[3];
+    int64_t sizes[3];
+
+    for (int i = 0; i < 3; i++)
+        filenames[i] = strdup(at(names[i]));
+
+    /*The hard link is counted once, in the first*/
+    expect(duMeasure(3, filenames, sizes));
+    expect_equal(sizes[0], blocks("a") + blocks("a/b") + blocks("a/big") + blocks("a/b/small"));
+    expect_equal(sizes[1], blocks("c") + blocks("c/usr"));
+    expect_equal(sizes[2], -1);
+
+    /*Whichever order the tree is read in*/
+    const char* reversed[] = {filenames[1], filenames[0]};
+    expect(duMeasure(2, reversed, sizes));
+    expect_equal(sizes[0], blocks("c") + blocks("c/usr") + blocks("c/link"));
+    expect_equal(sizes[1], blocks("a") + blocks("a/b") + blocks("a/b/small"));
+
+    const char* rootname = root;
+    expect(duMeasure(1, &rootname, sizes));
+    expect_equal(sizes[0],   blocks("") + blocks("a") + blocks("a/b") + blocks("a/big")
+                           + blocks("a/b/small") + blocks("c") + blocks("c/usr"));
+
+    unlink(at("c/usr"));
+    unlink(at("c/link"));
+    unlink(at("a/b/small"));
+    unlink(at("a/big"));
+    rmdir(at("a/b"));
+    rmdir(at("a"));
+    rmdir(at("c"));
+    rmdir(root);
+}
+
+TEST_GLOBAL_SETUP(test_du)
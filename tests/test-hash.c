@@ -0,0 +1,29 @@
+#include "test.h"
+
+#include "src/hash.h"
+
+static const char* sha256Hex (const char* str) {
+    static char hex[2*hashSHA256Size + 1];
+    uint8_t digest[hashSHA256Size];
+
+    hashSHA256(str, strlen(str), digest);
+    hashToHex(digest, hashSHA256Size, hex);
+    return hex;
+}
+
+void test_hash (void) {
+    /*Known values, across the lengths handled differently*/
+    expect(hashFast("", 0, 0) == 0xef46db3751d8e999ULL);
+    expect(hashFast("a", 1, 0) == 0xd24ec4f1a98c6e5bULL);
+
+    const char* sentence = "Nobody inspects the spammish repetition";
+    expect(hashFast(sentence, strlen(sentence), 0) == 0xfbcea83c8a378bf1ULL);
+
+    expect_str_equal(sha256Hex(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    expect_str_equal(sha256Hex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    /*Padding that spills into a second block*/
+    expect_str_equal(sha256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+                     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST_GLOBAL_SETUP(test_hash)
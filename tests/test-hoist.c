@@ -0,0 +1,87 @@
+#include "test.h"
+
+#include <gc.h>
+
+#include "src/type.h"
+#include "src/sym.h"
+#include "src/ast.h"
+#include "src/dirctx.h"
+#include "src/builtins.h"
+
+#include "src/lexer.h"
+#include "src/parser.h"
+#include "src/analyzer.h"
+#include "src/optimizer.h"
+
+#include "src/value.h"
+#include "src/runner.h"
+
+static _Atomic int failCalls = 0;
+
+/*File -> Int, always failing. Invariant, so it gets hoisted out of lambdas.*/
+static value* builtinFail (const value* file) {
+    (void) file;
+    failCalls++;
+    return valueCreateInvalid();
+}
+
+/*Compile, optimize and run a program, or null if it didn't compile*/
+static value* runProgram (typeSys* ts, sym* global, dirCtx* dirs, const char* str) {
+    lexerCtx lexer = lexerInit(str);
+    parserResult parsed = parse(global, ts, &lexer);
+    lexerDestroy(&lexer);
+
+    analyzerResult analyzed = analyze(ts, parsed.tree);
+
+    if (parsed.errors || analyzed.errors) {
+        astDestroy(parsed.tree);
+        return 0;
+    }
+
+    optimize(parsed.tree);
+
+    envCtx env = {.dirs = dirs};
+    value* result = run(&env, parsed.tree);
+
+    astDestroy(parsed.tree);
+    return result;
+}
+
+void test_hoist (void) {
+    GC_INIT();
+
+    typeSys ts = typesInit();
+    sym* global = symInit();
+    dirCtx dirs = dirsInit();
+
+    addBuiltins(&ts, global);
+
+    sym* fail = symAdd(global, "fail");
+    fail->dt = typeFn(&ts, typeUnitary(&ts, type_File), typeUnitary(&ts, type_Int));
+    fail->val = valueCreateFn(builtinFail);
+
+    /*Never called, so the hoisted failure is never run*/
+
+    value* none = runProgram(&ts, global, &dirs, "[1, 2, 3] | 0 take | \\x :: Int -> a.txt fail");
+    require(none);
+
+    expect(!valueIsInvalid(none));
+    expect_equal(valueGetVector(none).length, 0);
+    expect_equal(failCalls, 0);
+
+    /*Called for each, but the hoisted expression is run only once*/
+
+    value* each = runProgram(&ts, global, &dirs, "[1, 2, 3] | \\x :: Int -> a.txt fail");
+    require(each);
+
+    expect_equal(valueGetVector(each).length, 3);
+    expect_equal(failCalls, 1);
+
+    /*Teardown*/
+
+    symEnd(global);
+    dirsFree(&dirs);
+    typesFree(&ts);
+}
+
+TEST_GLOBAL_SETUP(test_hoist)
@@ -0,0 +1,122 @@
+#include "test.h"
+
+#include "src/regex.h"
+
+typedef struct regexCase {
+    const char *pattern, *str;
+    bool matches;
+} regexCase;
+
+static const regexCase cases[] = {
+    /*Literals, which are found without running the automaton*/
+    {"needle", "haystack with a needle in it", true},
+    {"needle", "haystack with a needl", false},
+    {"", "", true},
+    {"", "anything", true},
+
+    /*Anchors*/
+    {"^abc", "abcdef", true},
+    {"^abc", "xabc", false},
+    {"abc$", "xxabc", true},
+    {"abc$", "abcx", false},
+    {"^$", "", true},
+    {"^$", "x", false},
+    {"^a*$", "aaaa", true},
+    {"^a*$", "aaba", false},
+
+    /*Repetition*/
+    {"ab*c", "ac", true},
+    {"ab+c", "ac", false},
+    {"ab+c", "xxabbbc", true},
+    {"colou?r", "color", true},
+    {"^a{3}$", "aaa", true},
+    {"^a{3}$", "aaaa", false},
+    {"^a{2,}$", "a", false},
+    {"^a{2,}$", "aaaaa", true},
+    {"^a{2,3}$", "aaaa", false},
+    {"^(ab){1,2}c$", "ababc", true},
+    {"a{x", "a{x", true},
+    {"(a*)*b", "aaab", true},
+    {"(a*)*b", "aaaa", false},
+
+    /*Alternation and groups*/
+    {"cat|dog", "hotdog", true},
+    {"cat|dog", "bird", false},
+    {"^(?:cat|dog)s$", "dogs", true},
+    {"^(cat|dog)s$", "cats!", false},
+
+    /*Classes and escapes*/
+    {"[0-9]+-[0-9]+", "call 555-1234", true},
+    {"^[^aeiou]+$", "rhythm", true},
+    {"^[^aeiou]+$", "rhyme", false},
+    {"[]x]", "]", true},
+    {"[a-]", "-", true},
+    {"\\d\\d:\\d\\d", "at 12:30", true},
+    {"\\d\\d:\\d\\d", "at 1:30", false},
+    {"^\\w+$", "snake_case9", true},
+    {"^\\S+\\s\\S+$", "two words", true},
+    {"\\x41", "A", true},
+    {"a\\.b", "axb", false},
+    {"a.b", "axb", true},
+    {"a.b", "a\nb", false},
+
+    /*A literal that must be there, but isn't the prefix*/
+    {"[a-z]+@example\\.com", "mail bob@example.com", true},
+    {"[a-z]+@example\\.com", "mail @example.com", false},
+};
+
+static const char* const badPatterns[] = {
+    "(abc", "abc)", "[abc", "*a", "a{3,2}", "\\q", "[z-a]", "a\\"
+};
+
+void test_regex (void) {
+    char* error;
+
+    for (size_t i = 0; i < sizeof(cases)/sizeof(*cases); i++) {
+        const regexCase* c = &cases[i];
+        regex* re = regexCompile(c->pattern, &error);
+        require(re);
+
+        if (regexMatch(re, c->str, strlen(c->str)) != c->matches)
+            test_errprintf(__FILE__, __func__, __LINE__, "'%s' on '%s'\n", c->pattern, c->str);
+    }
+
+    for (size_t i = 0; i < sizeof(badPatterns)/sizeof(*badPatterns); i++) {
+        error = 0;
+        expect_null(regexCompile(badPatterns[i], &error));
+        expect(error);
+        free(error);
+    }
+
+    /*Compiled only once*/
+    expect(regexCompile("ab+c", &error) == regexCompile("ab+c", &error));
+
+    /*Lines, with \r\n line endings too*/
+    const char* text = "one\r\ntwo words\nthree\nfour words";
+    const char *end = text + strlen(text), *lineEnd;
+
+    regex* words = regexCompile("w[a-z]+s", &error);
+    const char* line = regexFindLine(words, text, end, &lineEnd);
+    expect(line == text+5 && lineEnd == text+14);
+
+    line = regexFindLine(words, lineEnd, end, &lineEnd);
+    expect(line && !strcmp(line, "four words") && lineEnd == end);
+
+    expect(regexFindLine(regexCompile("^one$", &error), text, end, &lineEnd) == text);
+    expect_null((void*) regexFindLine(regexCompile("^three$", &error), text, text+16, &lineEnd));
+
+    /*More states than fit, using the fallback*/
+    regex* re = regexCompile("a[ab]{12}$", &error);
+    require(re);
+
+    char str[4096];
+
+    for (size_t i = 0; i < sizeof(str); i++)
+        str[i] = "ab"[(i*7 + i/3) % 5 == 0];
+
+    str[sizeof(str)-13] = 'a';
+    expect(regexMatch(re, str, sizeof(str)));
+    expect(!regexMatch(re, "abababababab", 12));
+}
+
+TEST_GLOBAL_SETUP(test_regex)
@@ -0,0 +1,76 @@
+#include "test.h"
+
+#include <gc.h>
+#include <unistd.h>
+
+#include "src/value.h"
+#include "src/table.h"
+
+static const value* field (const value* rows, int row, int column) {
+    const value* fields = valueGetTupleNth(rows, row);
+    return fields ? valueGetTupleNth(fields, column) : 0;
+}
+
+static const char* fieldStr (const value* rows, int row, int column) {
+    const value* str = field(rows, row, column);
+    return str ? valueGetStr(str) : 0;
+}
+
+static const value* readTableOf (const char* filename, const char* contents) {
+    FILE* file = fopen(filename, "w");
+    require(file);
+    fputs(contents, file);
+    fclose(file);
+
+    const value* rows = tableRead(filename);
+    unlink(filename);
+
+    return rows;
+}
+
+void test_table (void) {
+    GC_INIT();
+
+    /*Quoting*/
+
+    const value* rows = readTableOf("/tmp/tush-test-table.csv",
+        "a,b,c\n"
+        "\"x, y\",\"say \"\"hi\"\"\",\n"
+        "\"two\nlines\",2,3\r\n"
+        "\n"
+        "last,row");
+
+    expect_str_equal("a", fieldStr(rows, 0, 0));
+    expect_str_equal("c", fieldStr(rows, 0, 2));
+    expect_str_equal("x, y", fieldStr(rows, 1, 0));
+    expect_str_equal("say \"hi\"", fieldStr(rows, 1, 1));
+    expect_str_equal("", fieldStr(rows, 1, 2));
+    expect_str_equal("two\nlines", fieldStr(rows, 2, 0));
+    /*No carriage return*/
+    expect_str_equal("3", fieldStr(rows, 2, 2));
+    /*Blank lines are skipped, a last line needs no newline*/
+    expect_str_equal("row", fieldStr(rows, 3, 1));
+    expect_null((void*) valueGetTupleNth(rows, 4));
+
+    /*Tabs, and rows spanning the blocks read*/
+
+    enum {longLength = 200*1000};
+
+    char* contents = malloc(longLength + 32);
+    strcpy(contents, "1\t");
+    memset(contents+2, 'x', longLength);
+    strcpy(contents+2+longLength, "\n2\tshort\n");
+
+    rows = readTableOf("/tmp/tush-test-table.tsv", contents);
+
+    expect_equal(strlen(fieldStr(rows, 0, 1)), longLength);
+    expect_str_equal("short", fieldStr(rows, 1, 1));
+
+    free(contents);
+
+    /*Can't be opened*/
+
+    expect(valueIsInvalid(tableRead("/tmp/tush-test-table-missing.csv")));
+}
+
+TEST_GLOBAL_SETUP(test_table)